@@ -0,0 +1,63 @@
+/**
+ * Allocates the arena of a wheel, zeroed
+ * @param t150 ptr to t150
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int t150_init_arena(struct t150 *t150)
+{
+	struct t150_arena *arena = kzalloc(sizeof(struct t150_arena), GFP_KERNEL);
+
+	if(!arena)
+		return -ENOMEM;
+
+	arena->buffer = usb_alloc_coherent(t150->usb_device, T150_ARENA_SIZE, GFP_KERNEL, &arena->dma);
+	if(!arena->buffer) {
+		kfree(arena);
+		return -ENOMEM;
+	}
+
+	memset(arena->buffer, 0, T150_ARENA_SIZE);
+	t150->arena = arena;
+
+	return 0;
+}
+
+/**
+ * Frees the arena. To be called after all its URBs were killed
+ * @param t150 ptr to t150
+ */
+static void t150_free_arena(struct t150 *t150)
+{
+	if(!t150->arena)
+		return;
+
+	usb_free_coherent(t150->usb_device, T150_ARENA_SIZE, t150->arena->buffer, t150->arena->dma);
+	kfree(t150->arena);
+	t150->arena = 0;
+}
+
+/**
+ * Gives an URB its buffer, taken from the arena. The URB is submitted
+ * with the DMA address of the buffer, nothing is mapped at submit time.
+ * Buffers are never given back, only the whole arena is freed
+ * @param t150 ptr to t150
+ * @param urb the URB, already filled
+ * @param size size of the buffer
+ * @return 0 on success, -ENOMEM if the arena is full
+ */
+static int t150_arena_bind(struct t150 *t150, struct urb *urb, size_t size)
+{
+	struct t150_arena *arena = t150->arena;
+
+	if(arena->used + size > T150_ARENA_SIZE)
+		return -ENOMEM;
+
+	urb->transfer_buffer = (uint8_t *)arena->buffer + arena->used;
+	urb->transfer_dma = arena->dma + arena->used;
+	urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+
+	// The next buffer starts on a new cache line
+	arena->used += L1_CACHE_ALIGN(size);
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+/********************************************************************
+ *			     BUFFER ARENA
+ *
+ *     The buffers of every URB that goes to the OUT endpoint,
+ *   and of the IN URB of the driver, are carved from a single
+ *   DMA-coherent block per wheel, each on its own cache lines,
+ *           so submits skip the DMA mapping
+ *******************************************************************/
+
+/** Room for the buffers of the URB pool, of the effect slots and of the IN URB */
+#define T150_ARENA_SIZE \
+	(T150_POOL_SIZE * L1_CACHE_ALIGN(T150_POOL_BUFFER_SIZE) + \
+	T150_FF_DEVICE_SLOTS * L1_CACHE_ALIGN(T150_FF_SLOT_BUFFER_SIZE) + \
+	L1_CACHE_ALIGN(T150_INPUT_BUFFER_SIZE))
+
+struct t150_arena
+{
+	void		*buffer;
+	dma_addr_t	dma;
+	/** Bytes already given to an URB */
+	size_t		used;
+};
+
+static int t150_init_arena(struct t150 *t150);
+static void t150_free_arena(struct t150 *t150);
+
+static int t150_arena_bind(struct t150 *t150, struct urb *urb, size_t size);
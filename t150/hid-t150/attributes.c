@@ -1,10 +1,6 @@
 static inline int t150_init_attributes(struct t150 *t150)
 {
-	int errno;
-
-	// Before making avaible the syfs attrbiutes we try to set them to some default
-	// @FIXME I do not know if it is desiradable to wait for URBs in probe() method...
-	t150_setup_task(t150);
+	int errno, i;
 
 	errno = device_create_file(&t150->usb_device->dev, &dev_attr_autocenter);
 	if(errno)
@@ -26,9 +22,67 @@ static inline int t150_init_attributes(struct t150 *t150)
 	if(errno)
 		goto err4;
 
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_ff_coalesce);
+	if(errno)
+		goto err5;
+
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_settings_wait);
+	if(errno)
+		goto err6;
+
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_ff_reconstruct);
+	if(errno)
+		goto err7;
+
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_ff_latency_us);
+	if(errno)
+		goto err8;
+
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_ff_slew);
+	if(errno)
+		goto err9;
+
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_ff_persist);
+	if(errno)
+		goto err10;
+
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_poll_interval);
+	if(errno)
+		goto err11;
+
+	errno = device_create_file(&t150->usb_device->dev, &dev_attr_report_rate);
+	if(errno)
+		goto err12;
+
+	for(i = 0; i < T150_AXES; i++) {
+		errno = device_create_bin_file(&t150->usb_device->dev, &t150_bin_attr_lut[i]);
+		if(errno)
+			goto err13;
+	}
+
+	for(i = 0; i < T150_AXES; i++) {
+		errno = device_create_file(&t150->usb_device->dev, &t150_dev_attr_filter[i]);
+		if(errno)
+			goto err14;
+	}
+
 	return 0;
 
-err4:	device_remove_file(&t150->usb_device->dev, &dev_attr_firmware_version);
+err14:	while(i--)
+		device_remove_file(&t150->usb_device->dev, &t150_dev_attr_filter[i]);
+	i = T150_AXES;
+err13:	while(i--)
+		device_remove_bin_file(&t150->usb_device->dev, &t150_bin_attr_lut[i]);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_report_rate);
+err12:	device_remove_file(&t150->usb_device->dev, &dev_attr_poll_interval);
+err11:	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_persist);
+err10:	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_slew);
+err9:	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_latency_us);
+err8:	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_reconstruct);
+err7:	device_remove_file(&t150->usb_device->dev, &dev_attr_settings_wait);
+err6:	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_coalesce);
+err5:	device_remove_file(&t150->usb_device->dev, &dev_attr_firmware_version);
+err4:	device_remove_file(&t150->usb_device->dev, &dev_attr_gain);
 err3:	device_remove_file(&t150->usb_device->dev, &dev_attr_range);
 err2:	device_remove_file(&t150->usb_device->dev, &dev_attr_enable_autocenter);
 err1:	device_remove_file(&t150->usb_device->dev, &dev_attr_autocenter);
@@ -37,11 +91,26 @@ err1:	device_remove_file(&t150->usb_device->dev, &dev_attr_autocenter);
 
 static inline void t150_free_attributes(struct t150 *t150)
 {
+	int i;
+
 	device_remove_file(&t150->usb_device->dev, &dev_attr_autocenter);
 	device_remove_file(&t150->usb_device->dev, &dev_attr_enable_autocenter);
 	device_remove_file(&t150->usb_device->dev, &dev_attr_range);
 	device_remove_file(&t150->usb_device->dev, &dev_attr_gain);
 	device_remove_file(&t150->usb_device->dev, &dev_attr_firmware_version);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_coalesce);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_settings_wait);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_reconstruct);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_latency_us);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_slew);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_ff_persist);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_poll_interval);
+	device_remove_file(&t150->usb_device->dev, &dev_attr_report_rate);
+
+	for(i = 0; i < T150_AXES; i++) {
+		device_remove_bin_file(&t150->usb_device->dev, &t150_bin_attr_lut[i]);
+		device_remove_file(&t150->usb_device->dev, &t150_dev_attr_filter[i]);
+	}
 }
 
 /**/
@@ -50,6 +119,7 @@ static ssize_t t150_store_return_force(struct device *dev, struct device_attribu
 {
 	uint8_t nforce;
 	struct t150 *t150 = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
 	if(kstrtou8(buf, 10, &nforce))
@@ -58,9 +128,9 @@ static ssize_t t150_store_return_force(struct device *dev, struct device_attribu
 	if(nforce > 100)
 		nforce = 100;
 
-	t150_set_autocenter(t150, nforce);
+	errno = t150_set_autocenter(t150, nforce, READ_ONCE(t150->settings_wait) ? T150_SETTINGS_WAIT : T150_SETTINGS_ASYNC);
 
-	return count;
+	return errno ? errno : count;
 }
 
 static ssize_t t150_show_return_force(struct device *dev, struct device_attribute *attr,char * buf )
@@ -70,7 +140,10 @@ static ssize_t t150_show_return_force(struct device *dev, struct device_attribut
 	unsigned long flags;
 
 	spin_lock_irqsave(&t150->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", t150->settings.autocenter_force);
+	if(!t150->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", t150->settings.autocenter_force);
 	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
 
 	return len;
@@ -81,12 +154,15 @@ static ssize_t t150_store_simulate_return_force(struct device *dev, struct devic
 {
 	bool use;
 	struct t150 *t150 = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
-	if(!kstrtobool(buf, &use))
-		t150_set_enable_autocenter(t150, use);	
+	if(kstrtobool(buf, &use))
+		return count;
 
-	return count;
+	errno = t150_set_enable_autocenter(t150, use, READ_ONCE(t150->settings_wait) ? T150_SETTINGS_WAIT : T150_SETTINGS_ASYNC);
+
+	return errno ? errno : count;
 }
 
 static ssize_t t150_show_simulate_return_force(struct device *dev, struct device_attribute *attr,char * buf)
@@ -96,7 +172,10 @@ static ssize_t t150_show_simulate_return_force(struct device *dev, struct device
 	unsigned long flags;
 
 	spin_lock_irqsave(&t150->settings.access_lock, flags);
-	len = sprintf(buf, "%c\n", t150->settings.autocenter_enabled ? 'y' : 'n');
+	if(!t150->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%c\n", t150->settings.autocenter_enabled ? 'y' : 'n');
 	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
 
 	return len;
@@ -107,6 +186,7 @@ static ssize_t t150_store_range(struct device *dev, struct device_attribute *att
 {
 	uint16_t range;
 	struct t150 *t150 = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
 	if(kstrtou16(buf, 10, &range))
@@ -119,9 +199,9 @@ static ssize_t t150_store_range(struct device *dev, struct device_attribute *att
 
 	range = DIV_ROUND_CLOSEST((range * 0xffff), 1080);
 
-	t150_set_range(t150, range);
+	errno = t150_set_range(t150, range, READ_ONCE(t150->settings_wait) ? T150_SETTINGS_WAIT : T150_SETTINGS_ASYNC);
 
-	return count;
+	return errno ? errno : count;
 }
 
 static ssize_t t150_show_range(struct device *dev, struct device_attribute *attr,char * buf )
@@ -131,7 +211,10 @@ static ssize_t t150_show_range(struct device *dev, struct device_attribute *attr
 	unsigned long flags;
 
 	spin_lock_irqsave(&t150->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(t150->settings.range * 1080, 0xffff));
+	if(!t150->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(t150->settings.range * 1080, 0xffff));
 	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
 
 	return len;
@@ -142,6 +225,7 @@ static ssize_t t150_store_ffb_intensity(struct device *dev, struct device_attrib
 {
 	uint8_t nforce;
 	struct t150 *t150 = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
 	if(kstrtou8(buf, 10, &nforce))
@@ -152,8 +236,8 @@ static ssize_t t150_store_ffb_intensity(struct device *dev, struct device_attrib
 
 	nforce = DIV_ROUND_CLOSEST(nforce * 0x80, 100);
 
-	t150_set_gain(t150, nforce);
-	return count;
+	errno = t150_set_gain(t150, nforce, READ_ONCE(t150->settings_wait) ? T150_SETTINGS_WAIT : T150_SETTINGS_ASYNC);
+	return errno ? errno : count;
 }
 
 static ssize_t t150_show_ffb_intensity(struct device *dev, struct device_attribute *attr,char * buf )
@@ -163,7 +247,10 @@ static ssize_t t150_show_ffb_intensity(struct device *dev, struct device_attribu
 	unsigned long flags;
 
 	spin_lock_irqsave(&t150->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(t150->settings.gain * 100, 0x80));
+	if(!t150->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(t150->settings.gain * 100, 0x80));
 	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
 
 	return len;
@@ -176,8 +263,216 @@ ssize_t t150_show_fw_version(struct device *dev, struct device_attribute *attr,c
 	unsigned long flags;
 
 	spin_lock_irqsave(&t150->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", t150->settings.firmware_version);
+	if(!t150->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", t150->settings.firmware_version);
 	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
 
 	return len;
 }
+
+static ssize_t t150_store_settings_wait(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	bool wait;
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtobool(buf, &wait))
+		WRITE_ONCE(t150->settings_wait, wait);
+
+	return count;
+}
+
+static ssize_t t150_show_settings_wait(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%c\n", READ_ONCE(t150->settings_wait) ? 'y' : 'n');
+}
+
+static ssize_t t150_store_ff_coalesce(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	bool use;
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtobool(buf, &use))
+		WRITE_ONCE(t150->ff_coalesce, use);
+
+	return count;
+}
+
+static ssize_t t150_show_ff_coalesce(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%c\n", READ_ONCE(t150->ff_coalesce) ? 'y' : 'n');
+}
+
+static ssize_t t150_store_ff_reconstruct(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+	int mode = sysfs_match_string(t150_recon_mode_names, buf);
+
+	if(mode < 0)
+		return mode;
+
+	WRITE_ONCE(t150->recon->mode, mode);
+
+	return count;
+}
+
+static ssize_t t150_show_ff_reconstruct(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", t150_recon_mode_names[READ_ONCE(t150->recon->mode)]);
+}
+
+static ssize_t t150_store_ff_latency(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	uint32_t latency;
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtou32(buf, 10, &latency))
+		WRITE_ONCE(t150->recon->latency_us, latency);
+
+	return count;
+}
+
+static ssize_t t150_show_ff_latency(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(t150->recon->latency_us));
+}
+
+static ssize_t t150_store_ff_slew(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	uint16_t slew;
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtou16(buf, 10, &slew) && slew)
+		WRITE_ONCE(t150->recon->slew, slew);
+
+	return count;
+}
+
+static ssize_t t150_show_ff_slew(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(t150->recon->slew));
+}
+
+static ssize_t t150_store_ff_persist(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	bool use;
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtobool(buf, &use))
+		WRITE_ONCE(t150->ff_persist, use);
+
+	return count;
+}
+
+static ssize_t t150_show_ff_persist(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%c\n", READ_ONCE(t150->ff_persist) ? 'y' : 'n');
+}
+
+static ssize_t t150_store_poll_interval(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	uint8_t interval;
+	struct t150 *t150 = dev_get_drvdata(dev);
+	int errno;
+
+	// If mallformed input leave...
+	if(kstrtou8(buf, 10, &interval))
+		return count;
+
+	errno = t150_input_set_poll(t150, interval);
+
+	return errno ? errno : count;
+}
+
+static ssize_t t150_show_poll_interval(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(t150->poll_interval));
+}
+
+static ssize_t t150_show_report_rate(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(t150->input_stats->rate));
+}
+
+static ssize_t t150_store_lut(struct file *file, struct kobject *kobj, t150_bin_attribute *attr,
+	char *buf, loff_t off, size_t count)
+{
+	struct t150 *t150 = dev_get_drvdata(kobj_to_dev(kobj));
+	int errno;
+
+	// The table is taken in a single write
+	if(off)
+		return -EINVAL;
+
+	errno = t150_axis_lut_store(t150, attr - t150_bin_attr_lut, buf, count);
+
+	return errno ? errno : count;
+}
+
+static ssize_t t150_show_lut(struct file *file, struct kobject *kobj, t150_bin_attribute *attr,
+	char *buf, loff_t off, size_t count)
+{
+	struct t150 *t150 = dev_get_drvdata(kobj_to_dev(kobj));
+
+	return t150_axis_lut_show(t150, attr - t150_bin_attr_lut, buf, off, count);
+}
+
+static ssize_t t150_store_filter(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+	char name[16];
+	u32 first = 0, second = 0;
+	int type, errno;
+
+	// If mallformed input leave...
+	if(sscanf(buf, "%15s %u %u", name, &first, &second) < 1)
+		return count;
+
+	for(type = 0; type < T150_AXIS_FILTER_TYPES; type++)
+		if(sysfs_streq(name, t150_axis_filter_names[type]))
+			break;
+
+	if(type == T150_AXIS_FILTER_TYPES)
+		return count;
+
+	errno = t150_axis_filter_store(t150, attr - t150_dev_attr_filter, type, first, second);
+
+	return errno ? errno : count;
+}
+
+static ssize_t t150_show_filter(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct t150 *t150 = dev_get_drvdata(dev);
+
+	return t150_axis_filter_show(t150, attr - t150_dev_attr_filter, buf);
+}
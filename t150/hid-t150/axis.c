@@ -0,0 +1,261 @@
+/** The ABS code of each axis */
+static const unsigned int t150_axis_codes[T150_AXES] = {
+	ABS_X, ABS_Y, ABS_RZ, ABS_THROTTLE
+};
+
+static inline int t150_init_axis(struct t150 *t150)
+{
+	t150->axis = kzalloc(sizeof(struct t150_axis), GFP_KERNEL);
+	if(!t150->axis)
+		return -ENOMEM;
+
+	mutex_init(&t150->axis->lock);
+
+	return 0;
+}
+
+/**
+ * To be called once no report can arrive anymore, after hid_hw_stop
+ */
+static inline void t150_free_axis(struct t150 *t150)
+{
+	struct t150_axis_filter *filter;
+	int i;
+
+	if(!t150->axis)
+		return;
+
+	for(i = 0; i < T150_AXES; i++) {
+		kfree(rcu_dereference_protected(t150->axis->lut[i], 1));
+
+		filter = rcu_dereference_protected(t150->axis->filter[i], 1);
+		if(filter) {
+			static_branch_dec(&t150_axis_filtering);
+			kfree(filter);
+		}
+	}
+
+	kfree(t150->axis);
+	t150->axis = 0;
+}
+
+/**
+ * Publishes a new table for an axis, the one it replaces is freed after
+ * a grace period so a report never sees half of a table
+ * @param t150 target wheel
+ * @param axis the axis
+ * @param buf T150_AXIS_LUT_POINTS little endian u16 values, the output for
+ *        the minimum of the axis first and for the maximum last. Anything
+ *        shorter removes the table
+ * @param count size of buf
+ * @return 0 on success, -ENOMEM if the table can not be allocated
+ */
+static int t150_axis_lut_store(struct t150 *t150, enum t150_axis_id axis, const char *buf, size_t count)
+{
+	struct t150_axis_lut *lut = 0, *old;
+	struct input_absinfo *absinfo = t150->joystick->absinfo;
+	int i;
+
+	if(count >= T150_AXIS_LUT_SIZE) {
+		lut = kmalloc(sizeof(struct t150_axis_lut), GFP_KERNEL);
+		if(!lut)
+			return -ENOMEM;
+
+		// The range given by the report descriptor, the whole u16 without one
+		lut->minimum = absinfo ? absinfo[t150_axis_codes[axis]].minimum : 0;
+		lut->maximum = absinfo ? absinfo[t150_axis_codes[axis]].maximum : U16_MAX;
+		if(lut->maximum <= lut->minimum) {
+			lut->minimum = 0;
+			lut->maximum = U16_MAX;
+		}
+
+		lut->scale = div64_u64(1ULL << (32 + T150_AXIS_LUT_SHIFT + T150_AXIS_LUT_FRAC),
+			(u64)(lut->maximum - lut->minimum));
+
+		for(i = 0; i < T150_AXIS_LUT_POINTS; i++)
+			lut->points[i] = (u8)buf[2 * i] | (u8)buf[2 * i + 1] << 8;
+	}
+
+	mutex_lock(&t150->axis->lock);
+	old = rcu_dereference_protected(t150->axis->lut[axis], lockdep_is_held(&t150->axis->lock));
+	rcu_assign_pointer(t150->axis->lut[axis], lut);
+	mutex_unlock(&t150->axis->lock);
+
+	if(old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
+/**
+ * Reads back the table of an axis, in the format written
+ * @param t150 target wheel
+ * @param axis the axis
+ * @param buf where to copy
+ * @param off where to start in the table
+ * @param count size of buf
+ * @return the bytes copied, 0 if the axis has no table
+ */
+static ssize_t t150_axis_lut_show(struct t150 *t150, enum t150_axis_id axis, char *buf, loff_t off, size_t count)
+{
+	const struct t150_axis_lut *lut;
+	size_t i;
+
+	if(off >= T150_AXIS_LUT_SIZE)
+		return 0;
+
+	count = min_t(size_t, count, T150_AXIS_LUT_SIZE - off);
+
+	rcu_read_lock();
+	lut = rcu_dereference(t150->axis->lut[axis]);
+	if(!lut)
+		count = 0;
+
+	// Byte by byte, off can be odd
+	for(i = 0; i < count; i++)
+		buf[i] = (off + i) & 1 ? word_high(lut->points[(off + i) / 2]) :
+			word_low(lut->points[(off + i) / 2]);
+	rcu_read_unlock();
+
+	return count;
+}
+
+/**
+ * @param cutoff cutoff frequency in mHz
+ * @param period_us time between two samples
+ * @return the weight of a new sample in a one pole low pass, in
+ *         1/2^T150_AXIS_FILTER_FRAC: 2 pi fc T / (1 + 2 pi fc T)
+ */
+static inline u32 t150_axis_alpha(u64 cutoff, u32 period_us)
+{
+	// 2 pi fc T, in 1/10^9
+	u64 w = div_u64(cutoff * period_us * 6283, 1000);
+
+	return div64_u64(w << T150_AXIS_FILTER_FRAC, NSEC_PER_SEC + w);
+}
+
+/**
+ * Runs a report through a filter. Fixed point only, one division for the
+ * 1 euro filter and none for the others
+ * @param filter the filter of the axis
+ * @param value a value of the axis as read from the wheel
+ * @return the filtered value
+ */
+static int t150_axis_filter(struct t150_axis_filter *filter, int value)
+{
+	s64 x = (s64)value << T150_AXIS_FILTER_FRAC;
+	int previous, older;
+	u64 cutoff;
+
+	if(!filter->primed) {
+		filter->y = x;
+		filter->dy = 0;
+		filter->history[0] = filter->history[1] = value;
+		filter->primed = true;
+	}
+
+	previous = filter->history[0];
+	older = filter->history[1];
+	filter->history[1] = previous;
+	filter->history[0] = value;
+
+	switch (filter->type) {
+	case T150_AXIS_FILTER_IIR:
+		filter->y += ((x - filter->y) * filter->alpha) >> 8;
+		break;
+	case T150_AXIS_FILTER_MEDIAN3:
+		// The one of the three that is neither the smallest nor the largest
+		return max(min(value, previous), min(max(value, previous), older));
+	case T150_AXIS_FILTER_EURO:
+		filter->dy += ((((s64)(value - previous) << T150_AXIS_FILTER_FRAC) - filter->dy) *
+			filter->alpha_d) >> T150_AXIS_FILTER_FRAC;
+
+		// Speed in units per second
+		cutoff = div_u64(abs(filter->dy) * USEC_PER_SEC, filter->period_us) >> T150_AXIS_FILTER_FRAC;
+		cutoff = min_t(u64, filter->min_cutoff + cutoff * filter->beta, T150_AXIS_EURO_MAX_MHZ);
+
+		filter->y += ((x - filter->y) * t150_axis_alpha(cutoff, filter->period_us)) >> T150_AXIS_FILTER_FRAC;
+		break;
+	default:
+		return value;
+	}
+
+	return (filter->y + BIT(T150_AXIS_FILTER_FRAC - 1)) >> T150_AXIS_FILTER_FRAC;
+}
+
+/**
+ * Sets the filter of an axis. The new one starts from the next report,
+ * the old one is freed after a grace period
+ * @param t150 target wheel
+ * @param axis the axis
+ * @param type the filter, T150_AXIS_FILTER_NONE removes it
+ * @param first iir: weight of a new report in 1/256, 1 to 256.
+ *        euro: cutoff at rest in mHz, at least 1
+ * @param second euro: mHz the cutoff rises for each unit/s of speed
+ * @return 0 on success, -EINVAL if the settings are out of range, -ENOMEM
+ */
+static int t150_axis_filter_store(struct t150 *t150, enum t150_axis_id axis,
+	enum t150_axis_filter_type type, u32 first, u32 second)
+{
+	struct t150_axis_filter *filter = 0, *old;
+
+	if(type == T150_AXIS_FILTER_IIR && (!first || first > 256))
+		return -EINVAL;
+
+	if(type == T150_AXIS_FILTER_EURO && (!first || first > T150_AXIS_EURO_MAX_MHZ))
+		return -EINVAL;
+
+	if(type != T150_AXIS_FILTER_NONE) {
+		filter = kzalloc(sizeof(struct t150_axis_filter), GFP_KERNEL);
+		if(!filter)
+			return -ENOMEM;
+
+		filter->type = type;
+		filter->alpha = first;
+		filter->min_cutoff = first;
+		filter->beta = second;
+		filter->period_us = t150_input_period_ms(t150) * USEC_PER_MSEC;
+		filter->alpha_d = t150_axis_alpha(T150_AXIS_EURO_DCUTOFF_MHZ, filter->period_us);
+
+		static_branch_inc(&t150_axis_filtering);
+	}
+
+	mutex_lock(&t150->axis->lock);
+	old = rcu_dereference_protected(t150->axis->filter[axis], lockdep_is_held(&t150->axis->lock));
+	rcu_assign_pointer(t150->axis->filter[axis], filter);
+	mutex_unlock(&t150->axis->lock);
+
+	if(old) {
+		static_branch_dec(&t150_axis_filtering);
+		kfree_rcu(old, rcu);
+	}
+
+	return 0;
+}
+
+/**
+ * Prints the filter of an axis as it is written
+ * @param t150 target wheel
+ * @param axis the axis
+ * @param buf a page
+ * @return the length printed
+ */
+static ssize_t t150_axis_filter_show(struct t150 *t150, enum t150_axis_id axis, char *buf)
+{
+	const struct t150_axis_filter *filter;
+	ssize_t length;
+
+	rcu_read_lock();
+	filter = rcu_dereference(t150->axis->filter[axis]);
+	if(!filter)
+		length = sprintf(buf, "none\n");
+	else if(filter->type == T150_AXIS_FILTER_IIR)
+		length = sprintf(buf, "iir %u\n", filter->alpha);
+	else if(filter->type == T150_AXIS_FILTER_EURO)
+		length = sprintf(buf, "euro %u %u\n", filter->min_cutoff, filter->beta);
+	else
+		length = sprintf(buf, "%s\n", t150_axis_filter_names[filter->type]);
+	rcu_read_unlock();
+
+	return length;
+}
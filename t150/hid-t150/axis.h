@@ -0,0 +1,156 @@
+/********************************************************************
+ *			     AXIS SHAPING
+ *
+ *     Filters smooth the noise of each axis, then tables uploaded
+ *   through sysfs give the deadzone, the curve and the calibration.
+ *   Both are applied to the reports before they reach evdev, hidraw
+ *           and the mixer still see the values of the wheel
+ *******************************************************************/
+
+/** Axes of the input report that can be shaped */
+enum t150_axis_id
+{
+	T150_AXIS_X,
+	T150_AXIS_Y,
+	T150_AXIS_RZ,
+	T150_AXIS_THROTTLE,
+	T150_AXES
+};
+
+/** The table has 2^T150_AXIS_LUT_SHIFT segments over the range of the axis */
+#define T150_AXIS_LUT_SHIFT	10
+#define T150_AXIS_LUT_POINTS	((1 << T150_AXIS_LUT_SHIFT) + 1)
+/** Size of a table as written to sysfs, T150_AXIS_LUT_POINTS little endian u16 */
+#define T150_AXIS_LUT_SIZE	(T150_AXIS_LUT_POINTS * sizeof(__le16))
+/** Fractional bits of the position between two points */
+#define T150_AXIS_LUT_FRAC	16
+
+/** A table, never changed once published */
+struct t150_axis_lut
+{
+	struct rcu_head		rcu;
+	/** Range of the axis when the table was uploaded */
+	s32			minimum;
+	s32			maximum;
+	/** 2^(32 + SHIFT + FRAC) / range, turns a value into a position */
+	u64			scale;
+	/** Output value at each point, the ones in between are interpolated */
+	u16			points[T150_AXIS_LUT_POINTS];
+};
+
+enum t150_axis_filter_type
+{
+	T150_AXIS_FILTER_NONE,
+	/** One pole low pass */
+	T150_AXIS_FILTER_IIR,
+	/** Median of the last three reports, one report of delay */
+	T150_AXIS_FILTER_MEDIAN3,
+	/** 1 euro: the cutoff of a low pass rises with the speed of the axis */
+	T150_AXIS_FILTER_EURO,
+	T150_AXIS_FILTER_TYPES
+};
+
+static const char * const t150_axis_filter_names[T150_AXIS_FILTER_TYPES] = {
+	"none", "iir", "median3", "euro"
+};
+
+/** Fractional bits of the state of the filters */
+#define T150_AXIS_FILTER_FRAC		16
+/** Cutoff of the low pass on the speed of the 1 euro filter, in mHz */
+#define T150_AXIS_EURO_DCUTOFF_MHZ	1000
+/** Highest cutoff of the 1 euro filter, in mHz, it is transparent well before */
+#define T150_AXIS_EURO_MAX_MHZ		1000000
+
+/** A filter and its state. The settings never change once published, the
+ * state is only touched by the reports, that never run concurrently */
+struct t150_axis_filter
+{
+	struct rcu_head			rcu;
+	enum t150_axis_filter_type	type;
+	/** iir: weight of a new report, in 1/256 */
+	u32				alpha;
+	/** euro: cutoff at rest in mHz, and how much it rises in mHz per
+	 * unit/s of speed */
+	u32				min_cutoff;
+	u32				beta;
+	/** euro: time between two reports in us, when the filter was set */
+	u32				period_us;
+	/** euro: weight of a new speed, in 1/2^T150_AXIS_FILTER_FRAC */
+	u32				alpha_d;
+
+	/** false until the first report */
+	bool				primed;
+	/** Output, in 1/2^T150_AXIS_FILTER_FRAC */
+	s64				y;
+	/** euro: speed in units per report, in 1/2^T150_AXIS_FILTER_FRAC */
+	s64				dy;
+	/** The last two reports, the newest first */
+	int				history[2];
+};
+
+/** Filters set on all wheels; with none the reports skip them for free */
+static DEFINE_STATIC_KEY_FALSE(t150_axis_filtering);
+
+struct t150_axis
+{
+	/** Serializes the uploads, the reports only take the RCU read lock */
+	struct mutex			lock;
+	/** 0 leaves the axis as it is */
+	struct t150_axis_lut __rcu	*lut[T150_AXES];
+	/** 0 if the axis is not filtered */
+	struct t150_axis_filter __rcu	*filter[T150_AXES];
+};
+
+static inline int t150_init_axis(struct t150 *t150);
+static inline void t150_free_axis(struct t150 *t150);
+static int t150_axis_lut_store(struct t150 *t150, enum t150_axis_id axis, const char *buf, size_t count);
+static ssize_t t150_axis_lut_show(struct t150 *t150, enum t150_axis_id axis, char *buf, loff_t off, size_t count);
+static int t150_axis_filter_store(struct t150 *t150, enum t150_axis_id axis,
+	enum t150_axis_filter_type type, u32 first, u32 second);
+static ssize_t t150_axis_filter_show(struct t150 *t150, enum t150_axis_id axis, char *buf);
+static int t150_axis_filter(struct t150_axis_filter *filter, int value);
+
+/**
+ * @param t150 target wheel
+ * @param axis the axis of value
+ * @param value a value of the axis as read from the wheel
+ * @return the value through the table of the axis, value if it has none
+ */
+static __always_inline int t150_axis_shape(struct t150 *t150, enum t150_axis_id axis, int value)
+{
+	const struct t150_axis_lut *lut;
+	struct t150_axis_filter *filter;
+	u64 position;
+	unsigned index;
+	s64 low, high;
+
+	rcu_read_lock();
+
+	// A jump label, a nop while no wheel has a filter
+	if(static_branch_unlikely(&t150_axis_filtering)) {
+		filter = rcu_dereference(t150->axis->filter[axis]);
+		if(filter)
+			value = t150_axis_filter(filter, value);
+	}
+
+	lut = rcu_dereference(t150->axis->lut[axis]);
+	if(!lut) {
+		rcu_read_unlock();
+		return value;
+	}
+
+	if(value <= lut->minimum) {
+		value = lut->points[0];
+	} else if(value >= lut->maximum) {
+		value = lut->points[T150_AXIS_LUT_POINTS - 1];
+	} else {
+		position = ((u64)(value - lut->minimum) * lut->scale) >> 32;
+		index = position >> T150_AXIS_LUT_FRAC;
+		low = lut->points[index];
+		high = lut->points[index + 1];
+		value = low + (((high - low) * (s64)(position & (BIT(T150_AXIS_LUT_FRAC) - 1))) >> T150_AXIS_LUT_FRAC);
+	}
+
+	rcu_read_unlock();
+	return value;
+}
@@ -0,0 +1,11 @@
+/**
+ * Fills the sine table from fixp_sin16, so the table and the function
+ * agree to the last bit. Called once when the module is loaded
+ */
+static void __init t150_init_conv(void)
+{
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(t150_conv_sin); i++)
+		t150_conv_sin[i] = fixp_sin16(i);
+}
@@ -0,0 +1,67 @@
+/********************************************************************
+ *			  UNIT CONVERSIONS
+ *
+ *    The packet builders scale the values of ff_effect down to
+ *   the units of the wheel. The divisors are constants of the
+ *   model: each one is turned into a reciprocal, so a division
+ *   is a multiplication and a shift on every compiler and every
+ *   -O level, and the sine of the direction comes from a table
+ *******************************************************************/
+
+/** Attack and fade levels */
+#define T150_CONV_ENVELOPE_LEVEL		0x1fff
+/** Constant level, after the direction is applied */
+#define T150_CONV_CONSTANT_LEVEL		0x01ff
+/** Phase of periodic effects, hundredths of a degree */
+#define T150_CONV_PHASE			((360 * 100) / 0xff)
+/** Coefficients of the conditions */
+#define T150_CONV_COEFF			0x147
+/** Center and deadband of the conditions */
+#define T150_CONV_CENTER			(0x7fff / 0x01f4)
+#define T150_CONV_DEADBAND		(0xffff / 0x03e8)
+/** Saturations of the springs and of the dampers */
+#define T150_CONV_SPRING_SAT		0x030c
+#define T150_CONV_DAMPER_SAT		0x028f
+/** Direction of the effects, in degrees */
+#define T150_CONV_DIRECTION		(0xFFFF / 360)
+
+/**
+ * Reciprocal of a divisor for t150_conv_udiv and t150_conv_sdiv, 2^32 / d
+ * rounded up. The error it carries is below 2^-16 for dividends of 16
+ * bits, so the quotient is always the one of the division
+ */
+#define T150_CONV_RECIPROCAL(d)		((u32)((0x100000000ULL + (d) - 1) / (d)))
+
+/** sin(n°) for n in [0, 360], as fixp_sin16 returns it */
+static s16 t150_conv_sin[361] __ro_after_init;
+
+static void t150_init_conv(void);
+
+/**
+ * @param x an unsigned value of 16 bits
+ * @param reciprocal T150_CONV_RECIPROCAL of the divisor
+ * @return x / divisor
+ */
+static __always_inline u16 t150_conv_udiv(u16 x, u32 reciprocal)
+{
+	return ((u64)x * reciprocal) >> 32;
+}
+
+/**
+ * @param x a value between -0x10000 and 0x10000, exclusive
+ * @param reciprocal T150_CONV_RECIPROCAL of the divisor
+ * @return x / divisor, truncated toward zero as the C division does
+ */
+static __always_inline int32_t t150_conv_sdiv(int32_t x, u32 reciprocal)
+{
+	return x < 0 ? -(int32_t)t150_conv_udiv(-x, reciprocal) : t150_conv_udiv(x, reciprocal);
+}
+
+/**
+ * @param direction direction of an effect, 0x0000 to 0xffff for a whole turn
+ * @return fixp_sin16 of the direction in whole degrees
+ */
+static __always_inline int32_t t150_conv_direction(u16 direction)
+{
+	return t150_conv_sin[t150_conv_udiv(direction, T150_CONV_RECIPROCAL(T150_CONV_DIRECTION))];
+}
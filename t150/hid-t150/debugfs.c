@@ -0,0 +1,107 @@
+/** Prints the buckets of a histogram that are not empty */
+static void t150_debugfs_hist(struct seq_file *file, const char *name, u32 *hist)
+{
+	int i;
+
+	for(i = 0; i < T150_INPUT_HIST_BUCKETS; i++) {
+		if(!hist[i])
+			continue;
+
+		if(i < T150_INPUT_HIST_BUCKETS - 1)
+			seq_printf(file, "%s < %lu us: %u\n", name, BIT(i), hist[i]);
+		else
+			seq_printf(file, "%s >= %lu us: %u\n", name, BIT(i - 1), hist[i]);
+	}
+}
+
+/** Timing of the input reports */
+static int t150_debugfs_input_show(struct seq_file *file, void *data)
+{
+	struct t150 *t150 = file->private;
+	struct t150_input_stats *stats = t150->input_stats;
+
+	seq_printf(file, "interval asked %u ms, polled at %u ms by %s\n",
+		READ_ONCE(t150->polling) ? t150->poll_interval : t150->bInterval_in,
+		t150_input_period_ms(t150), READ_ONCE(t150->polling) ? "the driver" : "usbhid");
+	seq_printf(file, "reports %llu\n", stats->reports);
+	seq_printf(file, "rate %u Hz\n", READ_ONCE(stats->rate));
+	seq_printf(file, "slow seconds %u\n", stats->slow);
+	seq_printf(file, "interval max %llu us\n", stats->interval_max_us);
+	t150_debugfs_hist(file, "interval", stats->interval);
+	seq_printf(file, "jitter max %llu us\n", stats->jitter_max_us);
+	t150_debugfs_hist(file, "jitter", stats->jitter);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(t150_debugfs_input);
+
+/**
+ * Creates the debugfs directory of a wheel. Failures are not fatal,
+ * debugfs is just a debugging aid
+ * @param t150 the wheel
+ */
+static inline void t150_init_debugfs(struct t150 *t150)
+{
+	struct dentry *dir;
+	int i;
+
+	t150->debugfs = debugfs_create_dir(dev_name(&t150->hid_device->dev), t150_debugfs_root);
+
+	debugfs_create_atomic_t("pool_exhausted", 0444, t150->debugfs, &t150->urb_pool->exhausted);
+	debugfs_create_atomic_t("input_vendor", 0444, t150->debugfs, &t150->input_vendor);
+	debugfs_create_atomic_t("input_unknown", 0444, t150->debugfs, &t150->input_unknown);
+	debugfs_create_file("input_timing", 0444, t150->debugfs, t150, &t150_debugfs_input_fops);
+	debugfs_create_atomic_t("ff_coalesced", 0444, t150->debugfs, &t150->ff_coalesced);
+	debugfs_create_atomic_t("ff_uploads", 0444, t150->debugfs, &t150->ff_uploads);
+	debugfs_create_atomic_t("ff_upload_failures", 0444, t150->debugfs, &t150->ff_upload_failures);
+	debugfs_create_atomic_t("ff_upload_retries", 0444, t150->debugfs, &t150->ff_upload_retries);
+	debugfs_create_u32("tx_depth", 0444, t150->debugfs, &t150->tx->depth);
+	debugfs_create_u32("tx_depth_max", 0444, t150->debugfs, &t150->tx->depth_max);
+	debugfs_create_atomic_t("tx_dropped", 0444, t150->debugfs, &t150->tx->dropped);
+	debugfs_create_atomic_t("tx_merged", 0444, t150->debugfs, &t150->tx->merged);
+	debugfs_create_atomic_t("tx_refunded", 0444, t150->debugfs, &t150->tx->refunded);
+
+	for(i = 0; i < T150_TX_CLASSES; i++) {
+		dir = debugfs_create_dir(t150_tx_class_names[i], t150->debugfs);
+		debugfs_create_u64("sent", 0444, dir, &t150->tx->queues[i].sent);
+		debugfs_create_u64("latency_total_us", 0444, dir, &t150->tx->queues[i].latency_total_us);
+		debugfs_create_u64("latency_max_us", 0444, dir, &t150->tx->queues[i].latency_max_us);
+	}
+	debugfs_create_u64("setup_time_us", 0444, t150->debugfs, &t150->setup_time_us);
+
+	debugfs_create_atomic_t("recoveries", 0444, t150->debugfs, &t150->recovery->recoveries);
+	debugfs_create_atomic_t("recovery_failures", 0444, t150->debugfs, &t150->recovery->failures);
+	debugfs_create_atomic_t("recovery_errors", 0444, t150->debugfs, &t150->recovery->errors);
+	debugfs_create_u64("recovery_last_us", 0444, t150->debugfs, &t150->recovery->last_us);
+	debugfs_create_u64("recovery_max_us", 0444, t150->debugfs, &t150->recovery->max_us);
+	// Writing 32 makes the next successful transfer fail with -EPIPE
+	debugfs_create_atomic_t("recovery_inject", 0644, t150->debugfs, &t150->recovery->inject);
+
+	debugfs_create_atomic_t("vslot_hits", 0444, t150->debugfs, &t150->vslot->hits);
+	debugfs_create_atomic_t("vslot_misses", 0444, t150->debugfs, &t150->vslot->misses);
+	debugfs_create_atomic_t("vslot_evictions", 0444, t150->debugfs, &t150->vslot->evictions);
+	debugfs_create_atomic_t("vslot_merged", 0444, t150->debugfs, &t150->vslot->merged);
+	debugfs_create_atomic_t("vslot_merged_slots", 0444, t150->debugfs, &t150->vslot->merged_slots);
+	debugfs_create_atomic_t("vslot_reused", 0444, t150->debugfs, &t150->vslot->reused);
+	debugfs_create_atomic_t("vslot_timed", 0444, t150->debugfs, &t150->vslot->timed);
+	debugfs_create_u64("vslot_late_max_ns", 0444, t150->debugfs, &t150->vslot->late_max_ns);
+
+	debugfs_create_atomic_t("recon_emitted", 0444, t150->debugfs, &t150->recon->emitted);
+	debugfs_create_atomic_t("recon_skipped", 0444, t150->debugfs, &t150->recon->skipped);
+
+	debugfs_create_atomic_t("torque_underruns", 0444, t150->debugfs, &t150->torque->underruns);
+	debugfs_create_atomic_t("torque_overruns", 0444, t150->debugfs, &t150->torque->overruns);
+	debugfs_create_atomic_t("torque_stalls", 0444, t150->debugfs, &t150->torque->stalls);
+
+	if(t150->mixer) {
+		debugfs_create_atomic_t("mixer_ticks", 0444, t150->debugfs, &t150->mixer->ticks);
+		debugfs_create_atomic_t("mixer_updates", 0444, t150->debugfs, &t150->mixer->updates);
+		debugfs_create_atomic_t("mixer_loops", 0444, t150->debugfs, &t150->mixer->loops);
+	}
+}
+
+static inline void t150_free_debugfs(struct t150 *t150)
+{
+	debugfs_remove_recursive(t150->debugfs);
+	t150->debugfs = 0;
+}
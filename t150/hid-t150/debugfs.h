@@ -0,0 +1,12 @@
+/********************************************************************
+ *			      DEBUGFS STUFF
+ *
+ *      Counters about the driver internals, they are placed
+ *         in /sys/kernel/debug/hid-t150/<hid device name>/
+ *******************************************************************/
+
+/** Root directory shared by all the wheels, created when the module is loaded */
+static struct dentry *t150_debugfs_root = 0;
+
+static inline void t150_init_debugfs(struct t150 *t150);
+static inline void t150_free_debugfs(struct t150 *t150);
@@ -149,6 +149,88 @@ union __packed ff_change
 	struct ff_change_gain gain;
 };
 
+/** A failed transfer of a slot is sent again this many times before giving up */
+#define T150_FF_RETRIES				3
+
+/** Effect slots of the wheel, the effect ids of the games are mapped on them */
+#define T150_FF_DEVICE_SLOTS			16
+
+/** Room for all the packets of a slot sent as a single transfer */
+#define T150_FF_SLOT_BUFFER_SIZE \
+	(sizeof(struct ff_first) + sizeof(struct ff_update) + sizeof(struct ff_commit) + \
+	sizeof(struct ff_change_effect_status))
+
+/** The packets of an effect, in the order they are sent to the wheel */
+enum t150_ff_stage
+{
+	T150_FF_STAGE_FIRST,
+	T150_FF_STAGE_UPDATE,
+	T150_FF_STAGE_COMMIT,
+	/** Play request of an effect uploaded on demand, it must follow the upload */
+	T150_FF_STAGE_PLAY,
+	T150_FF_STAGES
+};
+
+/** Packets that make up the upload of an effect */
+#define T150_FF_UPLOAD_STAGES \
+	(BIT(T150_FF_STAGE_FIRST) | BIT(T150_FF_STAGE_UPDATE) | BIT(T150_FF_STAGE_COMMIT))
+
+/** What the wheel has on a device slot */
+enum t150_ff_slot_state
+{
+	/** Nothing, or an effect whose upload failed */
+	T150_FF_SLOT_EMPTY,
+	/** Some packets of the upload are not acknowledged yet */
+	T150_FF_SLOT_UPLOADING,
+	/** The whole effect, stopped */
+	T150_FF_SLOT_READY,
+	/** The whole effect, playing */
+	T150_FF_SLOT_PLAYING
+};
+
+/** Mailbox of a device slot.
+ * The upload writes the new packets here, overwriting the ones still
+ * pending, and the completion handler of the slot URB sends the newest
+ * version of each pending packet. Only the recovery of the endpoint
+ * kills the URB, and the upload never waits for it. The shadow holds the packets as the wheel
+ * acknowledged them, a packet equal to its shadow is not sent again.
+ */
+struct t150_ff_slot
+{
+	spinlock_t	lock;
+	struct t150	*t150;
+	struct urb	*urb;
+	/** true while the URB is in flight */
+	bool		busy;
+	/** Bit n set if stage n is waiting to be sent */
+	unsigned long	pending;
+	/** Stages carried by the transfer in flight */
+	unsigned long	inflight;
+	/** Waits here for the transmit scheduler */
+	struct t150_tx_source	source;
+
+	struct ff_first		first;
+	struct ff_update	update;
+	struct ff_commit	commit;
+	struct ff_change_effect_status play;
+
+	/** Bit n set if the shadow of stage n is what the wheel has */
+	unsigned long		acked;
+	struct {
+		struct ff_first		first;
+		struct ff_update	update;
+		struct ff_commit	commit;
+	} shadow;
+	/** Failed transfers in a row */
+	unsigned		retries;
+
+	/** An upload is a transaction, it ends when all of its packets are
+	 * acknowledged or when one of them fails for good */
+	enum t150_ff_slot_state	state;
+	/** Last play request, the state after the upload */
+	bool			playing;
+};
+
 static int t150_init_ffb(struct t150 *t150);
 static void t150_free_ffb(struct t150 *t150);
 
@@ -157,6 +239,13 @@ static int t150_ff_erase(struct input_dev *dev, int effect_id);
 static int t150_ff_play(struct input_dev *dev, int effect_id, int value);
 static void t150_ff_set_gain(struct input_dev *dev, uint16_t gain);
 
+static int t150_ff_post(struct t150 *t150, int slot, struct ff_effect *effect);
+static int t150_ff_post_play(struct t150 *t150, int slot, int times);
+static int t150_ff_send_play(struct t150 *t150, int slot, int times);
+static void t150_ff_forget(struct t150 *t150);
+static void t150_ff_resend(struct t150 *t150);
+static int8_t t150_ff_constant_level(struct ff_effect *effect);
+
 static uint8_t t150_ffb_effects_length = 8;
 static const int16_t t150_ffb_effects[] = {
 	FF_GAIN,
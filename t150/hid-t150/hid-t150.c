@@ -11,15 +11,35 @@
 #include <linux/fixp-arith.h>
 #include <linux/spinlock.h>
 #include <linux/hid.h>
+#include <linux/debugfs.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/miscdevice.h>
+#include <linux/kref.h>
+#include <linux/idr.h>
+#include <linux/mm.h>
+#include <linux/jhash.h>
+#include <linux/hidraw.h>
+#include <linux/rcupdate.h>
+#include <linux/jump_label.h>
 
 #include "hid-t150.h"
+#include "convert.h"
+#include "axis.h"
 #include "input.h"
 #include "attributes.h"
 #include "settings.h"
+#include "tx.h"
+#include "recovery.h"
 #include "forcefeedback.h"
+#include "vslot.h"
 #include "packet.h"
-
-static void donothing_callback(struct urb *urb) {}
+#include "pool.h"
+#include "arena.h"
+#include "mixer.h"
+#include "reconstruct.h"
+#include "torque.h"
+#include "debugfs.h"
 
 /** Init for a t150 data struct
  * @param t150 pointer to the t150 structor to init
@@ -77,26 +97,71 @@ static inline int t150_constructor(struct t150 *t150,struct hid_device *hid_devi
 	t150->pipe_out= usb_sndintpipe(t150->usb_device, ep_irq_out->bEndpointAddress);
 
 	t150->bInterval_in = ep_irq_in->bInterval;
+	t150->max_packet_in = usb_endpoint_maxp(ep_irq_in);
 	t150->bInterval_out = ep_irq_out->bInterval;
+	t150->max_packet_out = usb_endpoint_maxp(ep_irq_out);
 
-	error_code = t150_init_input(t150);
+	// Freed after hid_hw_stop, when no report can use the tables anymore
+	error_code = t150_init_axis(t150);
+	if(error_code)
+		goto error3;
+
+	error_code = t150_init_tx(t150);
+	if(error_code)
+		goto error3;
+
+	error_code = t150_init_recovery(t150);
 	if(error_code)
 		goto error4;
 
-	error_code = t150_init_ffb(t150);
+	error_code = t150_init_arena(t150);
 	if(error_code)
 		goto error5;
+
+	error_code = t150_init_pool(t150);
+	if(error_code)
+		goto error6;
+
+	error_code = t150_init_input(t150);
+	if(error_code)
+		goto error7;
+
+	error_code = t150_init_ffb(t150);
+	if(error_code)
+		goto error8;
 	
+	error_code = t150_init_settings(t150);
+	if(error_code)
+		goto error9;
+
 	error_code = t150_init_attributes(t150);
 	if(error_code)
-		goto error6;
+		goto error10;
+
+	t150_init_debugfs(t150);
+
+	// hid_hw_start made hidraw and the input device visible, the reports
+	// they open go to hid-core alone until everything above is in place
+	smp_store_release(&t150->ready, true);
+
+	// The wheel is configured in background, probe does not wait for it
+	queue_work(t150->settings_wq, &t150->setup_work);
 
 	return 0;
 
-error6: t150_free_ffb(t150);
-error5: t150_free_input(t150);
-error4:	;
+error10: t150_free_settings(t150);
+	// Nothing is sent before the ffb is set up, it's the last to need the stop
+error9: t150_stop_tx(t150);
+	t150_stop_recovery(t150);
+	t150_free_ffb(t150);
+error8: t150_stop_input(t150);
+error7:	t150_free_pool(t150);
+error6: t150_free_arena(t150);
+error5: t150_free_recovery(t150);
+error4: t150_free_tx(t150);
 error3: hid_hw_stop(hid_device);
+	t150_free_input(t150);
+	t150_free_axis(t150);
 	return error_code;
 }
 
@@ -110,6 +175,8 @@ static int t150_probe(struct hid_device *hid_device, const struct hid_device_id
 	if(!t150)
 		return -ENOMEM;
 
+	t150->probe_time = ktime_get();
+
 	error_code = t150_constructor(t150, hid_device);
 	if(error_code)
 		goto error0;
@@ -126,27 +193,59 @@ static void t150_remove(struct hid_device *hid_device)
 
 	hid_info(t150->hid_device, "T150RS Wheel removed. Bye\n");
 
-	// Force feedback 
+	// sysfs first, its handlers use everything freed below
+	t150_free_attributes(t150);
+
+	t150_free_debugfs(t150);
+
+	// usbhid polls until hid_hw_stop, the reports from now on go to hid-core
+	// and the ones still in raw_event are waited for
+	smp_store_release(&t150->ready, false);
+	synchronize_rcu();
+
+	// Force feedback, nothing is sent anymore
+	t150_stop_tx(t150);
+	t150_stop_recovery(t150);
 	t150_free_ffb(t150);
 
-	// input deregister
-	t150_free_input(t150);
+	// The URB of the driver has a buffer in the arena
+	t150_stop_input(t150);
 
-	// sysf free
-	t150_free_attributes(t150);
+	t150_free_pool(t150);
+	t150_free_arena(t150);
+
+	// Settings still queued are flushed, the scheduler is stopped and they fail
+	t150_free_settings(t150);
+	t150_free_recovery(t150);
+	t150_free_tx(t150);
 
 	// Stop hid
 	hid_hw_close(hid_device);
 	hid_hw_stop(hid_device);
 
+	// No report arrives anymore
+	t150_free_input(t150);
+	t150_free_axis(t150);
+
 	// t150 free
 	kfree(t150);
 }
 
+#include "convert.c"
+#include "axis.c"
 #include "attributes.c"
 #include "input.c"
 #include "settings.c"
 #include "forcefeedback.c"
+#include "vslot.c"
+#include "tx.c"
+#include "recovery.c"
+#include "pool.c"
+#include "arena.c"
+#include "mixer.c"
+#include "reconstruct.c"
+#include "torque.c"
+#include "debugfs.c"
 
 
 /********************************************************************
@@ -167,7 +266,12 @@ static struct hid_driver t150_driver =
 	.id_table = t150_table,
 	.probe = t150_probe,
 	.remove = t150_remove,
-	.raw_event = t150_update_input
+	.raw_event = t150_update_input,
+	.input_configured = t150_input_configured,
+	.driver = {
+		// The setup is deferred anyway, do not hold up the other devices
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS
+	}
 };
 
 static int __init t150_init(void)
@@ -189,13 +293,18 @@ static int __init t150_init(void)
 	*packet_input_what = cpu_to_le16(0x0542);
 	*packet_input_close = cpu_to_le16(0x0042);
 
+	t150_init_conv();
+
+	t150_debugfs_root = debugfs_create_dir("hid-t150", 0);
+
 	errno = hid_register_driver(&t150_driver);
 	if(errno)
 		goto err3;
 	else
 		return 0;
 
-err3:	kfree(packet_input_close);
+err3:	debugfs_remove_recursive(t150_debugfs_root);
+	kfree(packet_input_close);
 err2:	kfree(packet_input_what);
 err1:	kfree(packet_input_open);
 err0:	return errno;
@@ -208,6 +317,8 @@ static void __exit t150_exit(void)
 	kfree(packet_input_close);
 
 	hid_unregister_driver(&t150_driver);
+
+	debugfs_remove_recursive(t150_debugfs_root);
 }
 
 module_init(t150_init);
@@ -1,3 +1,16 @@
+/** Axes of the hat for each of its positions, as hid-input maps them */
+static const struct {
+	int8_t x, y;
+} t150_input_hat[STATE_PACKET_HAT_MAX + 1] = {
+	{ 0, -1 }, { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }
+};
+
+module_param_named(poll_interval, t150_input_poll_interval, uint, 0644);
+MODULE_PARM_DESC(poll_interval, "Polling interval of the wheel in ms, 1 to 255, "
+	"0 for the one of the endpoint (default: 0)");
+
+static void t150_input_irq(struct urb *urb);
+
 /**
  * This function initializes the input system for
  * @t150 pointer to our device
@@ -6,6 +19,32 @@ static inline int t150_init_input(struct t150 *t150)
 {
 	struct hid_input *hidinput = list_entry(t150->hid_device->inputs.next, struct hid_input, list);
 	t150->joystick = hidinput->input;
+
+	t150->input_stats = kzalloc(sizeof(struct t150_input_stats), GFP_KERNEL);
+	if(!t150->input_stats)
+		return -ENOMEM;
+
+	t150->urb_in = usb_alloc_urb(0, GFP_KERNEL);
+	if(!t150->urb_in)
+		goto err;
+
+	// The interval is set when the polling starts
+	usb_fill_int_urb(
+		t150->urb_in,
+		t150->usb_device,
+		t150->pipe_in,
+		0,
+		min_t(uint16_t, t150->max_packet_in, T150_INPUT_BUFFER_SIZE),
+		t150_input_irq,
+		t150,
+		t150->bInterval_in
+	);
+
+	if(t150_arena_bind(t150, t150->urb_in, T150_INPUT_BUFFER_SIZE))
+		goto err;
+
+	t150->poll_interval = min_t(unsigned int, t150_input_poll_interval, U8_MAX);
+	INIT_WORK(&t150->poll_fallback, t150_input_fallback);
 	
 	input_set_drvdata(t150->joystick, t150);
 
@@ -13,10 +52,268 @@ static inline int t150_init_input(struct t150 *t150)
 	t150->joystick->close = t150_input_close;
 
 	return 0;
+
+err:	usb_free_urb(t150->urb_in);
+	t150->urb_in = 0;
+	kfree(t150->input_stats);
+	t150->input_stats = 0;
+	return -ENOMEM;
+}
+
+/**
+ * Stops the IN URB of the driver and drops the PM reference it held. To
+ * be called with the mutex of the input device held, while polling
+ * @param t150 target wheel
+ */
+static void t150_input_unpoll(struct t150 *t150)
+{
+	usb_kill_urb(t150->urb_in);
+	t150->polling = false;
+	hid_hw_power(t150->hid_device, PM_HINT_NORMAL);
+}
+
+/**
+ * Stops and frees the IN URB of the driver, its buffer is in the arena.
+ * The opens that come later fall back to usbhid
+ */
+static inline void t150_stop_input(struct t150 *t150)
+{
+	// No report schedules it anymore, raw_event is off
+	cancel_work_sync(&t150->poll_fallback);
+
+	// Opens and closes hold the mutex, none of them sees the URB go away
+	mutex_lock(&t150->joystick->mutex);
+	if(t150->polling)
+		t150_input_unpoll(t150);
+	usb_free_urb(t150->urb_in);
+	t150->urb_in = 0;
+	mutex_unlock(&t150->joystick->mutex);
 }
 
+/**
+ * To be called once no report can arrive anymore, after hid_hw_stop
+ */
 static inline void t150_free_input(struct t150 *t150)
 {
+	kfree(t150->input_stats);
+	t150->input_stats = 0;
+}
+
+/** Callback of the IN URB, feeds the reports to hid-core and polls again */
+static void t150_input_irq(struct urb *urb)
+{
+	struct t150 *t150 = urb->context;
+	int errno;
+
+	switch (urb->status) {
+	case 0:
+		// Any other report in raw_event comes from the URB of usbhid
+		WRITE_ONCE(t150->polled_report, true);
+		hid_input_report(t150->hid_device, HID_INPUT_REPORT,
+			urb->transfer_buffer, urb->actual_length, 1);
+		WRITE_ONCE(t150->polled_report, false);
+		break;
+	case -ENOENT:
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		// Killed or unplugged
+		return;
+	default:
+		hid_warn_ratelimited(t150->hid_device, "input report failed with status %d\n", urb->status);
+		break;
+	}
+
+	errno = usb_submit_urb(urb, GFP_ATOMIC);
+	if(errno && errno != -EPERM)
+		hid_err_ratelimited(t150->hid_device, "resubmitting the input URB, error %d\n", errno);
+}
+
+/**
+ * Starts the reports: the IN URB of the driver polls at poll_interval,
+ * otherwise usbhid polls at its own interval. To be called with the
+ * mutex of the input device held
+ * @param t150 target wheel
+ * @return 0 on success @see usb_submit_urb and hid_hw_open for the errors
+ */
+static int t150_input_start(struct t150 *t150)
+{
+	int errno;
+
+	// The reports stopped while closed, that gap is not an interval
+	t150->input_stats->last = 0;
+	t150->input_stats->window = 0;
+
+	if(!t150->poll_interval)
+		return hid_hw_open(t150->hid_device);
+
+	if(!t150->urb_in)
+		return -ENODEV;
+
+	// hid_hw_open keeps the interface awake for usbhid, the URB needs the same
+	errno = hid_hw_power(t150->hid_device, PM_HINT_FULLON);
+	if(errno < 0)
+		return errno;
+
+	// At full speed the interval is in frames, milliseconds
+	t150->urb_in->interval = t150->poll_interval;
+
+	errno = usb_submit_urb(t150->urb_in, GFP_KERNEL);
+	if(errno) {
+		hid_hw_power(t150->hid_device, PM_HINT_NORMAL);
+		return errno;
+	}
+
+	// The host controller may have changed it: xHCI polls at the interval of
+	// the endpoint whatever the URB asks, the others round it to a power of 2
+	t150->poll_effective = t150->urb_in->interval;
+	t150->polling = true;
+
+	if(t150->poll_effective != t150->poll_interval)
+		hid_info(t150->hid_device, "the host controller polls every %u ms, not every %u ms\n",
+			t150->poll_effective, t150->poll_interval);
+
+	return 0;
+}
+
+/**
+ * Scheduled when a report comes from usbhid while the driver polls: hidraw
+ * was opened and usbhid polls the same endpoint, the two URBs would share
+ * the reports. The driver stops its URB and keeps usbhid open in its place
+ * until the input is closed, the next open tries again
+ */
+static void t150_input_fallback(struct work_struct *work)
+{
+	struct t150 *t150 = container_of(work, struct t150, poll_fallback);
+	int errno;
+
+	mutex_lock(&t150->joystick->mutex);
+
+	if(!t150->polling)
+		goto out;
+
+	errno = hid_hw_open(t150->hid_device);
+	if(errno) {
+		hid_err(t150->hid_device, "handing the polling to usbhid, error %d\n", errno);
+		goto out;
+	}
+
+	t150_input_unpoll(t150);
+	hid_info(t150->hid_device, "hidraw is open, usbhid polls every %u ms until the input is closed\n",
+		t150->bInterval_in);
+
+out:	mutex_unlock(&t150->joystick->mutex);
+}
+
+/**
+ * @param t150 target wheel
+ * @return the interval the IN endpoint is polled at, as far as the
+ *         driver can tell, at least 1 ms
+ */
+static unsigned int t150_input_period_ms(struct t150 *t150)
+{
+	return max_t(unsigned int, t150->polling ? t150->poll_effective : t150->bInterval_in, 1);
+}
+
+/**
+ * Stops the reports, whoever is polling. To be called with the mutex
+ * of the input device held
+ * @param t150 target wheel
+ */
+static void t150_input_stop(struct t150 *t150)
+{
+	if(!t150->polling) {
+		hid_hw_close(t150->hid_device);
+		return;
+	}
+
+	t150_input_unpoll(t150);
+}
+
+/**
+ * Changes the polling interval. If the input is open the reports are
+ * stopped and started again with the new interval
+ * @param t150 target wheel
+ * @param interval the interval in ms, 0 for the one of usbhid
+ * @return 0 on success @see t150_input_start for the errors
+ */
+static int t150_input_set_poll(struct t150 *t150, uint8_t interval)
+{
+	int errno = 0;
+
+	mutex_lock(&t150->joystick->mutex);
+
+	t150->poll_interval = interval;
+	if(t150->joystick->users) {
+		t150_input_stop(t150);
+		errno = t150_input_start(t150);
+	}
+
+	mutex_unlock(&t150->joystick->mutex);
+
+	return errno;
+}
+
+/**
+ * Called by hid-input before the input device is registered, the
+ * reports carry the time they arrived in MSC_TIMESTAMP
+ */
+static int t150_input_configured(struct hid_device *hdev, struct hid_input *hidinput)
+{
+	input_set_capability(hidinput->input, EV_MSC, MSC_TIMESTAMP);
+
+	return 0;
+}
+
+/**
+ * @param us a time in microseconds
+ * @return its bucket in the histograms
+ */
+static inline unsigned t150_input_bucket(u64 us)
+{
+	return min_t(unsigned, fls64(us), T150_INPUT_HIST_BUCKETS - 1);
+}
+
+/**
+ * Accounts the arrival of a report in the histograms
+ * @param t150 target wheel
+ * @param now when the URB of the report completed
+ */
+static void t150_input_account(struct t150 *t150, ktime_t now)
+{
+	struct t150_input_stats *stats = t150->input_stats;
+	u64 interval, jitter, period = t150_input_period_ms(t150) * USEC_PER_MSEC;
+	s64 elapsed;
+
+	stats->reports++;
+
+	// Checks once per second that the wheel keeps up with the interval
+	if(!stats->window) {
+		stats->window = now;
+		stats->window_reports = 0;
+	}
+
+	stats->window_reports++;
+	elapsed = ktime_us_delta(now, stats->window);
+	if(elapsed >= USEC_PER_SEC) {
+		WRITE_ONCE(stats->rate, div64_u64((u64)stats->window_reports * USEC_PER_SEC, elapsed));
+		if((u64)stats->window_reports * period * 10 < (u64)elapsed * 9)
+			stats->slow++;
+
+		stats->window = now;
+		stats->window_reports = 0;
+	}
+
+	if(stats->last) {
+		interval = ktime_us_delta(now, stats->last);
+		jitter = interval > period ? interval - period : period - interval;
+
+		stats->interval[t150_input_bucket(interval)]++;
+		stats->interval_max_us = max(stats->interval_max_us, interval);
+		stats->jitter[t150_input_bucket(jitter)]++;
+		stats->jitter_max_us = max(stats->jitter_max_us, jitter);
+	}
+
+	stats->last = now;
 }
 
 static int t150_input_open(struct input_dev *dev)
@@ -34,7 +331,11 @@ static int t150_input_open(struct input_dev *dev)
 	if(ret)
 		return ret;
 
-	ret = hid_hw_open(t150->hid_device);
+	ret = t150_input_start(t150);
+
+	// The effects stayed on the wheel, only what plays has to be restored
+	if(!ret && READ_ONCE(t150->ff_persist))
+		t150_vslot_replay(t150, false);
 
 	return ret;
 }
@@ -44,16 +345,20 @@ static void t150_input_close(struct input_dev *dev)
 	struct t150 *t150 = input_get_drvdata(dev);
 	int boh, i;
 
-	hid_hw_close(t150->hid_device);
+	t150_input_stop(t150);
 
-	// Send magic codes
-	for(i = 0; i < 2; i++)
-		usb_interrupt_msg(
-			t150->usb_device,
-			t150->pipe_out,
-			packet_input_what, 2, &boh,
-			8
-		);
+	// Send magic codes, they wipe the effects of the wheel
+	if(!READ_ONCE(t150->ff_persist)) {
+		for(i = 0; i < 2; i++)
+			usb_interrupt_msg(
+				t150->usb_device,
+				t150->pipe_out,
+				packet_input_what, 2, &boh,
+				8
+			);
+
+		t150_ff_forget(t150);
+	}
 
 	usb_interrupt_msg(
 		t150->usb_device,
@@ -64,20 +369,124 @@ static void t150_input_close(struct input_dev *dev)
 }
 
 /**
- * This function updates the current input status of the joystick
+ * Reports the state of the wheel straight from the raw bytes, with the
+ * codes hid-input gave to the usages of the report, and a single SYN
+ * @param t150 target wheel
+ * @param packet an input report
+ * @param now when the URB of the report completed
+ */
+static void t150_input_report(struct t150 *t150, struct t150_state_packet *packet, ktime_t now)
+{
+	struct input_dev *input = t150->joystick;
+	uint16_t buttons = le16_to_cpu(packet->buttons);
+	uint8_t hat = packet->hat & 0x0f;
+	int i;
+
+	// evdev stamps the events with the arrival too, not with the wakeup of the reader
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	input_set_timestamp(input, now);
+#endif
+	input_event(input, EV_MSC, MSC_TIMESTAMP, (u32)ktime_to_us(now));
+
+	input_report_abs(input, ABS_X, t150_axis_shape(t150, T150_AXIS_X, le16_to_cpu(packet->wheel)));
+	input_report_abs(input, ABS_Y, t150_axis_shape(t150, T150_AXIS_Y, le16_to_cpu(packet->y)));
+	input_report_abs(input, ABS_RZ, t150_axis_shape(t150, T150_AXIS_RZ, le16_to_cpu(packet->rz)));
+	input_report_abs(input, ABS_THROTTLE, t150_axis_shape(t150, T150_AXIS_THROTTLE, le16_to_cpu(packet->slider)));
+
+	for(i = 0; i < STATE_PACKET_BUTTONS; i++)
+		input_report_key(input, BTN_JOYSTICK + i, buttons & BIT(i));
+
+	input_report_abs(input, ABS_HAT0X, hat <= STATE_PACKET_HAT_MAX ? t150_input_hat[hat].x : 0);
+	input_report_abs(input, ABS_HAT0Y, hat <= STATE_PACKET_HAT_MAX ? t150_input_hat[hat].y : 0);
+
+	input_sync(input);
+}
+
+/**
+ * Handles a vendor report. What they carry is not known, they are
+ * only counted
+ * @param t150 target wheel
+ * @param packet_raw the report
+ * @param size its size
+ */
+static void t150_input_vendor(struct t150 *t150, uint8_t *packet_raw, int size)
+{
+	atomic_inc(&t150->input_vendor);
+	hid_dbg(t150->hid_device, "vendor report 0x%02hhx of %d bytes\n", packet_raw[0], size);
+}
+
+/**
+ * Handles a report. To be called in an RCU read section, t150_remove waits
+ * for it to end before freeing what the report uses
+ * @param t150 target wheel
+ * @param packet_raw the report
+ * @param size its size
+ * @param now when the report arrived
+ * @return true if the report was handled, false to let hid-core parse it
+ */
+static bool t150_input_handle(struct t150 *t150, uint8_t *packet_raw, int size, ktime_t now)
+{
+	struct t150_state_packet *packet = (struct t150_state_packet*)packet_raw;
+
+	// Not from urb_in, usbhid polls as well
+	if(READ_ONCE(t150->polling) && !READ_ONCE(t150->polled_report))
+		schedule_work(&t150->poll_fallback);
+
+	switch (packet->type) {
+	case STATE_PACKET_INPUT:
+		// Shorter than expected, hid-core knows better
+		if(size < sizeof(struct t150_state_packet))
+			return false;
+
+		// The mixer follows the wheel for the condition effects
+		if(t150->mixer)
+			t150_mixer_input(t150, (int32_t)le16_to_cpu(packet->wheel) - 0x8000);
+
+		t150_input_account(t150, now);
+		t150_input_report(t150, packet, now);
+		return true;
+	case STATE_PACKET_VENDOR_02:
+	case STATE_PACKET_VENDOR_14:
+		t150_input_vendor(t150, packet_raw, size);
+		return true;
+	default:
+		atomic_inc(&t150->input_unknown);
+		return false;
+	}
+}
+
+/**
+ * This function updates the current input status of the joystick.
+ * The reports handled here skip the generic parsing of hid-core,
+ * hidraw still gets them
  * @t150 target wheel
  * @ss   new status to register
+ * @return -1 if the report was handled, 0 to let hid-core parse it
  */
 static int t150_update_input(struct hid_device *hdev, struct hid_report *report, uint8_t *packet_raw, int size)
 {	
-	struct t150_state_packet *packet = (struct t150_state_packet*)packet_raw;
+	struct t150 *t150 = hid_get_drvdata(hdev);
+	// Called by the completion handler of the IN URB, this is when the report arrived
+	ktime_t now = ktime_get();
+	bool handled = false;
 
-	if(packet->type != STATE_PACKET_INPUT)
-	{
-		hid_warn(hdev, "recived a packet that is not an input state :/\n");
-		printP(packet_raw, size);
-		return -1; // @TODO 
-	}
+	if(size < 1)
+		return 0;
 
-	return 0;
+	rcu_read_lock();
+
+	// Still in probe, or in remove, the joystick, the stats, the tables
+	// and the mixer may not exist
+	if(smp_load_acquire(&t150->ready))
+		handled = t150_input_handle(t150, packet_raw, size, now);
+
+	rcu_read_unlock();
+
+	if(!handled)
+		return 0;
+
+	if(hdev->claimed & HID_CLAIMED_HIDRAW)
+		hidraw_report_event(hdev, packet_raw, size);
+
+	return -1;
 }
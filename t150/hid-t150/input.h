@@ -1,12 +1,50 @@
 struct t150_state_packet;
 
+/** Size of the buffer of the IN URB, a full speed interrupt packet */
+#define T150_INPUT_BUFFER_SIZE	64
+
+/** Polling interval asked at probe, set by the module parameter */
+static unsigned int t150_input_poll_interval = 0;
+
+/** Buckets of the histograms, bucket n > 0 counts the times in
+ * [2^(n-1), 2^n) microseconds, the last one everything above */
+#define T150_INPUT_HIST_BUCKETS	16
+
+/** Timing of the input reports, as they arrive from the wheel */
+struct t150_input_stats
+{
+	/** Completion of the last report, 0 before the first one */
+	ktime_t		last;
+	u64		reports;
+	/** Time between two reports */
+	u32		interval[T150_INPUT_HIST_BUCKETS];
+	u64		interval_max_us;
+	/** Distance of the time between two reports from bInterval_in */
+	u32		jitter[T150_INPUT_HIST_BUCKETS];
+	u64		jitter_max_us;
+
+	/** Reports per second, measured over the last whole second */
+	u32		rate;
+	/** Seconds the wheel sent less than 9/10 of the reports asked */
+	u32		slow;
+	ktime_t		window;
+	u32		window_reports;
+};
+
 static inline int t150_init_input(struct t150 *t150);
+static inline void t150_stop_input(struct t150 *t150);
+static void t150_input_unpoll(struct t150 *t150);
 static inline void t150_free_input(struct t150 *t150);
 static int t150_input_open(struct input_dev *dev);
 static void t150_input_close(struct input_dev *dev);
+static bool t150_input_handle(struct t150 *t150, uint8_t *packet_raw, int size, ktime_t now);
 static int t150_update_input(struct hid_device *hdev, struct hid_report *report, uint8_t *packet_raw, int size);
+static int t150_input_configured(struct hid_device *hdev, struct hid_input *hidinput);
+static int t150_input_set_poll(struct t150 *t150, uint8_t interval);
+static unsigned int t150_input_period_ms(struct t150 *t150);
+static void t150_input_fallback(struct work_struct *work);
 
 static uint16_t *packet_input_open = 0;
 /** It seems it's used to purge all uploaded effects from the wheel, not sure */
 static uint16_t *packet_input_what = 0;
-static uint16_t *packet_input_close = 0; 
+static uint16_t *packet_input_close = 0; 
\ No newline at end of file
@@ -0,0 +1,580 @@
+/**
+ * Parses the ff_mixer module parameter. It's a comma separated list of a
+ * preset (native, hybrid or mixed) and of type=native|mixed overrides, for
+ * example "hybrid,spring=mixed". Wheels read it when they are plugged in.
+ */
+static int t150_mixer_param_set(const char *val, const struct kernel_param *kp)
+{
+	bool mixed[T150_MIXER_TYPES];
+	char *buffer, *cursor, *token, *mode;
+	int i, errno = 0;
+
+	if(strlen(val) >= sizeof(t150_mixer_param))
+		return -ENOSPC;
+
+	buffer = kstrdup(val, GFP_KERNEL);
+	if(!buffer)
+		return -ENOMEM;
+
+	memcpy(mixed, t150_mixer_mixed, sizeof(mixed));
+	cursor = strim(buffer);
+
+	while((token = strsep(&cursor, ",")) != 0) {
+		token = strim(token);
+		mode = strchr(token, '=');
+
+		if(!*token)
+			continue;
+
+		if(!mode) {
+			// A preset, applies to all the types
+			for(i = 0; i < T150_MIXER_TYPES; i++) {
+				if(sysfs_streq(token, "native"))
+					mixed[i] = false;
+				else if(sysfs_streq(token, "mixed"))
+					mixed[i] = true;
+				else if(sysfs_streq(token, "hybrid"))
+					mixed[i] = !t150_mixer_type_native[i];
+				else
+					errno = -EINVAL;
+			}
+			continue;
+		}
+
+		*mode++ = 0;
+		i = __sysfs_match_string(t150_mixer_type_names, T150_MIXER_TYPES, strim(token));
+		if(i < 0)
+			errno = -EINVAL;
+		else if(sysfs_streq(mode, "native"))
+			mixed[i] = false;
+		else if(sysfs_streq(mode, "mixed"))
+			mixed[i] = true;
+		else
+			errno = -EINVAL;
+	}
+
+	kfree(buffer);
+
+	if(errno)
+		return errno;
+
+	memcpy(t150_mixer_mixed, mixed, sizeof(mixed));
+	strscpy(t150_mixer_param, val, sizeof(t150_mixer_param));
+
+	return 0;
+}
+
+static int t150_mixer_param_get(char *buffer, const struct kernel_param *kp)
+{
+	return scnprintf(buffer, PAGE_SIZE, "%s\n", t150_mixer_param);
+}
+
+static const struct kernel_param_ops t150_mixer_param_ops = {
+	.set = t150_mixer_param_set,
+	.get = t150_mixer_param_get,
+};
+
+module_param_cb(ff_mixer, &t150_mixer_param_ops, 0, 0644);
+MODULE_PARM_DESC(ff_mixer, "Effects played by the host: native, hybrid or mixed, "
+	"followed by type=native|mixed overrides (default: native)");
+
+module_param_named(ff_closed_loop, t150_mixer_closed_loop, bool, 0644);
+MODULE_PARM_DESC(ff_closed_loop, "Play damper, friction and inertia on the host, "
+	"updating them at every input report (default: n)");
+
+/**
+ * @param effect an effect
+ * @return the mixer type of the effect, T150_MIXER_TYPES if it has none
+ */
+static enum t150_mixer_type t150_mixer_type_of(struct ff_effect *effect)
+{
+	int i;
+	uint16_t code = effect->type;
+
+	if(code == FF_PERIODIC)
+		code = effect->u.periodic.waveform;
+
+	for(i = 0; i < T150_MIXER_ENVELOPE; i++)
+		if(t150_mixer_type_codes[i] == code)
+			return i;
+
+	return T150_MIXER_TYPES;
+}
+
+/**
+ * @param effect an effect
+ * @return the envelope of the effect, 0 if it has none or if it's flat
+ */
+static struct ff_envelope *t150_mixer_envelope_of(struct ff_effect *effect)
+{
+	struct ff_envelope *envelope;
+
+	switch (effect->type) {
+	case FF_CONSTANT:
+		envelope = &effect->u.constant.envelope;
+		break;
+	case FF_PERIODIC:
+		envelope = &effect->u.periodic.envelope;
+		break;
+	case FF_RAMP:
+		envelope = &effect->u.ramp.envelope;
+		break;
+	default:
+		return 0;
+	}
+
+	if(!envelope->attack_length && !envelope->fade_length)
+		return 0;
+
+	return envelope;
+}
+
+/**
+ * Allocates the mixer if at least one type is mixed and advertises
+ * the types only the mixer can play. With everything native the mixer
+ * is not allocated and it costs nothing
+ * @param t150 ptr to t150
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int t150_init_mixer(struct t150 *t150)
+{
+	struct t150_mixer *mixer;
+	bool mixed[T150_MIXER_TYPES];
+	int i;
+
+	memcpy(mixed, t150_mixer_mixed, sizeof(mixed));
+
+	for(i = 0; i < T150_MIXER_TYPES; i++)
+		if(mixed[i])
+			break;
+
+	if(i == T150_MIXER_TYPES && !t150_mixer_closed_loop)
+		return 0;
+
+	mixer = kzalloc(sizeof(struct t150_mixer), GFP_KERNEL);
+	if(!mixer)
+		return -ENOMEM;
+
+	mixer->t150 = t150;
+	spin_lock_init(&mixer->lock);
+	memcpy(mixer->mixed, mixed, sizeof(mixed));
+	mixer->closed_loop = t150_mixer_closed_loop;
+	t150_hrtimer_setup(&mixer->timer, t150_mixer_tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+
+	if(mixer->closed_loop) {
+		mixer->mixed[T150_MIXER_DAMPER] = true;
+		mixer->mixed[T150_MIXER_FRICTION] = true;
+		mixer->mixed[T150_MIXER_INERTIA] = true;
+	}
+
+	// The stream is a constant force pointing along the wheel axis
+	mixer->stream.type = FF_CONSTANT;
+	mixer->stream.id = T150_MIXER_SLOT;
+	mixer->stream.direction = 0x4000;
+
+	for(i = 0; i < T150_MIXER_ENVELOPE; i++) {
+		if(!mixer->mixed[i])
+			continue;
+
+		set_bit(t150_mixer_type_codes[i], t150->joystick->ffbit);
+		if(t150_mixer_type_codes[i] >= FF_WAVEFORM_MIN && t150_mixer_type_codes[i] <= FF_WAVEFORM_MAX)
+			set_bit(FF_PERIODIC, t150->joystick->ffbit);
+	}
+
+	t150->mixer = mixer;
+
+	hid_info(t150->hid_device, "software effect mixer enabled (%s%s)\n", t150_mixer_param,
+		mixer->closed_loop ? ", closed loop" : "");
+
+	return 0;
+}
+
+/**
+ * Stops the timer. To be called before the effect slots are freed
+ * @param t150 ptr to t150
+ */
+static void t150_free_mixer(struct t150 *t150)
+{
+	if(!t150->mixer)
+		return;
+
+	hrtimer_cancel(&t150->mixer->timer);
+	kfree(t150->mixer);
+	t150->mixer = 0;
+}
+
+/**
+ * @param t150 ptr to t150
+ * @param effect an effect being uploaded
+ * @return true if the effect is to be played by the mixer
+ */
+static bool t150_mixer_wants(struct t150 *t150, struct ff_effect *effect)
+{
+	enum t150_mixer_type type;
+
+	if(!t150->mixer)
+		return false;
+
+	if(t150->mixer->mixed[T150_MIXER_ENVELOPE] && t150_mixer_envelope_of(effect))
+		return true;
+
+	type = t150_mixer_type_of(effect);
+
+	return type != T150_MIXER_TYPES && t150->mixer->mixed[type];
+}
+
+/**
+ * @param t150 ptr to t150
+ * @param effect_id id of an effect
+ * @return true if the effect was uploaded to the mixer
+ */
+static bool t150_mixer_owns(struct t150 *t150, int effect_id)
+{
+	return t150->mixer && test_bit(effect_id, t150->mixer->uploaded);
+}
+
+/**
+ * Stores an effect in the mixer. An effect already playing keeps its timing
+ * @param t150 ptr to t150
+ * @param effect the new effect
+ */
+static void t150_mixer_upload(struct t150 *t150, struct ff_effect *effect)
+{
+	struct t150_mixer *mixer = t150->mixer;
+	struct t150_mixer_effect *slot = &mixer->effects[effect->id];
+	unsigned long flags;
+
+	spin_lock_irqsave(&mixer->lock, flags);
+
+	slot->effect = *effect;
+	slot->direction = t150_conv_direction(effect->direction);
+	set_bit(effect->id, mixer->uploaded);
+
+	spin_unlock_irqrestore(&mixer->lock, flags);
+}
+
+/**
+ * Forgets an effect, because it was erased or because it's now
+ * played by the wheel
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect
+ */
+static void t150_mixer_release(struct t150 *t150, int effect_id)
+{
+	unsigned long flags;
+
+	if(!t150->mixer)
+		return;
+
+	spin_lock_irqsave(&t150->mixer->lock, flags);
+	clear_bit(effect_id, t150->mixer->uploaded);
+	clear_bit(effect_id, t150->mixer->playing);
+	spin_unlock_irqrestore(&t150->mixer->lock, flags);
+}
+
+/**
+ * Starts or stops an effect of the mixer, arming the timer if needed
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect
+ * @param times how many times to play it, 0 to stop it
+ * @return always 0
+ */
+static int t150_mixer_play(struct t150 *t150, int effect_id, int times)
+{
+	struct t150_mixer *mixer = t150->mixer;
+	struct t150_mixer_effect *slot = &mixer->effects[effect_id];
+	unsigned long flags;
+
+	spin_lock_irqsave(&mixer->lock, flags);
+
+	if(times) {
+		slot->start = ktime_add_ms(ktime_get(), slot->effect.replay.delay);
+		slot->times = times;
+		set_bit(effect_id, mixer->playing);
+	} else {
+		clear_bit(effect_id, mixer->playing);
+	}
+
+	if(times && !mixer->running) {
+		mixer->running = true;
+		hrtimer_start(&mixer->timer, 0, HRTIMER_MODE_REL);
+	}
+
+	spin_unlock_irqrestore(&mixer->lock, flags);
+
+	return 0;
+}
+
+/**
+ * Applies an envelope to a level, like ff-memless does
+ * @param envelope the envelope, 0 if none
+ * @param level the level without envelope
+ * @param t milliseconds since the effect started
+ * @param length length of the effect, 0 if infinite
+ * @return the new level
+ */
+static int32_t t150_mixer_envelope(const struct ff_envelope *envelope, int32_t level,
+	int32_t t, uint16_t length)
+{
+	int32_t magnitude = abs(level);
+
+	if(!envelope)
+		return level;
+
+	if(envelope->attack_length && t < envelope->attack_length)
+		magnitude = envelope->attack_level + div_s64(
+			(s64)(magnitude - envelope->attack_level) * t, envelope->attack_length);
+	else if(envelope->fade_length && length && t >= length - envelope->fade_length)
+		magnitude += div_s64(
+			(s64)(envelope->fade_level - magnitude) * (t - (length - envelope->fade_length)),
+			envelope->fade_length);
+
+	return level < 0 ? -magnitude : magnitude;
+}
+
+/**
+ * Response of a condition effect, for spring, damper and inertia
+ * @param condition the condition of the wheel axis
+ * @param value position, speed or acceleration of the wheel
+ * @return the force, in the ABS_X direction
+ */
+static int32_t t150_mixer_condition(const struct ff_condition_effect *condition, int32_t value)
+{
+	int32_t low = condition->center - condition->deadband / 2;
+	int32_t high = condition->center + condition->deadband / 2;
+	int32_t force;
+
+	if(value > high)
+		force = -clamp_t(s64, ((s64)condition->right_coeff * (value - high)) >> 15,
+			-(condition->right_saturation >> 1), condition->right_saturation >> 1);
+	else if(value < low)
+		force = -clamp_t(s64, ((s64)condition->left_coeff * (value - low)) >> 15,
+			-(condition->left_saturation >> 1), condition->left_saturation >> 1);
+	else
+		force = 0;
+
+	return force;
+}
+
+/**
+ * Computes the force of an effect at a given time. Effects that
+ * ended are removed from the playing ones
+ * @param mixer the mixer
+ * @param id id of the effect
+ * @param now time of the tick
+ * @return the force in 1.15 fixed point, positive towards larger ABS_X values
+ */
+static int32_t t150_mixer_force(struct t150_mixer *mixer, int id, ktime_t now)
+{
+	struct t150_mixer_effect *slot = &mixer->effects[id];
+	struct ff_effect *effect = &slot->effect;
+	struct ff_periodic_effect *periodic = &effect->u.periodic;
+	struct ff_condition_effect *condition = &effect->u.condition[0];
+	uint16_t length = effect->replay.length;
+	uint32_t angle;
+	int32_t t, wave, level;
+
+	t = ktime_ms_delta(now, slot->start);
+	if(t < 0)
+		return 0; // Still in its delay
+
+	if(length && t >= length) {
+		if(--slot->times <= 0) {
+			clear_bit(id, mixer->playing);
+			return 0;
+		}
+
+		slot->start = ktime_add_ms(slot->start, length + effect->replay.delay);
+		return 0;
+	}
+
+	switch (effect->type) {
+	case FF_CONSTANT:
+		level = t150_mixer_envelope(t150_mixer_envelope_of(effect),
+			effect->u.constant.level, t, length);
+		break;
+	case FF_RAMP:
+		level = effect->u.ramp.start_level;
+		if(length)
+			level += div_s64((s64)(effect->u.ramp.end_level - level) * t, length);
+		level = t150_mixer_envelope(t150_mixer_envelope_of(effect), level, t, length);
+		break;
+	case FF_PERIODIC:
+		if(!periodic->period) {
+			wave = 0;
+		} else {
+			// Position in the period, 0x10000 is a whole period
+			angle = ((uint32_t)(t % periodic->period) << 16) / periodic->period;
+			angle = (angle + periodic->phase * 0x10000 / (360 * 100)) & 0xffff;
+
+			switch (periodic->waveform) {
+			case FF_SQUARE:
+				wave = angle < 0x8000 ? 0x7fff : -0x7fff;
+				break;
+			case FF_TRIANGLE:
+				wave = angle < 0x8000 ? (int32_t)angle * 2 - 0x8000 : 0x17fff - (int32_t)angle * 2;
+				break;
+			case FF_SAW_UP:
+				wave = (int32_t)angle - 0x8000;
+				break;
+			case FF_SAW_DOWN:
+				wave = 0x7fff - (int32_t)angle;
+				break;
+			case FF_SINE:
+			default:
+				wave = t150_conv_sin[(angle * 360) >> 16];
+				break;
+			}
+		}
+
+		level = t150_mixer_envelope(t150_mixer_envelope_of(effect), periodic->magnitude, t, length);
+		level = periodic->offset + ((level * wave) >> 15);
+		break;
+	case FF_SPRING:
+		return t150_mixer_condition(condition, mixer->position);
+	case FF_DAMPER:
+		return t150_mixer_condition(condition,
+			mixer->velocity << (T150_MIXER_VELOCITY_SHIFT - T150_MIXER_MOTION_FRAC));
+	case FF_INERTIA:
+		return t150_mixer_condition(condition,
+			mixer->acceleration << (T150_MIXER_ACCEL_SHIFT - T150_MIXER_MOTION_FRAC));
+	case FF_FRICTION:
+		if(abs(mixer->velocity) <= T150_MIXER_FRICTION_DEADBAND << T150_MIXER_MOTION_FRAC)
+			return 0;
+		return mixer->velocity > 0 ? -condition->right_coeff : condition->left_coeff;
+	default:
+		return 0;
+	}
+
+	// Force effects are projected on the wheel axis like the firmware does
+	return ((level * slot->direction) >> 15) * T150_MIXER_AXIS_SIGN;
+}
+
+/**
+ * Sends the new level of the stream, starting or stopping it if needed.
+ * To be called with mixer->lock held
+ * @param mixer the mixer
+ * @param force the sum of the effects, 0 with nothing playing
+ */
+static void t150_mixer_output(struct t150_mixer *mixer, int32_t force)
+{
+	struct t150 *t150 = mixer->t150;
+	struct ff_effect stream = mixer->stream;
+	int errno = 0;
+
+	stream.u.constant.level = clamp_t(int32_t, force * T150_MIXER_AXIS_SIGN, -0x7fff, 0x7fff);
+
+	if(!mixer->active) {
+		if(!force)
+			return;
+
+		errno = t150_ff_post(t150, T150_MIXER_SLOT, &stream);
+		if(!errno)
+			errno = t150_ff_send_play(t150, T150_MIXER_SLOT, 1);
+		mixer->active = !errno;
+	} else if(stream.u.constant.level != mixer->stream.u.constant.level) {
+		errno = t150_ff_post(t150, T150_MIXER_SLOT, &stream);
+	}
+
+	if(!errno) {
+		if(stream.u.constant.level != mixer->stream.u.constant.level)
+			atomic_inc(&mixer->updates);
+		mixer->stream = stream;
+	}
+}
+
+/**
+ * Computes the sum of the playing effects and sends it to the wheel.
+ * The cost is bounded: one constant time step for each of the
+ * FF_MAX_EFFECTS effects at most and a single update packet, only
+ * if the level of the stream changed. To be called with mixer->lock held
+ * @param mixer the mixer
+ * @param now the current time
+ * @return false if nothing is playing anymore and the timer can stop
+ */
+static bool t150_mixer_run(struct t150_mixer *mixer, ktime_t now)
+{
+	int32_t force = 0;
+	int id;
+
+	for_each_set_bit(id, mixer->playing, FF_MAX_EFFECTS)
+		force += t150_mixer_force(mixer, id, now);
+
+	if(bitmap_empty(mixer->playing, FF_MAX_EFFECTS)) {
+		if(mixer->active && !t150_ff_send_play(mixer->t150, T150_MIXER_SLOT, 0))
+			mixer->active = false;
+
+		// If the stop could not be sent retry on the next tick
+		mixer->running = mixer->active;
+	} else {
+		t150_mixer_output(mixer, force);
+	}
+
+	return mixer->running;
+}
+
+/** Timer of the mixer, runs every T150_MIXER_PERIOD_US while there are mixed effects playing */
+static enum hrtimer_restart t150_mixer_tick(struct hrtimer *timer)
+{
+	struct t150_mixer *mixer = container_of(timer, struct t150_mixer, timer);
+	unsigned long flags;
+	bool running;
+
+	spin_lock_irqsave(&mixer->lock, flags);
+	running = t150_mixer_run(mixer, ktime_get());
+	spin_unlock_irqrestore(&mixer->lock, flags);
+
+	atomic_inc(&mixer->ticks);
+
+	if(!running)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, us_to_ktime(T150_MIXER_PERIOD_US));
+	return HRTIMER_RESTART;
+}
+
+/**
+ * Estimates speed and acceleration of the wheel from the position in an
+ * input report. Both are low pass filtered, the reports come every 2 ms
+ * and a plain difference would be mostly noise. In closed loop mode the
+ * forces are recomputed right away, so conditions react to the wheel at
+ * the report rate instead of waiting for the next tick
+ * @param t150 ptr to t150
+ * @param position the wheel axis, 0 is the center
+ */
+static void t150_mixer_input(struct t150 *t150, int32_t position)
+{
+	struct t150_mixer *mixer = t150->mixer;
+	ktime_t now = ktime_get();
+	int32_t velocity, acceleration;
+	s64 elapsed;
+	unsigned long flags;
+
+	spin_lock_irqsave(&mixer->lock, flags);
+
+	elapsed = ktime_us_delta(now, mixer->last_input);
+	mixer->last_input = now;
+
+	if(elapsed <= 0 || elapsed > T150_MIXER_MOTION_TIMEOUT_US) {
+		// First report in a while, there is no speed to speak of
+		mixer->velocity = 0;
+		mixer->acceleration = 0;
+	} else {
+		// Units per millisecond, in T150_MIXER_MOTION_FRAC fixed point
+		velocity = div_s64((s64)(position - mixer->position) * (USEC_PER_MSEC << T150_MIXER_MOTION_FRAC), elapsed);
+		velocity = mixer->velocity + ((velocity - mixer->velocity) >> T150_MIXER_MOTION_FILTER);
+
+		acceleration = div_s64((s64)(velocity - mixer->velocity) * USEC_PER_MSEC, elapsed);
+		mixer->acceleration += (acceleration - mixer->acceleration) >> T150_MIXER_MOTION_FILTER;
+		mixer->velocity = velocity;
+	}
+
+	mixer->position = position;
+
+	if(mixer->closed_loop && mixer->running) {
+		t150_mixer_run(mixer, now);
+		atomic_inc(&mixer->loops);
+	}
+
+	spin_unlock_irqrestore(&mixer->lock, flags);
+}
@@ -0,0 +1,134 @@
+/********************************************************************
+ *			   SOFTWARE EFFECT MIXER
+ *
+ *     Effects the firmware can not play are synthesized on the
+ *   host: an hrtimer sums them every millisecond into the level
+ *   of a single constant force effect, kept on a device slot
+ *                  reserved to the mixer
+ *******************************************************************/
+
+/** Period of the mixer, in microseconds */
+#define T150_MIXER_PERIOD_US		1000
+/** Device slot used to play the mixed stream */
+#define T150_MIXER_SLOT			(T150_FF_DEVICE_SLOTS - 1)
+/** Steering speed in position units per millisecond is shifted left by
+ * this amount before being used by damper effects */
+#define T150_MIXER_VELOCITY_SHIFT	6
+/** Same as T150_MIXER_VELOCITY_SHIFT for the acceleration of inertia effects */
+#define T150_MIXER_ACCEL_SHIFT		10
+/** Friction ignores speeds smaller than this, to not rattle at rest */
+#define T150_MIXER_FRICTION_DEADBAND	2
+/** Fractional bits of the estimated speed and acceleration */
+#define T150_MIXER_MOTION_FRAC		4
+/** Each new speed sample weights 1 / 2^T150_MIXER_MOTION_FILTER */
+#define T150_MIXER_MOTION_FILTER		2
+/** Reports further apart than this do not give a speed */
+#define T150_MIXER_MOTION_TIMEOUT_US	50000
+/** Sign of a force that pushes the wheel towards larger ABS_X values */
+#define T150_MIXER_AXIS_SIGN		(-1)
+
+/** The effect types the mixer knows, the names are the ones used in the
+ * ff_mixer module parameter */
+enum t150_mixer_type
+{
+	T150_MIXER_CONSTANT,
+	T150_MIXER_SINE,
+	T150_MIXER_SQUARE,
+	T150_MIXER_TRIANGLE,
+	T150_MIXER_SAW_UP,
+	T150_MIXER_SAW_DOWN,
+	T150_MIXER_RAMP,
+	T150_MIXER_SPRING,
+	T150_MIXER_DAMPER,
+	T150_MIXER_FRICTION,
+	T150_MIXER_INERTIA,
+	/** Constant, periodic and ramp effects with an attack or a fade */
+	T150_MIXER_ENVELOPE,
+	T150_MIXER_TYPES
+};
+
+static const char * const t150_mixer_type_names[T150_MIXER_TYPES] = {
+	"constant", "sine", "square", "triangle", "saw_up", "saw_down",
+	"ramp", "spring", "damper", "friction", "inertia", "envelope"
+};
+
+/** ff code of each type, 0 for the envelope pseudo type */
+static const uint16_t t150_mixer_type_codes[T150_MIXER_TYPES] = {
+	FF_CONSTANT, FF_SINE, FF_SQUARE, FF_TRIANGLE, FF_SAW_UP, FF_SAW_DOWN,
+	FF_RAMP, FF_SPRING, FF_DAMPER, FF_FRICTION, FF_INERTIA, 0
+};
+
+/** true if the firmware can play the type by itself */
+static const bool t150_mixer_type_native[T150_MIXER_TYPES] = {
+	true, true, false, false, true, true,
+	false, true, true, false, false, false
+};
+
+/** The mode of each type chosen with the ff_mixer parameter, true if mixed */
+static bool t150_mixer_mixed[T150_MIXER_TYPES];
+static char t150_mixer_param[128] = "native";
+/** Update the conditions at every input report, see ff_closed_loop */
+static bool t150_mixer_closed_loop;
+
+/** State of an effect played by the mixer */
+struct t150_mixer_effect
+{
+	struct ff_effect	effect;
+	/** When the current repetition starts, delay included */
+	ktime_t			start;
+	/** How many repetitions are still to be played */
+	int			times;
+	/** sin(direction) in 1.15 fixed point, computed at upload */
+	int32_t			direction;
+};
+
+struct t150_mixer
+{
+	struct t150		*t150;
+	spinlock_t		lock;
+	struct hrtimer		timer;
+
+	/** Copy of the ff_mixer modes taken at probe */
+	bool			mixed[T150_MIXER_TYPES];
+	/** Copy of ff_closed_loop taken at probe */
+	bool			closed_loop;
+
+	/** Bit n set if effect n is uploaded to the mixer */
+	unsigned long		uploaded[BITS_TO_LONGS(FF_MAX_EFFECTS)];
+	/** Bit n set if effect n is playing */
+	unsigned long		playing[BITS_TO_LONGS(FF_MAX_EFFECTS)];
+	struct t150_mixer_effect	effects[FF_MAX_EFFECTS];
+
+	/** true while the timer is armed */
+	bool			running;
+	/** true while the stream effect is playing on the wheel */
+	bool			active;
+	/** The constant effect sent to T150_MIXER_SLOT */
+	struct ff_effect	stream;
+
+	/** Motion of the wheel, updated by every input report. Speed and
+	 * acceleration are in T150_MIXER_MOTION_FRAC fixed point */
+	int32_t			position;
+	int32_t			velocity;
+	int32_t			acceleration;
+	ktime_t			last_input;
+
+	/** How many ticks were computed */
+	atomic_t		ticks;
+	/** How many times the level of the stream changed */
+	atomic_t		updates;
+	/** How many times the forces were computed from an input report */
+	atomic_t		loops;
+};
+
+static int t150_init_mixer(struct t150 *t150);
+static void t150_free_mixer(struct t150 *t150);
+
+static enum hrtimer_restart t150_mixer_tick(struct hrtimer *timer);
+
+static bool t150_mixer_wants(struct t150 *t150, struct ff_effect *effect);
+static bool t150_mixer_owns(struct t150 *t150, int effect_id);
+static void t150_mixer_upload(struct t150 *t150, struct ff_effect *effect);
+static void t150_mixer_release(struct t150 *t150, int effect_id);
+static int t150_mixer_play(struct t150 *t150, int effect_id, int times);
+static void t150_mixer_input(struct t150 *t150, int32_t position);
@@ -0,0 +1,220 @@
+/** Gives an URB back to the pool */
+static void t150_pool_put(struct urb *urb)
+{
+	struct t150_pool_entry *entry = urb->context;
+	struct t150_urb_pool *pool = entry->t150->urb_pool;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	__set_bit(entry->index, pool->free);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/** Callback of the URBs of the pool, a halted endpoint is recovered */
+static void t150_pool_complete(struct urb *urb)
+{
+	struct t150_pool_entry *entry = urb->context;
+	struct t150 *t150 = entry->t150;
+	struct ff_change_gain *ff_change = urb->transfer_buffer;
+	int status = t150_recovery_status(t150, urb->status);
+	unsigned long flags;
+
+	// The wheel accepted the gain, now we can update the cached value
+	if(!status && entry->source.key == T150_TX_KEY_GAIN) {
+		spin_lock_irqsave(&t150->settings.access_lock, flags);
+		t150->settings.gain = ff_change->gain;
+		spin_unlock_irqrestore(&t150->settings.access_lock, flags);
+	}
+
+	t150_pool_put(urb);
+
+	if(t150_recovery_fatal(status))
+		t150_recovery_trigger(t150, status);
+}
+
+/** Called by the transmit scheduler when it's the turn of a queued URB */
+static bool t150_pool_send(struct t150_tx_source *source)
+{
+	struct t150_pool_entry *entry = container_of(source, struct t150_pool_entry, source);
+	int errno;
+
+	// The recovery replays the play state once the endpoint is back
+	if(t150_recovery_active(entry->t150)) {
+		t150_pool_put(entry->urb);
+		return false;
+	}
+
+	errno = usb_submit_urb(entry->urb, GFP_ATOMIC);
+	if(errno) {
+		t150_pool_put(entry->urb);
+		hid_err(entry->t150->hid_device, "unable to send queued URB, errno %d\n", errno);
+		return false;
+	}
+
+	return true;
+}
+
+/** Called by the transmit scheduler when a newer command replaced a queued URB */
+static void t150_pool_drop(struct t150_tx_source *source)
+{
+	struct t150_pool_entry *entry = container_of(source, struct t150_pool_entry, source);
+
+	t150_pool_put(entry->urb);
+}
+
+/**
+ * Allocates all the URBs of the pool, their buffers come from the arena.
+ * Called from probe, it's the only place where the pool allocates memory
+ * @param t150 the wheel
+ * @returns 0 if no error, -ENOMEM otherwise
+ */
+static int t150_init_pool(struct t150 *t150)
+{
+	struct t150_urb_pool *pool;
+	struct t150_pool_entry *entry;
+	unsigned i;
+
+	pool = kzalloc(sizeof(struct t150_urb_pool), GFP_KERNEL);
+	if(!pool)
+		return -ENOMEM;
+
+	spin_lock_init(&pool->lock);
+	atomic_set(&pool->exhausted, 0);
+	t150->urb_pool = pool;
+
+	for(i = 0; i < T150_POOL_SIZE; i++) {
+		entry = &pool->entries[i];
+		entry->t150 = t150;
+		entry->index = i;
+		entry->source.send = t150_pool_send;
+		entry->source.drop = t150_pool_drop;
+
+		entry->urb = usb_alloc_urb(0, GFP_KERNEL);
+		if(!entry->urb)
+			goto err;
+
+		usb_fill_int_urb(
+			entry->urb,
+			t150->usb_device,
+			t150->pipe_out,
+			0,
+			T150_POOL_BUFFER_SIZE,
+			t150_pool_complete,
+			entry,
+			t150->bInterval_out
+		);
+
+		if(t150_arena_bind(t150, entry->urb, T150_POOL_BUFFER_SIZE))
+			goto err;
+
+		__set_bit(i, pool->free);
+	}
+
+	return 0;
+
+err:	t150_free_pool(t150);
+	return -ENOMEM;
+}
+
+/**
+ * Waits for the URBs in flight and frees the whole pool
+ * @param t150 the wheel
+ */
+static void t150_free_pool(struct t150 *t150)
+{
+	struct t150_urb_pool *pool = t150->urb_pool;
+	unsigned i;
+
+	if(!pool)
+		return;
+
+	for(i = 0; i < T150_POOL_SIZE; i++) {
+		if(!pool->entries[i].urb)
+			continue;
+
+		usb_kill_urb(pool->entries[i].urb);
+		usb_free_urb(pool->entries[i].urb);
+	}
+
+	kfree(pool);
+	t150->urb_pool = 0;
+}
+
+/**
+ * Takes a free URB from the pool. Safe to call in atomic context.
+ * @param t150 the wheel
+ * @returns an URB with a zeroed buffer of T150_POOL_BUFFER_SIZE bytes,
+ * 	0 if every URB of the pool is in flight
+ */
+static struct urb *t150_pool_get(struct t150 *t150)
+{
+	struct t150_urb_pool *pool = t150->urb_pool;
+	struct urb *urb;
+	unsigned long flags, i;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	i = find_first_bit(pool->free, T150_POOL_SIZE);
+	if(i >= T150_POOL_SIZE) {
+		spin_unlock_irqrestore(&pool->lock, flags);
+		atomic_inc(&pool->exhausted);
+		return 0;
+	}
+
+	__clear_bit(i, pool->free);
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	urb = pool->entries[i].urb;
+	memset(urb->transfer_buffer, 0, T150_POOL_BUFFER_SIZE);
+
+	return urb;
+}
+
+/**
+ * Sends an URB taken with t150_pool_get, through the transmit scheduler.
+ * If the submission fails the URB is given back to the pool. Safe to call
+ * in atomic context.
+ * @param t150 the wheel
+ * @param urb the URB to send
+ * @param length how many bytes of the buffer are to be sent
+ * @param key an older queued command with the same key is dropped, 0 never
+ * @returns 0 if no error or if the URB is queued
+ * 	@see usb_submit_urb for the error codes
+ */
+static int t150_pool_submit(struct t150 *t150, struct urb *urb, size_t length, u32 key)
+{
+	struct t150_pool_entry *entry = urb->context;
+	int errno;
+
+	urb->transfer_buffer_length = length;
+	entry->source.key = key;
+
+	// The recovery replays the play state once the endpoint is back
+	if(t150_recovery_active(t150)) {
+		t150_pool_put(urb);
+		return 0;
+	}
+
+	if(!t150_tx_acquire(t150, &entry->source, T150_TX_CLASS_CONTROL))
+		return 0;
+
+	errno = usb_submit_urb(urb, GFP_ATOMIC);
+	if(errno) {
+		t150_pool_put(urb);
+		t150_tx_refund(t150, T150_TX_CLASS_CONTROL);
+	}
+
+	return errno;
+}
+
+/**
+ * Kills the URBs of the pool in flight, they go back to the pool
+ * @param t150 the wheel
+ */
+static void t150_pool_kill(struct t150 *t150)
+{
+	unsigned i;
+
+	for(i = 0; i < T150_POOL_SIZE; i++)
+		usb_kill_urb(t150->urb_pool->entries[i].urb);
+}
@@ -0,0 +1,40 @@
+/********************************************************************
+ *			      URB POOL
+ *
+ *      URBs used for the short ffb commands (play, stop, gain)
+ *      are allocated once when the wheel is probed and then
+ *         recycled by their completion handler, so the
+ *          callers never allocate and never sleep
+ *******************************************************************/
+
+/** How many URBs are preallocated for each wheel */
+#define T150_POOL_SIZE		32
+/** Size of the buffer of each URB, an interrupt packet of the OUT endpoint */
+#define T150_POOL_BUFFER_SIZE	32
+
+struct t150_pool_entry
+{
+	struct t150	*t150;
+	struct urb	*urb;
+	unsigned	index;
+	/** Waits here for the transmit scheduler */
+	struct t150_tx_source	source;
+};
+
+struct t150_urb_pool
+{
+	spinlock_t lock;
+	/** A set bit means the URB is not in flight and can be used */
+	unsigned long free[BITS_TO_LONGS(T150_POOL_SIZE)];
+	struct t150_pool_entry entries[T150_POOL_SIZE];
+
+	/** How many times a caller found no free URB */
+	atomic_t exhausted;
+};
+
+static int t150_init_pool(struct t150 *t150);
+static void t150_free_pool(struct t150 *t150);
+
+static struct urb *t150_pool_get(struct t150 *t150);
+static int t150_pool_submit(struct t150 *t150, struct urb *urb, size_t length, u32 key);
+static void t150_pool_kill(struct t150 *t150);
@@ -0,0 +1,227 @@
+/**
+ * Allocates the reconstruction stage of a wheel, disabled by default
+ * @param t150 ptr to t150
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int t150_init_recon(struct t150 *t150)
+{
+	struct t150_recon *recon = kzalloc(sizeof(struct t150_recon), GFP_KERNEL);
+
+	if(!recon)
+		return -ENOMEM;
+
+	recon->t150 = t150;
+	spin_lock_init(&recon->lock);
+	t150_hrtimer_setup(&recon->timer, t150_recon_tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+
+	// At full speed bInterval is in milliseconds
+	recon->period = ms_to_ktime(max_t(uint8_t, t150->bInterval_out, 1));
+	recon->mode = T150_RECON_OFF;
+	recon->latency_us = T150_RECON_DEFAULT_LATENCY_US;
+	recon->slew = T150_RECON_DEFAULT_SLEW;
+
+	t150->recon = recon;
+
+	return 0;
+}
+
+/**
+ * Stops the timer. To be called before the effect slots are freed
+ * @param t150 ptr to t150
+ */
+static void t150_free_recon(struct t150 *t150)
+{
+	if(!t150->recon)
+		return;
+
+	hrtimer_cancel(&t150->recon->timer);
+	kfree(t150->recon);
+	t150->recon = 0;
+}
+
+/**
+ * Uploads a constant effect. If only the level changed, and the
+ * reconstruction is enabled, the new level is reached by the timer over
+ * the next output intervals; the first of them is sent one tick after
+ * the upload, so the filter costs one output interval of latency on top
+ * of the length of the segment, which is never longer than latency_us.
+ * Any other change is uploaded right away.
+ * @param t150 ptr to t150
+ * @param effect the new effect
+ * @return 0 on success @see t150_vslot_post for error codes
+ */
+static int t150_recon_upload(struct t150 *t150, struct ff_effect *effect)
+{
+	struct t150_recon *recon = t150->recon;
+	struct t150_recon_channel *channel = &recon->channels[effect->id];
+	struct ff_effect same;
+	ktime_t now = ktime_get();
+	s64 interval;
+	unsigned long flags;
+	int errno;
+
+	spin_lock_irqsave(&recon->lock, flags);
+
+	if(test_bit(effect->id, recon->valid)) {
+		same = *effect;
+		same.u.constant.level = channel->sent.u.constant.level;
+
+		if(recon->mode != T150_RECON_OFF && !memcmp(&same, &channel->sent, sizeof(struct ff_effect))) {
+			// The segment lasts as long as the game takes between two updates, within the budget
+			interval = ktime_us_delta(now, channel->last_update);
+			interval = min_t(s64, interval, recon->latency_us);
+			interval = max_t(s64, interval, ktime_to_us(recon->period));
+
+			channel->previous = channel->to;
+			channel->from = channel->sent.u.constant.level;
+			channel->to = effect->u.constant.level;
+			channel->start = now;
+			channel->span_us = interval;
+			channel->last_update = now;
+			set_bit(effect->id, recon->moving);
+
+			if(!recon->running) {
+				recon->running = true;
+				hrtimer_start(&recon->timer, recon->period, HRTIMER_MODE_REL);
+			}
+
+			spin_unlock_irqrestore(&recon->lock, flags);
+			return 0;
+		}
+	}
+
+	clear_bit(effect->id, recon->moving);
+
+	errno = t150_vslot_post(t150, effect);
+	if(!errno) {
+		channel->sent = *effect;
+		channel->previous = channel->to = effect->u.constant.level;
+		channel->last_update = now;
+		set_bit(effect->id, recon->valid);
+	} else {
+		clear_bit(effect->id, recon->valid);
+	}
+
+	spin_unlock_irqrestore(&recon->lock, flags);
+
+	return errno;
+}
+
+/**
+ * Forgets an effect, because it was erased or because it's not
+ * a constant effect on the wheel anymore
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect
+ */
+static void t150_recon_release(struct t150 *t150, int effect_id)
+{
+	unsigned long flags;
+
+	if(!t150->recon)
+		return;
+
+	spin_lock_irqsave(&t150->recon->lock, flags);
+	clear_bit(effect_id, t150->recon->valid);
+	clear_bit(effect_id, t150->recon->moving);
+	spin_unlock_irqrestore(&t150->recon->lock, flags);
+}
+
+/**
+ * Level of a channel at a point of its segment
+ * @param recon the reconstruction stage
+ * @param channel the channel
+ * @param elapsed microseconds since the start of the segment
+ * @param done set to true if the target is reached
+ * @return the level
+ */
+static int32_t t150_recon_level(struct t150_recon *recon, struct t150_recon_channel *channel,
+	s64 elapsed, bool *done)
+{
+	int32_t distance = channel->to - channel->from;
+	s64 u, u2, u3, step, level;
+	s64 m1, m2;
+
+	// Position in the segment, 1 << 16 is the end
+	u = elapsed >= channel->span_us ? 1 << 16 : div_u64((u64)elapsed << 16, channel->span_us);
+	*done = u == 1 << 16;
+
+	switch (recon->mode) {
+	case T150_RECON_CUBIC:
+		// Cubic Hermite, tangents as in a Catmull-Rom spline
+		u2 = (u * u) >> 16;
+		u3 = (u2 * u) >> 16;
+		m1 = (channel->to - channel->previous) / 2;
+		m2 = distance;
+
+		level = (2 * u3 - 3 * u2 + (1 << 16)) * channel->from
+			+ (u3 - 2 * u2 + u) * m1
+			+ (3 * u2 - 2 * u3) * channel->to
+			+ (u3 - u2) * m2;
+		level >>= 16;
+		break;
+	case T150_RECON_SLEW:
+		// At least slew units per millisecond, fast enough to end within the budget
+		step = max_t(s64, div_s64((s64)recon->slew * elapsed, USEC_PER_MSEC), (abs(distance) * u) >> 16);
+		*done = step >= abs(distance);
+		level = *done ? channel->to : channel->from + (distance < 0 ? -step : step);
+		break;
+	case T150_RECON_LINEAR:
+	default:
+		level = channel->from + ((distance * u) >> 16);
+		break;
+	}
+
+	if(*done)
+		return channel->to;
+
+	return clamp_t(s64, level, -0x8000, 0x7fff);
+}
+
+/**
+ * Timer of the reconstruction, runs once per output interval while
+ * some channel is moving. A sample that does not change the level
+ * on the wire is not sent and it's counted as skipped
+ */
+static enum hrtimer_restart t150_recon_tick(struct hrtimer *timer)
+{
+	struct t150_recon *recon = container_of(timer, struct t150_recon, timer);
+	struct t150_recon_channel *channel;
+	struct ff_effect next;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	bool running, done;
+	int id;
+
+	spin_lock_irqsave(&recon->lock, flags);
+
+	for_each_set_bit(id, recon->moving, FF_MAX_EFFECTS) {
+		channel = &recon->channels[id];
+
+		next = channel->sent;
+		next.u.constant.level = t150_recon_level(recon, channel,
+			ktime_us_delta(now, channel->start), &done);
+
+		if(t150_ff_constant_level(&next) == t150_ff_constant_level(&channel->sent)) {
+			channel->sent = next;
+			atomic_inc(&recon->skipped);
+		} else if(!t150_vslot_post(recon->t150, &next)) {
+			channel->sent = next;
+			atomic_inc(&recon->emitted);
+		} else {
+			done = false; // Try again on the next tick
+		}
+
+		if(done)
+			clear_bit(id, recon->moving);
+	}
+
+	running = recon->running = !bitmap_empty(recon->moving, FF_MAX_EFFECTS);
+
+	spin_unlock_irqrestore(&recon->lock, flags);
+
+	if(!running)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, recon->period);
+	return HRTIMER_RESTART;
+}
@@ -0,0 +1,197 @@
+static void t150_recovery_work(struct work_struct *work);
+
+/**
+ * Allocates the recovery of a wheel
+ * @param t150 ptr to t150
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int t150_init_recovery(struct t150 *t150)
+{
+	struct t150_recovery *recovery = kzalloc(sizeof(struct t150_recovery), GFP_KERNEL);
+
+	if(!recovery)
+		return -ENOMEM;
+
+	spin_lock_init(&recovery->lock);
+	mutex_init(&recovery->sync_lock);
+	INIT_DELAYED_WORK(&recovery->work, t150_recovery_work);
+	recovery->t150 = t150;
+
+	t150->recovery = recovery;
+
+	return 0;
+}
+
+/**
+ * No recovery is started anymore, and the one running is waited for.
+ * To be called before the URBs of the slots and of the pool are freed
+ * @param t150 ptr to t150
+ */
+static void t150_stop_recovery(struct t150 *t150)
+{
+	struct t150_recovery *recovery = t150->recovery;
+	unsigned long flags;
+
+	if(!recovery)
+		return;
+
+	spin_lock_irqsave(&recovery->lock, flags);
+	recovery->dead = true;
+	spin_unlock_irqrestore(&recovery->lock, flags);
+
+	cancel_delayed_work_sync(&recovery->work);
+}
+
+/**
+ * Frees the recovery, after all the URBs were killed
+ * @param t150 ptr to t150
+ */
+static void t150_free_recovery(struct t150 *t150)
+{
+	t150_stop_recovery(t150);
+
+	kfree(t150->recovery);
+	t150->recovery = 0;
+}
+
+/**
+ * @param status status of a transfer on the OUT endpoint
+ * @return true if the endpoint is halted or out of sync with the wheel,
+ * 	and sending again is pointless until it's recovered
+ */
+static bool t150_recovery_fatal(int status)
+{
+	switch (status) {
+	case -EPIPE:
+	case -EPROTO:
+	case -EILSEQ:
+	case -ETIME:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * The status a completion handler has to act on: the one of the URB,
+ * unless an error was injected through debugfs and the transfer succeeded
+ * @param t150 ptr to t150
+ * @param status status of the URB
+ * @return the status to handle
+ */
+static int t150_recovery_status(struct t150 *t150, int status)
+{
+	int injected;
+
+	if(status || !atomic_read(&t150->recovery->inject))
+		return status;
+
+	injected = atomic_xchg(&t150->recovery->inject, 0);
+
+	return injected ? -abs(injected) : status;
+}
+
+/**
+ * Starts the recovery of the OUT endpoint, if it's not already running.
+ * Safe to call in atomic context
+ * @param t150 ptr to t150
+ * @param status the error that was seen
+ */
+static void t150_recovery_trigger(struct t150 *t150, int status)
+{
+	struct t150_recovery *recovery = t150->recovery;
+	unsigned long flags;
+	bool start = false;
+
+	spin_lock_irqsave(&recovery->lock, flags);
+
+	if(recovery->dead)
+		goto out;
+
+	if(recovery->active) {
+		atomic_inc(&recovery->errors);
+		goto out;
+	}
+
+	WRITE_ONCE(recovery->active, true);
+	// The settings wait in their queue until the endpoint is back
+	t150_tx_hold(t150, T150_TX_CLASS_SETTINGS, true);
+	recovery->since = ktime_get();
+	recovery->attempts = 0;
+	queue_delayed_work(system_highpri_wq, &recovery->work, 0);
+	start = true;
+
+out:	spin_unlock_irqrestore(&recovery->lock, flags);
+
+	if(start)
+		hid_warn(t150->hid_device, "OUT endpoint failed with status %d, recovering\n", status);
+}
+
+/**
+ * @param t150 ptr to t150
+ * @return true while the OUT endpoint is being recovered, the ffb
+ * 	traffic waits for the end of it
+ */
+static bool t150_recovery_active(struct t150 *t150)
+{
+	return READ_ONCE(t150->recovery->active);
+}
+
+/**
+ * Worker of the recovery. The URBs queued on the endpoint are killed,
+ * the slots keep their packets, then the halt is cleared, which also
+ * resets the data toggle of the endpoint. Once the endpoint works the
+ * cached settings are applied again, the effects of the slots are
+ * uploaded in full and the play state of the table is replayed
+ */
+static void t150_recovery_work(struct work_struct *work)
+{
+	struct t150_recovery *recovery = container_of(to_delayed_work(work), struct t150_recovery, work);
+	struct t150 *t150 = recovery->t150;
+	unsigned long flags;
+	u64 elapsed;
+	int errno, i;
+
+	// Nothing may be queued on an endpoint while its halt is cleared
+	for(i = 0; i < T150_FF_DEVICE_SLOTS; i++)
+		usb_kill_urb(t150->ff_slots[i].urb);
+	t150_pool_kill(t150);
+
+	// A setting that had its turn before the error is waited for
+	mutex_lock(&recovery->sync_lock);
+	errno = usb_clear_halt(t150->usb_device, t150->pipe_out);
+	mutex_unlock(&recovery->sync_lock);
+
+	if(errno && ++recovery->attempts < T150_RECOVERY_ATTEMPTS && !READ_ONCE(recovery->dead)) {
+		queue_delayed_work(system_highpri_wq, &recovery->work,
+			msecs_to_jiffies(T150_RECOVERY_BACKOFF_MS));
+		return;
+	}
+
+	spin_lock_irqsave(&recovery->lock, flags);
+	WRITE_ONCE(recovery->active, false);
+	spin_unlock_irqrestore(&recovery->lock, flags);
+
+	t150_tx_hold(t150, T150_TX_CLASS_SETTINGS, false);
+
+	// The next error starts over
+	if(errno) {
+		atomic_inc(&recovery->failures);
+		hid_err(t150->hid_device, "unable to clear the halt of the OUT endpoint, error %d\n", errno);
+		return;
+	}
+
+	if(READ_ONCE(recovery->dead))
+		return;
+
+	t150_settings_reapply(t150);
+	t150_ff_resend(t150);
+	t150_vslot_replay(t150, true);
+
+	elapsed = ktime_us_delta(ktime_get(), recovery->since);
+	recovery->last_us = elapsed;
+	recovery->max_us = max(recovery->max_us, elapsed);
+	atomic_inc(&recovery->recoveries);
+
+	hid_info(t150->hid_device, "OUT endpoint recovered in %llu us\n", elapsed);
+}
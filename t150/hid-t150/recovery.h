@@ -0,0 +1,53 @@
+/********************************************************************
+ *			   ENDPOINT RECOVERY
+ *
+ *     A stall or a protocol error leaves the OUT endpoint dead
+ *   until its halt is cleared. The recovery worker stops the ffb
+ *   traffic, clears the halt and sends again what the wheel had:
+ *     the settings, the effects and which of them were playing
+ *******************************************************************/
+
+/** Attempts to clear the halt before giving up */
+#define T150_RECOVERY_ATTEMPTS		3
+/** Wait between two attempts, in milliseconds */
+#define T150_RECOVERY_BACKOFF_MS		5
+
+struct t150_recovery
+{
+	struct delayed_work	work;
+	struct t150		*t150;
+
+	spinlock_t		lock;
+	/** true from the error to the end of the recovery, nothing is sent */
+	bool			active;
+	/** true once the wheel is being removed */
+	bool			dead;
+	/** Held by the settings around their synchronous transfer, which can't
+	 * be killed, and by the worker while it clears the halt */
+	struct mutex		sync_lock;
+	/** Failed attempts to clear the halt of the current recovery */
+	unsigned		attempts;
+	/** When the error that started the recovery arrived */
+	ktime_t			since;
+
+	/** errno, as a positive number, that the next successful transfer
+	 * reports instead of its status; 0 if none. Written from debugfs */
+	atomic_t		inject;
+
+	/** Recoveries completed, given up, and errors seen while one was running */
+	atomic_t		recoveries;
+	atomic_t		failures;
+	atomic_t		errors;
+	/** Time from the error to the traffic sent again, in microseconds */
+	u64			last_us;
+	u64			max_us;
+};
+
+static int t150_init_recovery(struct t150 *t150);
+static void t150_stop_recovery(struct t150 *t150);
+static void t150_free_recovery(struct t150 *t150);
+
+static bool t150_recovery_fatal(int status);
+static int t150_recovery_status(struct t150 *t150, int status);
+static void t150_recovery_trigger(struct t150 *t150, int status);
+static bool t150_recovery_active(struct t150 *t150);
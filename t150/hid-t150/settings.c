@@ -1,118 +1,224 @@
 /**
- * @param t150 ptr to t150
- * @param gain a value between 0x00 and 0x80 where 0x80 is 100% gain
- * @return 0 on success @see usb_interrupt_msg for return codes
+ * Sends a command to the wheel and, if the wheel accepts it, updates the
+ * cached value of the setting
+ * @param setting the command
  */
-static int t150_set_gain(struct t150 *t150, uint8_t gain)
+static void t150_settings_run(struct t150_setting *setting)
 {
-	int boh, errno;
-	uint8_t *buffer = kzalloc(2, GFP_KERNEL);
+	struct t150 *t150 = setting->t150;
+	struct operation40 *op40 = (struct operation40 *)setting->buffer;
+	struct t150_tx_waiter waiter;
 	unsigned long flags;
+	int boh;
 
-	buffer[0] = 0x43;
-	buffer[1] = gain;
+	for(;;) {
+		// Settings go after the ffb traffic, and wait for the end of a recovery
+		setting->errno = t150_tx_wait(t150, &waiter, T150_TX_CLASS_SETTINGS);
+		if(setting->errno)
+			return;
 
-	mutex_lock(&t150->lock);
+		mutex_lock(&t150->recovery->sync_lock);
+		if(!t150_recovery_active(t150))
+			break;
 
-	// Send to the wheel desidered return force
-	errno = usb_interrupt_msg(
+		// The recovery started after our turn came, back in the queue
+		mutex_unlock(&t150->recovery->sync_lock);
+		t150_tx_refund(t150, T150_TX_CLASS_SETTINGS);
+	}
+
+	setting->errno = usb_interrupt_msg(
 		t150->usb_device,
 		t150->pipe_out,
-		buffer,
-		2, &boh,
+		setting->buffer,
+		setting->length, &boh,
 		SETTINGS_TIMEOUT
 	);
 
-	if(!errno) {
-		spin_lock_irqsave(&t150->settings.access_lock, flags);
-		t150->settings.gain = gain;
-		spin_unlock_irqrestore(&t150->settings.access_lock, flags);
-	} else {
-		hid_err(t150->hid_device, "Operation set gain failed with code %d", errno);
+	mutex_unlock(&t150->recovery->sync_lock);
+
+	if(setting->errno) {
+		hid_err(t150->hid_device, "errno %d during operation 0x%02hhX 0x%02hhX",
+			setting->errno, setting->buffer[0], setting->buffer[1]);
+		if(t150_recovery_fatal(setting->errno))
+			t150_recovery_trigger(t150, setting->errno);
+		return;
 	}
 
-	mutex_unlock(&t150->lock);
+	// The wheel accepted the command, now we can update the cached value
+	spin_lock_irqsave(&t150->settings.access_lock, flags);
+
+	if(setting->buffer[0] == 0x43)
+		t150->settings.gain = setting->buffer[1];
+	else switch (op40->operation) {
+	case SET40_RETURN_FORCE:
+		t150->settings.autocenter_force = le16_to_cpu(op40->argument);
+		break;
+	case SET40_USE_RETURN_FORCE:
+		t150->settings.autocenter_enabled = le16_to_cpu(op40->argument);
+		break;
+	case SET40_RANGE:
+		t150->settings.range = le16_to_cpu(op40->argument);
+		break;
+	}
 
-	kfree(buffer);
+	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
+}
 
-	return errno;
+/**
+ * Worker of the settings queue. The queue is ordered, so the commands reach the
+ * wheel one at the time and in the same order they were queued.
+ */
+static void t150_settings_work(struct work_struct *work)
+{
+	struct t150_setting *setting = container_of(work, struct t150_setting, work);
+
+	t150_settings_run(setting);
+
+	if(setting->mode == T150_SETTINGS_WAIT) {
+		complete(&setting->done);
+	} else {
+		kfree(setting->buffer);
+		kfree(setting);
+	}
 }
 
 /**
- * @param autocenter_force a value between 0 and 100, is the strength of the autocenter effect
+ * Allocates a new settings command
+ * @param t150 ptr to t150
+ * @param length size of the packet
+ * @param mode how the command is going to be delivered
+ * @return the command with a zeroed buffer, 0 if no memory
  */
-static __always_inline int t150_set_autocenter(struct t150 *t150, uint8_t autocenter_force)
+static struct t150_setting *t150_settings_alloc(struct t150 *t150, size_t length,
+	enum t150_settings_mode mode)
 {
-	uint8_t *buffer = kzalloc(4, GFP_KERNEL);
-	int errno;
-	unsigned long flags;
+	struct t150_setting *setting = kzalloc(sizeof(struct t150_setting), GFP_KERNEL);
 
-	mutex_lock(&t150->lock);
+	if(!setting)
+		return 0;
+
+	setting->buffer = kzalloc(length, GFP_KERNEL);
+	if(!setting->buffer) {
+		kfree(setting);
+		return 0;
+	}
 
-	errno = t150_settings_set40(t150, SET40_RETURN_FORCE, autocenter_force, buffer);
+	INIT_WORK(&setting->work, t150_settings_work);
+	init_completion(&setting->done);
+	setting->t150 = t150;
+	setting->length = length;
+	setting->mode = mode;
 
-	if(!errno) {
-		spin_lock_irqsave(&t150->settings.access_lock, flags);
-		t150->settings.autocenter_force = autocenter_force;
-		spin_unlock_irqrestore(&t150->settings.access_lock, flags);
+	return setting;
+}
+
+/**
+ * Delivers a command allocated with t150_settings_alloc
+ * @return 0 if async, otherwise the result of the command
+ * 	@see usb_interrupt_msg for return codes
+ */
+static int t150_settings_queue(struct t150 *t150, struct t150_setting *setting)
+{
+	int errno;
+
+	switch (setting->mode) {
+	case T150_SETTINGS_ASYNC:
+		queue_work(t150->settings_wq, &setting->work);
+		return 0;
+	case T150_SETTINGS_WAIT:
+		queue_work(t150->settings_wq, &setting->work);
+		wait_for_completion(&setting->done);
+		break;
+	case T150_SETTINGS_NOW:
+		t150_settings_run(setting);
+		break;
 	}
 
-	mutex_unlock(&t150->lock);
+	errno = setting->errno;
+	kfree(setting->buffer);
+	kfree(setting);
 
-	kfree(buffer);
 	return errno;
 }
 
 /**
- * @param enable true if the autocenter effect is to be kept enabled when the input
- * 	is opened. The autocentering effect is always active while no input are open
+ * Creates the ordered work queue used to send the settings to the wheel
+ * @param t150 ptr to t150
+ * @return 0 on success, -ENOMEM otherwise
  */
-static __always_inline int t150_set_enable_autocenter(struct t150 *t150, bool enable)
+static int t150_init_settings(struct t150 *t150)
 {
-	uint8_t *buffer = kzalloc(4, GFP_KERNEL);
-	int errno;
-	unsigned long flags;
+	t150->settings_wq = alloc_ordered_workqueue("t150-settings-%s", 0,
+		dev_name(&t150->hid_device->dev));
 
-	mutex_lock(&t150->lock);
+	if(!t150->settings_wq)
+		return -ENOMEM;
 
-	errno = t150_settings_set40(t150, SET40_USE_RETURN_FORCE, enable, buffer);
+	INIT_WORK(&t150->setup_work, t150_setup_task);
 
-	if(!errno) {
-		spin_lock_irqsave(&t150->settings.access_lock, flags);
-		t150->settings.autocenter_enabled = enable;
-		spin_unlock_irqrestore(&t150->settings.access_lock, flags);
-	}
+	return 0;
+}
 
-	mutex_unlock(&t150->lock);
+/**
+ * Sends the commands still in the queue and destroys it.
+ * If the setup did not start yet it's skipped
+ * @param t150 ptr to t150
+ */
+static void t150_free_settings(struct t150 *t150)
+{
+	if(!t150->settings_wq)
+		return;
 
-	kfree(buffer);
-	return errno;
+	cancel_work_sync(&t150->setup_work);
+	destroy_workqueue(t150->settings_wq);
+	t150->settings_wq = 0;
 }
 
 /**
- * @param range a value between 0x0000 and 0xffff where 0xffff is 1080°
- * 	wheel range
+ * @param t150 ptr to t150
+ * @param gain a value between 0x00 and 0x80 where 0x80 is 100% gain
+ * @param mode how the command is delivered
+ * @return 0 on success @see usb_interrupt_msg for return codes
  */
-static __always_inline int t150_set_range(struct t150 *t150, uint16_t range)
+static int t150_set_gain(struct t150 *t150, uint8_t gain, enum t150_settings_mode mode)
 {
-	uint8_t *buffer = kzalloc(4, GFP_KERNEL);
-	int errno;
-	unsigned long flags;
+	struct t150_setting *setting = t150_settings_alloc(t150, 2, mode);
 
-	mutex_lock(&t150->lock);
+	if(!setting)
+		return -ENOMEM;
 
-	errno = t150_settings_set40(t150, SET40_RANGE, range, buffer);
+	setting->buffer[0] = 0x43;
+	setting->buffer[1] = gain;
 
-	if(!errno) {
-		spin_lock_irqsave(&t150->settings.access_lock, flags);
-		t150->settings.range = range;
-		spin_unlock_irqrestore(&t150->settings.access_lock, flags);
-	}
+	return t150_settings_queue(t150, setting);
+}
 
-	mutex_unlock(&t150->lock);
+/**
+ * @param autocenter_force a value between 0 and 100, is the strength of the autocenter effect
+ */
+static __always_inline int t150_set_autocenter(struct t150 *t150, uint8_t autocenter_force,
+	enum t150_settings_mode mode)
+{
+	return t150_settings_set40(t150, SET40_RETURN_FORCE, autocenter_force, mode);
+}
 
-	kfree(buffer);
-	return errno;
+/**
+ * @param enable true if the autocenter effect is to be kept enabled when the input
+ * 	is opened. The autocentering effect is always active while no input are open
+ */
+static __always_inline int t150_set_enable_autocenter(struct t150 *t150, bool enable,
+	enum t150_settings_mode mode)
+{
+	return t150_settings_set40(t150, SET40_USE_RETURN_FORCE, enable, mode);
+}
+
+/**
+ * @param range a value between 0x0000 and 0xffff where 0xffff is 1080°
+ * 	wheel range
+ */
+static __always_inline int t150_set_range(struct t150 *t150, uint16_t range, enum t150_settings_mode mode)
+{
+	return t150_settings_set40(t150, SET40_RANGE, range, mode);
 }
 
 
@@ -120,45 +226,46 @@ static __always_inline int t150_set_range(struct t150 *t150, uint16_t range)
  * @t150 pointer to t150
  * @operation number of operation
  * @argument the argument to pass with the request
- * @buffer a buffer of at least 4 BYTES!
+ * @mode how the command is delivered
  * @return 0 on success @see usb_interrupt_msg for return codes
  */
 static int t150_settings_set40(
-	struct t150 *t150, operation_t operation, uint16_t argument, void *buffer_
+	struct t150 *t150, operation_t operation, uint16_t argument, enum t150_settings_mode mode
 )
 {
-	int boh, errno;
-	struct operation40 *buffer = buffer_;
+	struct operation40 *buffer;
+	struct t150_setting *setting = t150_settings_alloc(t150, sizeof(struct operation40), mode);
+
+	if(!setting)
+		return -ENOMEM;
+
+	buffer = (struct operation40 *)setting->buffer;
 	buffer->code = 0x40;
 	buffer->operation = operation;
 	buffer->argument = cpu_to_le16(argument);
 
-	// Send to the wheel desidered return force
-	errno = usb_interrupt_msg(
-		t150->usb_device,
-		t150->pipe_out,
-		buffer,
-		sizeof(struct operation40), &boh,
-		SETTINGS_TIMEOUT
-	);
-
-	if(errno)
-		hid_err(t150->hid_device, "errno %d during operation 0x40 0x%02hhX with argument (big endian) %04hhX",
-			errno, operation, argument);
-
-	return errno;
+	return t150_settings_queue(t150, setting);
 }
 
-static int t150_setup_task(struct t150 *t150)
+/**
+ * Retrives the firmware version and writes the default settings.
+ * Runs in the settings queue after probe, so the writes done to the sysfs
+ * attributes in the meantime are applied after the defaults
+ */
+static void t150_setup_task(struct work_struct *work)
 {
+	struct t150 *t150 = container_of(work, struct t150, setup_work);
 	int errno = 0;
 	uint8_t *fw_version;
+	unsigned long flags;
 
 	fw_version = kzalloc(8, GFP_KERNEL);
+	if(!fw_version)
+		return;
 
 	// Retrive current version
 	mutex_lock(&t150->lock);
-	
+
 	errno = usb_control_msg(
 		t150->usb_device,
 		usb_rcvctrlpipe(t150->usb_device, 0),
@@ -172,24 +279,59 @@ static int t150_setup_task(struct t150 *t150)
 	else
 		t150->settings.firmware_version = fw_version[1];
 
-	errno = t150_set_gain(t150, 0x66); // ~80%
+	errno = t150_set_gain(t150, 0x66, T150_SETTINGS_NOW); // ~80%
 	if(errno)
 		hid_err(t150->hid_device, "Error %d while setting the t150 default gain\n", errno);
 
-	errno = t150_set_enable_autocenter(t150, false);
+	errno = t150_set_enable_autocenter(t150, false, T150_SETTINGS_NOW);
 	if(errno)
 		hid_err(t150->hid_device, "Error %d while setting the t150 default enable_autocenter\n", errno);
 
-	errno = t150_set_autocenter(t150, 50);
+	errno = t150_set_autocenter(t150, 50, T150_SETTINGS_NOW);
 	if(errno)
 		hid_err(t150->hid_device, "Error %d while setting the t150 default autocenter\n", errno);
 
-	errno = t150_set_range(t150, 0xffff);
+	errno = t150_set_range(t150, 0xffff, T150_SETTINGS_NOW);
 	if(errno)
 		hid_err(t150->hid_device, "Error %d while setting the t150 default range\n", errno);
 
-	hid_info(t150->hid_device,  "Setup completed! Firmware version is %d\n", t150->settings.firmware_version);
+	spin_lock_irqsave(&t150->settings.access_lock, flags);
+	t150->settings.setup_done = true;
+	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
+
+	t150->setup_time_us = ktime_us_delta(ktime_get(), t150->probe_time);
+
+	hid_info(t150->hid_device,  "Setup completed in %llu ms! Firmware version is %d\n",
+		t150->setup_time_us / USEC_PER_MSEC, t150->settings.firmware_version);
 
 	kfree(fw_version);
-	return errno;
+}
+
+/**
+ * Queues again the settings the wheel accepted, after the recovery of
+ * the OUT endpoint. Before the setup there is nothing to apply again
+ * @param t150 ptr to t150
+ */
+static void t150_settings_reapply(struct t150 *t150)
+{
+	uint8_t gain, autocenter_force;
+	bool autocenter_enabled, setup_done;
+	uint16_t range;
+	unsigned long flags;
+
+	spin_lock_irqsave(&t150->settings.access_lock, flags);
+	gain = t150->settings.gain;
+	autocenter_force = t150->settings.autocenter_force;
+	autocenter_enabled = t150->settings.autocenter_enabled;
+	range = t150->settings.range;
+	setup_done = t150->settings.setup_done;
+	spin_unlock_irqrestore(&t150->settings.access_lock, flags);
+
+	if(!setup_done)
+		return;
+
+	t150_set_gain(t150, gain, T150_SETTINGS_ASYNC);
+	t150_set_enable_autocenter(t150, autocenter_enabled, T150_SETTINGS_ASYNC);
+	t150_set_autocenter(t150, autocenter_force, T150_SETTINGS_ASYNC);
+	t150_set_range(t150, range, T150_SETTINGS_ASYNC);
 }
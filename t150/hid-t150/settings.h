@@ -25,12 +25,48 @@ struct opertation42
 	operation_t	operation;
 };
 
-static int t150_settings_set40(struct t150 *t150, operation_t operation, 
-	uint16_t argument, void *buffer);
+/** How a settings command is delivered */
+enum t150_settings_mode
+{
+	/** Queued, the caller does not wait for the ack */
+	T150_SETTINGS_ASYNC,
+	/** Queued, the caller waits for the ack */
+	T150_SETTINGS_WAIT,
+	/** Sent right away, only for code already running in the settings queue */
+	T150_SETTINGS_NOW
+};
+
+/** A settings command waiting in the work queue of the wheel.
+ * The cached value in t150->settings is updated by the worker only
+ * after the wheel has accepted the command.
+ */
+struct t150_setting
+{
+	struct work_struct	work;
+	struct t150		*t150;
+
+	/** DMA-safe packet, 0x40 operation or 0x43 gain */
+	uint8_t			*buffer;
+	size_t			length;
+
+	/** If not async the caller frees the command */
+	enum t150_settings_mode	mode;
+	struct completion	done;
+	int			errno;
+};
+
+static int t150_init_settings(struct t150 *t150);
+static void t150_free_settings(struct t150 *t150);
+
+static int t150_settings_set40(struct t150 *t150, operation_t operation,
+	uint16_t argument, enum t150_settings_mode mode);
 
-static int t150_set_gain(struct t150 *t150, uint8_t gain);
-static __always_inline int t150_set_autocenter(struct t150 *t150, uint8_t autocenter_force);
-static __always_inline int t150_set_enable_autocenter(struct t150 *t150, bool enable);
-static __always_inline int t150_set_range(struct t150 *t150, uint16_t range);
+static int t150_set_gain(struct t150 *t150, uint8_t gain, enum t150_settings_mode mode);
+static __always_inline int t150_set_autocenter(struct t150 *t150, uint8_t autocenter_force,
+	enum t150_settings_mode mode);
+static __always_inline int t150_set_enable_autocenter(struct t150 *t150, bool enable,
+	enum t150_settings_mode mode);
+static __always_inline int t150_set_range(struct t150 *t150, uint16_t range, enum t150_settings_mode mode);
 
-static int t150_setup_task(struct t150 *t150);
\ No newline at end of file
+static void t150_setup_task(struct work_struct *work);
+static void t150_settings_reapply(struct t150 *t150);
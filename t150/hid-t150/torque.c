@@ -0,0 +1,267 @@
+static DEFINE_IDA(t150_torque_ida);
+
+/** Frees the device when the wheel and the file are both gone */
+static void t150_torque_destroy(struct kref *kref)
+{
+	struct t150_torque *torque = container_of(kref, struct t150_torque, kref);
+
+	__free_page(torque->page);
+	kfree(torque);
+}
+
+/**
+ * Sends a new level on the reserved slot, starting the effect the
+ * first time. To be called with torque->lock held
+ * @param torque the device
+ * @param level the new level
+ */
+static void t150_torque_output(struct t150_torque *torque, int32_t level)
+{
+	struct t150 *t150 = torque->t150;
+	struct ff_effect stream = torque->stream;
+	int errno = 0;
+
+	stream.u.constant.level = level;
+
+	if(!torque->active) {
+		errno = t150_ff_post(t150, torque->slot, &stream);
+		if(!errno)
+			errno = t150_ff_post_play(t150, torque->slot, 1);
+		torque->active = !errno;
+	} else if(level != torque->stream.u.constant.level) {
+		errno = t150_ff_post(t150, torque->slot, &stream);
+	}
+
+	if(!errno)
+		torque->stream = stream;
+}
+
+/**
+ * Timer of the device, drains the ring once per output interval.
+ * The samples that arrived since the last tick are averaged into
+ * a single level; without new samples the last level is held, and
+ * after T150_TORQUE_STALL_US it drops to zero
+ */
+static enum hrtimer_restart t150_torque_tick(struct hrtimer *timer)
+{
+	struct t150_torque *torque = container_of(timer, struct t150_torque, timer);
+	struct t150_torque_ring *ring = torque->ring;
+	ktime_t now = ktime_get();
+	int32_t level, sum = 0;
+	unsigned long flags;
+	u32 head, count;
+	bool running;
+
+	spin_lock_irqsave(&torque->lock, flags);
+
+	running = torque->open && torque->t150;
+	if(!running)
+		goto out;
+
+	// Pairs with the release of the producer, the samples are there
+	head = smp_load_acquire(&ring->head);
+	count = head - torque->tail;
+
+	if(count > T150_TORQUE_RING_SAMPLES) {
+		atomic_add(count - T150_TORQUE_RING_SAMPLES, &torque->overruns);
+		torque->tail = head - T150_TORQUE_RING_SAMPLES;
+		count = T150_TORQUE_RING_SAMPLES;
+	}
+
+	if(count) {
+		for(; torque->tail != head; torque->tail++)
+			sum += READ_ONCE(ring->samples[torque->tail % T150_TORQUE_RING_SAMPLES]);
+
+		level = clamp_t(int32_t, sum / (int32_t)count, -0x7fff, 0x7fff);
+		torque->last_sample = now;
+		smp_store_release(&ring->tail, torque->tail);
+	} else {
+		atomic_inc(&torque->underruns);
+		level = torque->stream.u.constant.level;
+
+		if(level && ktime_us_delta(now, torque->last_sample) > T150_TORQUE_STALL_US) {
+			atomic_inc(&torque->stalls);
+			level = 0;
+		}
+	}
+
+	t150_torque_output(torque, level);
+
+out:	torque->running = running;
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	if(!running)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, torque->period);
+	return HRTIMER_RESTART;
+}
+
+/** Only one producer at a time, it gets the reserved slot */
+static int t150_torque_open(struct inode *inode, struct file *file)
+{
+	struct t150_torque *torque = container_of(file->private_data, struct t150_torque, misc);
+	unsigned long flags;
+	int errno = 0;
+
+	spin_lock_irqsave(&torque->lock, flags);
+
+	if(!torque->t150) {
+		errno = -ENODEV;
+	} else if(torque->open) {
+		errno = -EBUSY;
+	} else {
+		torque->slot = t150_vslot_reserve(torque->t150);
+		if(torque->slot < 0) {
+			errno = torque->slot;
+		} else {
+			memset(torque->ring, 0, sizeof(struct t150_torque_ring));
+			torque->ring->size = T150_TORQUE_RING_SAMPLES;
+			torque->tail = 0;
+			torque->last_sample = ktime_get();
+			torque->active = false;
+			torque->stream.u.constant.level = 0;
+			torque->open = true;
+
+			if(!torque->running) {
+				torque->running = true;
+				hrtimer_start(&torque->timer, torque->period, HRTIMER_MODE_REL);
+			}
+		}
+	}
+
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	if(errno)
+		return errno;
+
+	kref_get(&torque->kref);
+	file->private_data = torque;
+
+	return 0;
+}
+
+/** The torque is stopped and the slot given back */
+static int t150_torque_release(struct inode *inode, struct file *file)
+{
+	struct t150_torque *torque = file->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&torque->lock, flags);
+
+	torque->open = false;
+	if(torque->t150) {
+		if(torque->active)
+			t150_ff_send_play(torque->t150, torque->slot, 0);
+		t150_vslot_unreserve(torque->t150, torque->slot);
+	}
+	torque->active = false;
+
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	kref_put(&torque->kref, t150_torque_destroy);
+
+	return 0;
+}
+
+/** Maps the ring, a single page */
+static int t150_torque_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct t150_torque *torque = file->private_data;
+
+	if(vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	// The mapping holds a reference to the page, it outlives the device
+	return vm_insert_page(vma, vma->vm_start, torque->page);
+}
+
+static const struct file_operations t150_torque_fops = {
+	.owner = THIS_MODULE,
+	.open = t150_torque_open,
+	.release = t150_torque_release,
+	.mmap = t150_torque_mmap,
+	.llseek = noop_llseek,
+};
+
+/**
+ * Creates /dev/t150-torqueN for a wheel
+ * @param t150 ptr to t150
+ * @return 0 on success, -ENOMEM or an error of misc_register
+ */
+static int t150_init_torque(struct t150 *t150)
+{
+	struct t150_torque *torque = kzalloc(sizeof(struct t150_torque), GFP_KERNEL);
+	int errno = -ENOMEM;
+
+	if(!torque)
+		return -ENOMEM;
+
+	torque->page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if(!torque->page)
+		goto err0;
+	torque->ring = page_address(torque->page);
+
+	kref_init(&torque->kref);
+	spin_lock_init(&torque->lock);
+	t150_hrtimer_setup(&torque->timer, t150_torque_tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+
+	// At full speed bInterval is in milliseconds
+	torque->period = ms_to_ktime(max_t(uint8_t, t150->bInterval_out, 1));
+	torque->t150 = t150;
+
+	// The stream is a constant force pointing along the wheel axis
+	torque->stream.type = FF_CONSTANT;
+	torque->stream.direction = 0x4000;
+
+	torque->minor_id = ida_alloc(&t150_torque_ida, GFP_KERNEL);
+	if(torque->minor_id < 0) {
+		errno = torque->minor_id;
+		goto err1;
+	}
+
+	snprintf(torque->name, sizeof(torque->name), "t150-torque%d", torque->minor_id);
+	torque->misc.minor = MISC_DYNAMIC_MINOR;
+	torque->misc.name = torque->name;
+	torque->misc.fops = &t150_torque_fops;
+	torque->misc.parent = &t150->hid_device->dev;
+
+	errno = misc_register(&torque->misc);
+	if(errno)
+		goto err2;
+
+	t150->torque = torque;
+
+	return 0;
+
+err2:	ida_free(&t150_torque_ida, torque->minor_id);
+err1:	__free_page(torque->page);
+err0:	kfree(torque);
+	return errno;
+}
+
+/**
+ * Removes the device. An open file keeps it alive, but it's cut
+ * off from the wheel. To be called before the slots are freed
+ * @param t150 ptr to t150
+ */
+static void t150_free_torque(struct t150 *t150)
+{
+	struct t150_torque *torque = t150->torque;
+	unsigned long flags;
+
+	if(!torque)
+		return;
+
+	misc_deregister(&torque->misc);
+	ida_free(&t150_torque_ida, torque->minor_id);
+
+	spin_lock_irqsave(&torque->lock, flags);
+	torque->t150 = 0;
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	hrtimer_cancel(&torque->timer);
+
+	t150->torque = 0;
+	kref_put(&torque->kref, t150_torque_destroy);
+}
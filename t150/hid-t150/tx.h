@@ -0,0 +1,114 @@
+/********************************************************************
+ *			   TRANSMIT SCHEDULER
+ *
+ *     The OUT endpoint takes a packet every bInterval_out, all
+ *    the ffb traffic goes through a token bucket refilled at
+ *   that rate. What does not fit waits in one of three strict
+ *  priority queues, where stale commands are replaced by their
+ *                      newer versions
+ *******************************************************************/
+
+/** Transfers that can be handed to the host controller back to back */
+#define T150_TX_BURST			2
+/** After this many tokens in a row given to a higher class while a lower
+ * one waits, one goes to the lower class, so it's never starved. Play and
+ * stop commands are never put behind, they are not counted */
+#define T150_TX_STARVATION_LIMIT		8
+
+/** Traffic classes, in order of priority */
+enum t150_tx_class
+{
+	/** Play, stop, gain and updates of a single parameter */
+	T150_TX_CLASS_CONTROL,
+	/** Upload of whole effects */
+	T150_TX_CLASS_UPLOAD,
+	/** Wheel settings */
+	T150_TX_CLASS_SETTINGS,
+	T150_TX_CLASSES
+};
+
+static const char * const t150_tx_class_names[T150_TX_CLASSES] = {
+	"control", "upload", "settings"
+};
+
+/** Queue and statistics of a traffic class */
+struct t150_tx_queue
+{
+	struct list_head	sources;
+	/** Sends so far, and their time spent waiting for a token */
+	u64			sent;
+	u64			latency_total_us;
+	u64			latency_max_us;
+};
+
+/** Keys of the commands that replace their older queued versions */
+#define T150_TX_KEY_PLAY(id)		(0x100 | (id))
+#define T150_TX_KEY_GAIN			0x200
+#define T150_TX_KEY_IS_PLAY(key)		(((key) & ~0xff) == 0x100)
+
+/** Something that sends packets on the OUT endpoint */
+struct t150_tx_source
+{
+	struct list_head	node;
+	/** true while waiting in the queue */
+	bool			queued;
+	/** Class of the queue it's waiting in */
+	enum t150_tx_class	class;
+	/** When it entered the queue */
+	ktime_t			since;
+	/** A queued source with the same key is dropped in favour of this one, 0 never */
+	u32			key;
+
+	/** Sends the packet, called with a token taken for it. Returns false if
+	 * no transfer was queued, the token is then given back */
+	bool			(*send)(struct t150_tx_source *source);
+	/** Called when the source is replaced by a newer one with the same key */
+	void			(*drop)(struct t150_tx_source *source);
+};
+
+/** Someone who sleeps until its turn, see t150_tx_wait */
+struct t150_tx_waiter
+{
+	struct t150_tx_source	source;
+	struct completion	turn;
+	int			errno;
+};
+
+struct t150_tx
+{
+	spinlock_t		lock;
+	struct hrtimer		timer;
+	/** One token is added every period */
+	ktime_t			period;
+	bool			running;
+	/** Set when the wheel goes away, nothing is sent anymore */
+	bool			dead;
+
+	unsigned		tokens;
+	struct t150_tx_queue	queues[T150_TX_CLASSES];
+	/** Classes held back, BIT(class) each, their sources wait in the queue */
+	unsigned		held;
+	/** Tokens given in a row to a higher class while a lower one was waiting */
+	unsigned		bypassed;
+
+	/** Sources in the queue, and the most there ever were */
+	u32			depth;
+	u32			depth_max;
+	/** Stale commands replaced before being sent */
+	atomic_t		dropped;
+	/** Sources made ready again while already queued */
+	atomic_t		merged;
+	/** Tokens given back by sends that had nothing to send */
+	atomic_t		refunded;
+};
+
+static int t150_init_tx(struct t150 *t150);
+static void t150_stop_tx(struct t150 *t150);
+static void t150_free_tx(struct t150 *t150);
+
+static bool t150_tx_acquire(struct t150 *t150, struct t150_tx_source *source,
+	enum t150_tx_class class);
+static void t150_tx_refund(struct t150 *t150, enum t150_tx_class class);
+static void t150_tx_hold(struct t150 *t150, enum t150_tx_class class, bool hold);
+static int t150_tx_wait(struct t150 *t150, struct t150_tx_waiter *waiter, enum t150_tx_class class);
+static enum hrtimer_restart t150_tx_tick(struct hrtimer *timer);
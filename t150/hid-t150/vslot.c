@@ -0,0 +1,699 @@
+module_param_named(ff_merge, t150_vslot_merge, bool, 0644);
+MODULE_PARM_DESC(ff_merge, "Play the springs and the dampers running at the same time "
+	"as a single effect per type (default: y)");
+
+module_param_named(ff_host_timing, t150_vslot_host_timing, bool, 0644);
+MODULE_PARM_DESC(ff_host_timing, "Start and stop the effects with a delay, a length or "
+	"repetitions from the host instead of the wheel (default: y)");
+
+/**
+ * Allocates the effect table of a wheel, all the device slots are free
+ * but the one of the mixer
+ * @param t150 ptr to t150
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int t150_init_vslot(struct t150 *t150)
+{
+	struct t150_vslot *vslot = kzalloc(sizeof(struct t150_vslot), GFP_KERNEL);
+	int i;
+
+	if(!vslot)
+		return -ENOMEM;
+
+	spin_lock_init(&vslot->lock);
+	vslot->t150 = t150;
+	vslot->merge = t150_vslot_merge;
+	vslot->host_timing = t150_vslot_host_timing;
+	t150_hrtimer_setup(&vslot->timer, t150_vslot_tick, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+
+	for(i = 0; i < T150_FF_DEVICE_SLOTS; i++)
+		vslot->owners[i] = T150_VSLOT_FREE;
+	for(i = 0; i < FF_MAX_EFFECTS; i++) {
+		vslot->effects[i].slot = T150_VSLOT_FREE;
+		vslot->effects[i].merged = T150_VSLOT_UNMERGED;
+	}
+	for(i = 0; i < T150_VSLOT_GROUPS; i++)
+		vslot->combined[i].slot = T150_VSLOT_FREE;
+
+	if(t150->mixer)
+		vslot->owners[T150_MIXER_SLOT] = T150_VSLOT_RESERVED;
+
+	t150->vslot = vslot;
+
+	return 0;
+}
+
+/**
+ * Frees the effect table. To be called when nobody posts anymore
+ * @param t150 ptr to t150
+ */
+static void t150_free_vslot(struct t150 *t150)
+{
+	unsigned long flags;
+
+	if(!t150->vslot)
+		return;
+
+	spin_lock_irqsave(&t150->vslot->lock, flags);
+	t150->vslot->dead = true;
+	spin_unlock_irqrestore(&t150->vslot->lock, flags);
+
+	hrtimer_cancel(&t150->vslot->timer);
+
+	kfree(t150->vslot);
+	t150->vslot = 0;
+}
+
+/**
+ * @param entry an effect
+ * @param now the current time
+ * @return true if the wheel may still be playing the effect
+ */
+static bool t150_vslot_busy(struct t150_vslot_effect *entry, ktime_t now)
+{
+	return entry->playing && ktime_before(now, entry->until);
+}
+
+/**
+ * The hash of an effect without its id, the same effect uploaded under
+ * another id has the same hash
+ * @param effect an effect
+ * @return the hash, never 0
+ */
+static u32 t150_vslot_hash(struct ff_effect *effect)
+{
+	struct ff_effect copy = *effect;
+
+	copy.id = 0;
+
+	return jhash(&copy, sizeof(struct ff_effect), 0) | 1;
+}
+
+/**
+ * Gives a device slot to an owner. A free slot that still holds the
+ * same effect is taken first, then any free slot, then, if allowed,
+ * the one of the least recently used effect that is not playing.
+ * To be called with vslot->lock held
+ * @param vslot the effect table
+ * @param owner the effect id without a slot, T150_VSLOT_MERGED or T150_VSLOT_RESERVED
+ * @param hash hash of the effect that goes on the slot, 0 if it changes over time
+ * @param evict true to evict an idle effect when no slot is free
+ * @return the device slot, -ENOSPC if there is none
+ */
+static int t150_vslot_map(struct t150_vslot *vslot, int owner, u32 hash, bool evict)
+{
+	struct t150_vslot_effect *entry;
+	ktime_t now = ktime_get();
+	int i, slot = -ENOSPC, free = -ENOSPC;
+	u64 oldest = U64_MAX;
+
+	for(i = 0; i < T150_FF_DEVICE_SLOTS; i++) {
+		if(vslot->owners[i] == T150_VSLOT_FREE) {
+			if(hash && vslot->hashes[i] == hash) {
+				atomic_inc(&vslot->reused);
+				free = i;
+				break;
+			}
+			if(free < 0)
+				free = i;
+			continue;
+		}
+
+		// The reserved slots and the combined conditions are never evicted
+		if(!evict || free >= 0 || vslot->owners[i] < 0)
+			continue;
+
+		entry = &vslot->effects[vslot->owners[i]];
+		if(!t150_vslot_busy(entry, now) && entry->used < oldest) {
+			oldest = entry->used;
+			slot = i;
+		}
+	}
+
+	if(free >= 0)
+		slot = free;
+
+	if(slot < 0)
+		return slot;
+
+	if(vslot->owners[slot] != T150_VSLOT_FREE) {
+		vslot->effects[vslot->owners[slot]].slot = T150_VSLOT_FREE;
+		atomic_inc(&vslot->evictions);
+	}
+
+	vslot->owners[slot] = owner;
+	vslot->hashes[slot] = hash;
+	if(owner >= 0)
+		vslot->effects[owner].slot = slot;
+
+	return slot;
+}
+
+/**
+ * @param vslot the effect table
+ * @param effect an effect
+ * @return true if the host starts and stops the effect
+ */
+static bool t150_vslot_timed(struct t150_vslot *vslot, struct ff_effect *effect)
+{
+	return vslot->host_timing && (effect->replay.delay || effect->replay.length);
+}
+
+/**
+ * Posts an effect on a device slot. An effect timed by the host
+ * reaches the wheel without delay and length, so it plays forever
+ * @param t150 ptr to t150
+ * @param slot the device slot
+ * @param effect the effect
+ * @return @see t150_ff_post
+ */
+static int t150_vslot_send(struct t150 *t150, int slot, struct ff_effect *effect)
+{
+	struct ff_effect device;
+
+	if(!t150_vslot_timed(t150->vslot, effect))
+		return t150_ff_post(t150, slot, effect);
+
+	device = *effect;
+	device.replay.delay = 0;
+	device.replay.length = 0;
+
+	return t150_ff_post(t150, slot, &device);
+}
+
+/**
+ * Arms the timer at the next start or stop of a timed replay.
+ * To be called with vslot->lock held
+ * @param vslot the effect table
+ */
+static void t150_vslot_arm(struct t150_vslot *vslot)
+{
+	ktime_t next = KTIME_MAX;
+	int i;
+
+	if(vslot->dead)
+		return;
+
+	for(i = 0; i < FF_MAX_EFFECTS; i++)
+		if(vslot->effects[i].remaining)
+			next = min_t(ktime_t, next, vslot->effects[i].next);
+
+	if(next != KTIME_MAX)
+		hrtimer_start(&vslot->timer, next, HRTIMER_MODE_ABS);
+}
+
+/**
+ * Starts and stops a timed effect for every instant of its replay that
+ * is due. A repetition plays for replay.length after replay.delay, the
+ * instants follow each other without drifting.
+ * To be called with vslot->lock held
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect, with a timed replay
+ * @param now the current time
+ */
+static void t150_vslot_advance(struct t150 *t150, int effect_id, ktime_t now)
+{
+	struct t150_vslot *vslot = t150->vslot;
+	struct t150_vslot_effect *entry = &vslot->effects[effect_id];
+	struct ff_replay *replay = &entry->effect.replay;
+	u64 late;
+
+	while(entry->remaining && !ktime_after(entry->next, now)) {
+		// Only an erase takes the slot of a timed effect, and it ends the replay
+		if(entry->slot < 0) {
+			entry->remaining = 0;
+			entry->playing = false;
+			break;
+		}
+
+		late = ktime_to_ns(ktime_sub(now, entry->next));
+		vslot->late_max_ns = max(vslot->late_max_ns, late);
+		atomic_inc(&vslot->timed);
+
+		if(!entry->on) {
+			t150_ff_send_play(t150, entry->slot, 1);
+			entry->on = true;
+			entry->next = replay->length ? ktime_add_ms(entry->next, replay->length) : KTIME_MAX;
+		} else {
+			t150_ff_send_play(t150, entry->slot, 0);
+			entry->on = false;
+			entry->next = ktime_add_ms(entry->next, replay->delay);
+			if(!--entry->remaining)
+				entry->playing = false;
+		}
+	}
+}
+
+/**
+ * Starts the timed replay of an effect: it's uploaded now, if it's not
+ * on the wheel, and started by the host after its delay.
+ * To be called with vslot->lock held
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect
+ * @param times how many times to play it
+ * @param was_playing true if the wheel may be playing it now
+ * @return 0 on success, -ENOSPC if all the device slots are playing
+ *	@see t150_ff_post for the other error codes
+ */
+static int t150_vslot_schedule(struct t150 *t150, int effect_id, int times, bool was_playing)
+{
+	struct t150_vslot *vslot = t150->vslot;
+	struct t150_vslot_effect *entry = &vslot->effects[effect_id];
+	ktime_t now = ktime_get();
+	int slot, errno;
+
+	if(entry->slot >= 0) {
+		atomic_inc(&vslot->hits);
+
+		// Played again, it waits stopped for its delay
+		if(was_playing && entry->effect.replay.delay)
+			t150_ff_send_play(t150, entry->slot, 0);
+	} else {
+		atomic_inc(&vslot->misses);
+
+		slot = t150_vslot_map(vslot, effect_id, t150_vslot_hash(&entry->effect), true);
+		if(slot < 0)
+			return slot;
+
+		errno = t150_vslot_send(t150, slot, &entry->effect);
+		if(errno)
+			return errno;
+	}
+
+	entry->remaining = times;
+	entry->on = false;
+	entry->next = ktime_add_ms(now, entry->effect.replay.delay);
+
+	t150_vslot_advance(t150, effect_id, now);
+	t150_vslot_arm(vslot);
+
+	return 0;
+}
+
+/**
+ * Timer of the timed replays, sends the starts and the stops that are due
+ */
+static enum hrtimer_restart t150_vslot_tick(struct hrtimer *timer)
+{
+	struct t150_vslot *vslot = container_of(timer, struct t150_vslot, timer);
+	unsigned long flags;
+	ktime_t now;
+	int i;
+
+	spin_lock_irqsave(&vslot->lock, flags);
+
+	now = ktime_get();
+	for(i = 0; i < FF_MAX_EFFECTS; i++)
+		if(vslot->effects[i].remaining)
+			t150_vslot_advance(vslot->t150, i, now);
+
+	// Armed again from here, a play may have armed it in the meantime
+	t150_vslot_arm(vslot);
+
+	spin_unlock_irqrestore(&vslot->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * Only conditions that play forever from the start can be summed,
+ * the combined effect has a single timing
+ * @param vslot the effect table
+ * @param effect an effect
+ * @return the group the effect can be folded in, -1 if none
+ */
+static int t150_vslot_group_of(struct t150_vslot *vslot, struct ff_effect *effect)
+{
+	if(!vslot->merge || effect->replay.length || effect->replay.delay)
+		return -1;
+
+	switch (effect->type) {
+	case FF_SPRING:
+		return T150_VSLOT_SPRING;
+	case FF_DAMPER:
+		return T150_VSLOT_DAMPER;
+	default:
+		return -1;
+	}
+}
+
+/**
+ * Sums the members of a group. Coefficients and saturations add up,
+ * the deadband is the narrowest one and the center is the point where
+ * the springs balance, the average of the centers weighted by the
+ * coefficients. To be called with vslot->lock held
+ * @param vslot the effect table
+ * @param combined the group, with at least one member
+ * @param sum where to store the combined effect
+ */
+static void t150_vslot_combine(struct t150_vslot *vslot, struct t150_vslot_combined *combined,
+	struct ff_effect *sum)
+{
+	struct ff_condition_effect *condition;
+	int32_t right_coeff = 0, left_coeff = 0, weight, weights = 0;
+	uint32_t right_sat = 0, left_sat = 0;
+	uint16_t deadband = U16_MAX;
+	s64 center = 0;
+	int id;
+
+	for_each_set_bit(id, combined->members, FF_MAX_EFFECTS) {
+		condition = &vslot->effects[id].effect.u.condition[0];
+
+		right_coeff += condition->right_coeff;
+		left_coeff += condition->left_coeff;
+		right_sat += condition->right_saturation;
+		left_sat += condition->left_saturation;
+		deadband = min(deadband, condition->deadband);
+
+		weight = abs(condition->right_coeff) + abs(condition->left_coeff);
+		center += (s64)condition->center * weight;
+		weights += weight;
+	}
+
+	// The rest of the effect comes from the first member
+	*sum = vslot->effects[find_first_bit(combined->members, FF_MAX_EFFECTS)].effect;
+	condition = &sum->u.condition[0];
+
+	condition->right_coeff = clamp_t(int32_t, right_coeff, -0x7fff, 0x7fff);
+	condition->left_coeff = clamp_t(int32_t, left_coeff, -0x7fff, 0x7fff);
+	condition->right_saturation = min_t(uint32_t, right_sat, U16_MAX);
+	condition->left_saturation = min_t(uint32_t, left_sat, U16_MAX);
+	condition->deadband = deadband;
+	if(weights)
+		condition->center = div_s64(center, weights);
+}
+
+/**
+ * Brings the slot of a group in line with its members: the sum is
+ * uploaded, only the packets that changed are sent, and the slot is started
+ * with the first member and stopped and given back after the last one.
+ * To be called with vslot->lock held
+ * @param t150 ptr to t150
+ * @param group the group
+ * @return 0 on success, -ENOSPC if there is no slot for the group
+ *	@see t150_ff_post for the other error codes
+ */
+static int t150_vslot_sync(struct t150 *t150, int group)
+{
+	struct t150_vslot *vslot = t150->vslot;
+	struct t150_vslot_combined *combined = &vslot->combined[group];
+	struct ff_effect sum;
+	int errno;
+
+	if(bitmap_empty(combined->members, FF_MAX_EFFECTS)) {
+		if(combined->slot < 0)
+			return 0;
+
+		errno = t150_ff_send_play(t150, combined->slot, 0);
+		vslot->owners[combined->slot] = T150_VSLOT_FREE;
+		combined->slot = T150_VSLOT_FREE;
+		return errno;
+	}
+
+	t150_vslot_combine(vslot, combined, &sum);
+
+	if(combined->slot >= 0) {
+		errno = t150_ff_post(t150, combined->slot, &sum);
+	} else {
+		errno = t150_vslot_map(vslot, T150_VSLOT_MERGED(group), 0, true);
+		if(errno < 0)
+			return errno;
+
+		combined->slot = errno;
+		atomic_inc(&vslot->merged_slots);
+
+		errno = t150_ff_post(t150, combined->slot, &sum);
+		if(!errno)
+			errno = t150_ff_post_play(t150, combined->slot, 1);
+	}
+
+	return errno;
+}
+
+/**
+ * Takes an effect out of its group. To be called with vslot->lock held
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect, folded in a group
+ * @return @see t150_vslot_sync
+ */
+static int t150_vslot_unmerge(struct t150 *t150, int effect_id)
+{
+	struct t150_vslot_effect *entry = &t150->vslot->effects[effect_id];
+	int group = entry->merged;
+
+	clear_bit(effect_id, t150->vslot->combined[group].members);
+	entry->merged = T150_VSLOT_UNMERGED;
+
+	return t150_vslot_sync(t150, group);
+}
+
+/**
+ * Uploads an effect. It's cached and, if it's on the wheel or a device
+ * slot is free, it's sent right away; otherwise it waits in the cache
+ * until it's played. A change to a condition folded in a group only
+ * uploads the new sum.
+ * @param t150 ptr to t150
+ * @param effect the new effect
+ * @return 0 on success @see t150_ff_post for error codes
+ */
+static int t150_vslot_post(struct t150 *t150, struct ff_effect *effect)
+{
+	struct t150_vslot *vslot = t150->vslot;
+	struct t150_vslot_effect *entry = &vslot->effects[effect->id];
+	u32 hash = t150_vslot_hash(effect);
+	bool replay = false;
+	unsigned long flags;
+	int errno = 0;
+
+	spin_lock_irqsave(&vslot->lock, flags);
+
+	entry->effect = *effect;
+	entry->valid = true;
+	entry->used = ++vslot->clock;
+
+	if(entry->merged != T150_VSLOT_UNMERGED) {
+		if(t150_vslot_group_of(vslot, effect) == entry->merged) {
+			errno = t150_vslot_sync(t150, entry->merged);
+			goto out;
+		}
+
+		// It got a timing of its own, it goes back to its own slot
+		t150_vslot_unmerge(t150, effect->id);
+		replay = entry->playing;
+		if(entry->slot < 0)
+			t150_vslot_map(vslot, effect->id, hash, true);
+	}
+
+	// A condition that can be folded does not need a slot of its own
+	if(entry->slot < 0 && t150_vslot_group_of(vslot, effect) < 0)
+		t150_vslot_map(vslot, effect->id, hash, false);
+
+	if(entry->slot >= 0) {
+		vslot->hashes[entry->slot] = hash;
+		errno = t150_vslot_send(t150, entry->slot, effect);
+		if(!errno && replay && t150_vslot_timed(vslot, effect))
+			errno = t150_vslot_schedule(t150, effect->id, entry->times, false);
+		else if(!errno && replay)
+			errno = t150_ff_post_play(t150, entry->slot, entry->times);
+	} else if(replay) {
+		entry->playing = false;
+		errno = -ENOSPC;
+	}
+
+out:	spin_unlock_irqrestore(&vslot->lock, flags);
+
+	return errno;
+}
+
+/**
+ * Plays or stops an effect. An effect that is not on the wheel is
+ * uploaded first, and the play request follows the upload in the
+ * mailbox of the slot. A condition that can be folded joins the sum
+ * of its group instead.
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect
+ * @param times how many times to play it, 0 to stop it
+ * @return 0 on success, -ENOSPC if all the device slots are playing
+ *	@see t150_ff_send_play for the other error codes
+ */
+static int t150_vslot_play(struct t150 *t150, int effect_id, int times)
+{
+	struct t150_vslot *vslot = t150->vslot;
+	struct t150_vslot_effect *entry = &vslot->effects[effect_id];
+	struct ff_replay *replay = &entry->effect.replay;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	int errno = 0, slot, group;
+	bool was_playing;
+
+	spin_lock_irqsave(&vslot->lock, flags);
+
+	was_playing = entry->playing;
+
+	// A new play or a stop ends the replay timed so far
+	entry->remaining = 0;
+	entry->on = false;
+
+	entry->playing = times;
+	entry->times = times;
+	if(times) {
+		entry->used = ++vslot->clock;
+		entry->until = replay->length ?
+			ktime_add_ms(now, (u64)(replay->delay + replay->length) * times) : KTIME_MAX;
+	}
+
+	group = times && entry->valid ? t150_vslot_group_of(vslot, &entry->effect) : -1;
+
+	if(entry->merged != T150_VSLOT_UNMERGED) {
+		if(entry->merged != group)
+			errno = t150_vslot_unmerge(t150, effect_id);
+		else
+			errno = t150_vslot_sync(t150, group);
+	} else if(group >= 0) {
+		// It may still be playing on its own slot
+		if(entry->slot >= 0 && was_playing)
+			t150_ff_send_play(t150, entry->slot, 0);
+
+		atomic_inc(&vslot->merged);
+		set_bit(effect_id, vslot->combined[group].members);
+		entry->merged = group;
+		errno = t150_vslot_sync(t150, group);
+	} else if(times && entry->valid && t150_vslot_timed(vslot, &entry->effect)) {
+		errno = t150_vslot_schedule(t150, effect_id, times, was_playing);
+	} else if(entry->slot >= 0) {
+		if(times)
+			atomic_inc(&vslot->hits);
+		errno = t150_ff_send_play(t150, entry->slot, times);
+	} else if(times && entry->valid) {
+		atomic_inc(&vslot->misses);
+
+		slot = t150_vslot_map(vslot, effect_id, t150_vslot_hash(&entry->effect), true);
+		if(slot < 0) {
+			errno = slot;
+		} else {
+			errno = t150_vslot_send(t150, slot, &entry->effect);
+			if(!errno)
+				errno = t150_ff_post_play(t150, slot, times);
+		}
+	}
+
+	if(errno == -ENOSPC)
+		entry->playing = false;
+
+	spin_unlock_irqrestore(&vslot->lock, flags);
+
+	if(errno == -ENOSPC)
+		hid_warn(t150->hid_device, "no device slot free to play effect %d\n", effect_id);
+
+	return errno;
+}
+
+/**
+ * Forgets an effect, because it was erased or because it's now played
+ * by the mixer. If it's still playing on the wheel it's stopped
+ * @param t150 ptr to t150
+ * @param effect_id id of the effect
+ */
+static void t150_vslot_release(struct t150 *t150, int effect_id)
+{
+	struct t150_vslot *vslot = t150->vslot;
+	struct t150_vslot_effect *entry = &vslot->effects[effect_id];
+	unsigned long flags;
+
+	spin_lock_irqsave(&vslot->lock, flags);
+
+	if(entry->merged != T150_VSLOT_UNMERGED)
+		t150_vslot_unmerge(t150, effect_id);
+
+	if(entry->slot >= 0) {
+		if(entry->playing)
+			t150_ff_send_play(t150, entry->slot, 0);
+		vslot->owners[entry->slot] = T150_VSLOT_FREE;
+		entry->slot = T150_VSLOT_FREE;
+	}
+
+	entry->valid = false;
+	entry->playing = false;
+	entry->remaining = 0;
+	entry->on = false;
+
+	spin_unlock_irqrestore(&vslot->lock, flags);
+}
+
+/**
+ * Takes a device slot out of the table, for whoever drives it directly.
+ * An idle effect is evicted if needed
+ * @param t150 ptr to t150
+ * @return the device slot, -ENOSPC if all of them are playing
+ */
+static int t150_vslot_reserve(struct t150 *t150)
+{
+	unsigned long flags;
+	int slot;
+
+	spin_lock_irqsave(&t150->vslot->lock, flags);
+	slot = t150_vslot_map(t150->vslot, T150_VSLOT_RESERVED, 0, true);
+	spin_unlock_irqrestore(&t150->vslot->lock, flags);
+
+	return slot;
+}
+
+/**
+ * Gives back a slot taken with t150_vslot_reserve
+ * @param t150 ptr to t150
+ * @param slot the device slot
+ */
+static void t150_vslot_unreserve(struct t150 *t150, int slot)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&t150->vslot->lock, flags);
+	t150->vslot->owners[slot] = T150_VSLOT_FREE;
+	spin_unlock_irqrestore(&t150->vslot->lock, flags);
+}
+
+/**
+ * Brings what the wheel plays in line with the table, after an input
+ * close that left the effects on the wheel or after the recovery of the
+ * endpoint. The effects still playing are started again and the slots
+ * nobody owns anymore are stopped; the reserved slots are left to
+ * whoever drives them
+ * @param t150 ptr to t150
+ * @param force true to stop every idle slot that holds an effect, when
+ * 	the state of the slots can't be trusted
+ */
+static void t150_vslot_replay(struct t150 *t150, bool force)
+{
+	struct t150_vslot *vslot = t150->vslot;
+	struct t150_vslot_effect *entry;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	int i, owner, times;
+	bool playing;
+
+	spin_lock_irqsave(&vslot->lock, flags);
+
+	for(i = 0; i < T150_FF_DEVICE_SLOTS; i++) {
+		owner = vslot->owners[i];
+		if(owner == T150_VSLOT_RESERVED)
+			continue;
+
+		times = 0;
+		if(owner >= 0) {
+			entry = &vslot->effects[owner];
+			if(entry->remaining)
+				times = entry->on;
+			else if(t150_vslot_busy(entry, now))
+				times = entry->times;
+		} else if(owner != T150_VSLOT_FREE) {
+			times = 1;
+		}
+
+		playing = force ? READ_ONCE(t150->ff_slots[i].state) != T150_FF_SLOT_EMPTY :
+			READ_ONCE(t150->ff_slots[i].state) == T150_FF_SLOT_PLAYING;
+		if(times || playing)
+			t150_ff_send_play(t150, i, times);
+	}
+
+	spin_unlock_irqrestore(&vslot->lock, flags);
+}
@@ -0,0 +1,119 @@
+/********************************************************************
+ *			 EFFECT SLOT VIRTUALIZATION
+ *
+ *     Games see FF_MAX_EFFECTS effect ids, the wheel only has
+ *   T150_FF_DEVICE_SLOTS slots. Every effect is cached here and
+ *   lives on a slot while it's in use; when they run out the
+ *  least recently used idle effect is evicted, and re-uploaded
+ *  from the cache when played again. Springs and dampers playing
+ *   at the same time are folded into a single slot per type. The
+ *   delay, the length and the repetitions of an effect are timed
+ *    by the host, the wheel only ever plays effects that last
+ *                         forever
+ *******************************************************************/
+
+/** Owner of a free device slot */
+#define T150_VSLOT_FREE			(-1)
+/** Owner of the device slot kept for the mixer */
+#define T150_VSLOT_RESERVED		(-2)
+/** Owner of the device slot of a combined condition */
+#define T150_VSLOT_MERGED(group)		(-3 - (group))
+/** Effect not folded in a combined condition */
+#define T150_VSLOT_UNMERGED		(-1)
+
+/** Conditions that can be folded together */
+enum t150_vslot_group
+{
+	T150_VSLOT_SPRING,
+	T150_VSLOT_DAMPER,
+	T150_VSLOT_GROUPS
+};
+
+/** Fold the conditions playing at the same time, set by the module parameter */
+static bool t150_vslot_merge = true;
+/** Time the replay of the effects on the host, set by the module parameter */
+static bool t150_vslot_host_timing = true;
+
+/** An effect as the game uploaded it */
+struct t150_vslot_effect
+{
+	/** The newest version, sent again if the effect is evicted */
+	struct ff_effect	effect;
+	/** false until the first upload and after the erase */
+	bool			valid;
+	/** Device slot holding the effect, T150_VSLOT_FREE if none */
+	int			slot;
+	/** Last play or upload, in ticks of t150_vslot->clock */
+	u64			used;
+	/** Play requested and not stopped, until the end of its replay */
+	bool			playing;
+	int			times;
+	ktime_t			until;
+	/** Combined condition the effect plays in, T150_VSLOT_UNMERGED if none */
+	int			merged;
+	/** Replay timed by the host: repetitions left, 0 if none, whether
+	 * the wheel is playing it and when it's next started or stopped */
+	int			remaining;
+	bool			on;
+	ktime_t			next;
+};
+
+/** Conditions of the same type playing together, summed in a single effect */
+struct t150_vslot_combined
+{
+	/** Device slot of the sum, T150_VSLOT_FREE while no member plays */
+	int			slot;
+	/** Bit n set if effect n is part of the sum */
+	unsigned long		members[BITS_TO_LONGS(FF_MAX_EFFECTS)];
+};
+
+struct t150_vslot
+{
+	struct t150		*t150;
+	spinlock_t		lock;
+	/** Advances at each play or upload, orders the effects for the LRU */
+	u64			clock;
+	/** Effect id held by each device slot, or T150_VSLOT_FREE/T150_VSLOT_RESERVED */
+	int			owners[T150_FF_DEVICE_SLOTS];
+	/** Hash of the effect last posted on each device slot, 0 if unknown.
+	 * It stays when the slot is given back, the wheel still has the effect */
+	u32			hashes[T150_FF_DEVICE_SLOTS];
+	struct t150_vslot_effect	effects[FF_MAX_EFFECTS];
+	/** Copy of t150_vslot_merge taken at probe */
+	bool			merge;
+	struct t150_vslot_combined combined[T150_VSLOT_GROUPS];
+	/** Copy of t150_vslot_host_timing taken at probe */
+	bool			host_timing;
+	/** Fires at the next start or stop of a timed replay */
+	struct hrtimer		timer;
+	/** true once the wheel is being removed, the timer is not armed anymore */
+	bool			dead;
+
+	/** Plays of an effect already on the wheel, of one that had to be
+	 * uploaded first and slots taken from an idle effect */
+	atomic_t		hits;
+	atomic_t		misses;
+	atomic_t		evictions;
+	/** Plays folded in a combined condition and combined conditions
+	 * started on a slot, their ratio is how many conditions share a slot */
+	atomic_t		merged;
+	atomic_t		merged_slots;
+	/** Free slots picked because they already held the same effect */
+	atomic_t		reused;
+	/** Starts and stops of timed replays, and the longest time one of
+	 * them was sent after its instant, in nanoseconds */
+	atomic_t		timed;
+	u64			late_max_ns;
+};
+
+static int t150_init_vslot(struct t150 *t150);
+static void t150_free_vslot(struct t150 *t150);
+
+static int t150_vslot_post(struct t150 *t150, struct ff_effect *effect);
+static int t150_vslot_play(struct t150 *t150, int effect_id, int times);
+static void t150_vslot_release(struct t150 *t150, int effect_id);
+static int t150_vslot_reserve(struct t150 *t150);
+static void t150_vslot_unreserve(struct t150 *t150, int slot);
+static void t150_vslot_replay(struct t150 *t150, bool force);
+
+static enum hrtimer_restart t150_vslot_tick(struct hrtimer *timer);
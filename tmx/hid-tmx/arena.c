@@ -0,0 +1,63 @@
+/**
+ * Allocates the arena of a wheel, zeroed
+ * @param tmx ptr to tmx
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int tmx_init_arena(struct tmx *tmx)
+{
+	struct tmx_arena *arena = kzalloc(sizeof(struct tmx_arena), GFP_KERNEL);
+
+	if(!arena)
+		return -ENOMEM;
+
+	arena->buffer = usb_alloc_coherent(tmx->usb_device, TMX_ARENA_SIZE, GFP_KERNEL, &arena->dma);
+	if(!arena->buffer) {
+		kfree(arena);
+		return -ENOMEM;
+	}
+
+	memset(arena->buffer, 0, TMX_ARENA_SIZE);
+	tmx->arena = arena;
+
+	return 0;
+}
+
+/**
+ * Frees the arena. To be called after all its URBs were killed
+ * @param tmx ptr to tmx
+ */
+static void tmx_free_arena(struct tmx *tmx)
+{
+	if(!tmx->arena)
+		return;
+
+	usb_free_coherent(tmx->usb_device, TMX_ARENA_SIZE, tmx->arena->buffer, tmx->arena->dma);
+	kfree(tmx->arena);
+	tmx->arena = 0;
+}
+
+/**
+ * Gives an URB its buffer, taken from the arena. The URB is submitted
+ * with the DMA address of the buffer, nothing is mapped at submit time.
+ * Buffers are never given back, only the whole arena is freed
+ * @param tmx ptr to tmx
+ * @param urb the URB, already filled
+ * @param size size of the buffer
+ * @return 0 on success, -ENOMEM if the arena is full
+ */
+static int tmx_arena_bind(struct tmx *tmx, struct urb *urb, size_t size)
+{
+	struct tmx_arena *arena = tmx->arena;
+
+	if(arena->used + size > TMX_ARENA_SIZE)
+		return -ENOMEM;
+
+	urb->transfer_buffer = (uint8_t *)arena->buffer + arena->used;
+	urb->transfer_dma = arena->dma + arena->used;
+	urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+
+	// The next buffer starts on a new cache line
+	arena->used += L1_CACHE_ALIGN(size);
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+/********************************************************************
+ *			     BUFFER ARENA
+ *
+ *     The buffers of every URB that goes to the OUT endpoint,
+ *   and of the IN URB of the driver, are carved from a single
+ *   DMA-coherent block per wheel, each on its own cache lines,
+ *           so submits skip the DMA mapping
+ *******************************************************************/
+
+/** Room for the buffers of the URB pool, of the effect slots and of the IN URB */
+#define TMX_ARENA_SIZE \
+	(TMX_POOL_SIZE * L1_CACHE_ALIGN(TMX_POOL_BUFFER_SIZE) + \
+	TMX_FF_DEVICE_SLOTS * L1_CACHE_ALIGN(TMX_FF_SLOT_BUFFER_SIZE) + \
+	L1_CACHE_ALIGN(TMX_INPUT_BUFFER_SIZE))
+
+struct tmx_arena
+{
+	void		*buffer;
+	dma_addr_t	dma;
+	/** Bytes already given to an URB */
+	size_t		used;
+};
+
+static int tmx_init_arena(struct tmx *tmx);
+static void tmx_free_arena(struct tmx *tmx);
+
+static int tmx_arena_bind(struct tmx *tmx, struct urb *urb, size_t size);
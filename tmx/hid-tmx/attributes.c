@@ -1,10 +1,6 @@
 static inline int tmx_init_attributes(struct tmx *tmx)
 {
-	int errno;
-
-	// Before making avaible the syfs attrbiutes we try to set them to some default
-	// @FIXME I do not know if it is desiradable to wait for URBs in probe() method...
-	tmx_setup_task(tmx);
+	int errno, i;
 
 	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_autocenter);
 	if(errno)
@@ -26,9 +22,67 @@ static inline int tmx_init_attributes(struct tmx *tmx)
 	if(errno)
 		goto err4;
 
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_ff_coalesce);
+	if(errno)
+		goto err5;
+
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_settings_wait);
+	if(errno)
+		goto err6;
+
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_ff_reconstruct);
+	if(errno)
+		goto err7;
+
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_ff_latency_us);
+	if(errno)
+		goto err8;
+
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_ff_slew);
+	if(errno)
+		goto err9;
+
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_ff_persist);
+	if(errno)
+		goto err10;
+
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_poll_interval);
+	if(errno)
+		goto err11;
+
+	errno = device_create_file(&tmx->usb_device->dev, &dev_attr_report_rate);
+	if(errno)
+		goto err12;
+
+	for(i = 0; i < TMX_AXES; i++) {
+		errno = device_create_bin_file(&tmx->usb_device->dev, &tmx_bin_attr_lut[i]);
+		if(errno)
+			goto err13;
+	}
+
+	for(i = 0; i < TMX_AXES; i++) {
+		errno = device_create_file(&tmx->usb_device->dev, &tmx_dev_attr_filter[i]);
+		if(errno)
+			goto err14;
+	}
+
 	return 0;
 
-err4:	device_remove_file(&tmx->usb_device->dev, &dev_attr_firmware_version);
+err14:	while(i--)
+		device_remove_file(&tmx->usb_device->dev, &tmx_dev_attr_filter[i]);
+	i = TMX_AXES;
+err13:	while(i--)
+		device_remove_bin_file(&tmx->usb_device->dev, &tmx_bin_attr_lut[i]);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_report_rate);
+err12:	device_remove_file(&tmx->usb_device->dev, &dev_attr_poll_interval);
+err11:	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_persist);
+err10:	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_slew);
+err9:	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_latency_us);
+err8:	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_reconstruct);
+err7:	device_remove_file(&tmx->usb_device->dev, &dev_attr_settings_wait);
+err6:	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_coalesce);
+err5:	device_remove_file(&tmx->usb_device->dev, &dev_attr_firmware_version);
+err4:	device_remove_file(&tmx->usb_device->dev, &dev_attr_gain);
 err3:	device_remove_file(&tmx->usb_device->dev, &dev_attr_range);
 err2:	device_remove_file(&tmx->usb_device->dev, &dev_attr_enable_autocenter);
 err1:	device_remove_file(&tmx->usb_device->dev, &dev_attr_autocenter);
@@ -37,11 +91,26 @@ err1:	device_remove_file(&tmx->usb_device->dev, &dev_attr_autocenter);
 
 static inline void tmx_free_attributes(struct tmx *tmx)
 {
+	int i;
+
 	device_remove_file(&tmx->usb_device->dev, &dev_attr_autocenter);
 	device_remove_file(&tmx->usb_device->dev, &dev_attr_enable_autocenter);
 	device_remove_file(&tmx->usb_device->dev, &dev_attr_range);
 	device_remove_file(&tmx->usb_device->dev, &dev_attr_gain);
 	device_remove_file(&tmx->usb_device->dev, &dev_attr_firmware_version);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_coalesce);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_settings_wait);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_reconstruct);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_latency_us);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_slew);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_ff_persist);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_poll_interval);
+	device_remove_file(&tmx->usb_device->dev, &dev_attr_report_rate);
+
+	for(i = 0; i < TMX_AXES; i++) {
+		device_remove_bin_file(&tmx->usb_device->dev, &tmx_bin_attr_lut[i]);
+		device_remove_file(&tmx->usb_device->dev, &tmx_dev_attr_filter[i]);
+	}
 }
 
 /**/
@@ -50,6 +119,7 @@ static ssize_t tmx_store_return_force(struct device *dev, struct device_attribut
 {
 	uint8_t nforce;
 	struct tmx *tmx = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
 	if(kstrtou8(buf, 10, &nforce))
@@ -58,9 +128,9 @@ static ssize_t tmx_store_return_force(struct device *dev, struct device_attribut
 	if(nforce > 100)
 		nforce = 100;
 
-	tmx_set_autocenter(tmx, nforce);
+	errno = tmx_set_autocenter(tmx, nforce, READ_ONCE(tmx->settings_wait) ? TMX_SETTINGS_WAIT : TMX_SETTINGS_ASYNC);
 
-	return count;
+	return errno ? errno : count;
 }
 
 static ssize_t tmx_show_return_force(struct device *dev, struct device_attribute *attr,char * buf )
@@ -70,7 +140,10 @@ static ssize_t tmx_show_return_force(struct device *dev, struct device_attribute
 	unsigned long flags;
 
 	spin_lock_irqsave(&tmx->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", tmx->settings.autocenter_force);
+	if(!tmx->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", tmx->settings.autocenter_force);
 	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
 
 	return len;
@@ -81,12 +154,15 @@ static ssize_t tmx_store_simulate_return_force(struct device *dev, struct device
 {
 	bool use;
 	struct tmx *tmx = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
-	if(!kstrtobool(buf, &use))
-		tmx_set_enable_autocenter(tmx, use);	
+	if(kstrtobool(buf, &use))
+		return count;
 
-	return count;
+	errno = tmx_set_enable_autocenter(tmx, use, READ_ONCE(tmx->settings_wait) ? TMX_SETTINGS_WAIT : TMX_SETTINGS_ASYNC);
+
+	return errno ? errno : count;
 }
 
 static ssize_t tmx_show_simulate_return_force(struct device *dev, struct device_attribute *attr,char * buf)
@@ -96,7 +172,10 @@ static ssize_t tmx_show_simulate_return_force(struct device *dev, struct device_
 	unsigned long flags;
 
 	spin_lock_irqsave(&tmx->settings.access_lock, flags);
-	len = sprintf(buf, "%c\n", tmx->settings.autocenter_enabled ? 'y' : 'n');
+	if(!tmx->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%c\n", tmx->settings.autocenter_enabled ? 'y' : 'n');
 	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
 
 	return len;
@@ -107,6 +186,7 @@ static ssize_t tmx_store_range(struct device *dev, struct device_attribute *attr
 {
 	uint16_t range;
 	struct tmx *tmx = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
 	if(kstrtou16(buf, 10, &range))
@@ -120,9 +200,9 @@ static ssize_t tmx_store_range(struct device *dev, struct device_attribute *attr
 
 	range = DIV_ROUND_CLOSEST((range * 0xffff), 900);
 
-	tmx_set_range(tmx, range);
+	errno = tmx_set_range(tmx, range, READ_ONCE(tmx->settings_wait) ? TMX_SETTINGS_WAIT : TMX_SETTINGS_ASYNC);
 
-	return count;
+	return errno ? errno : count;
 }
 
 static ssize_t tmx_show_range(struct device *dev, struct device_attribute *attr,char * buf )
@@ -132,7 +212,10 @@ static ssize_t tmx_show_range(struct device *dev, struct device_attribute *attr,
 	unsigned long flags;
 
 	spin_lock_irqsave(&tmx->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(tmx->settings.range * 900, 0xffff));
+	if(!tmx->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(tmx->settings.range * 900, 0xffff));
 	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
 
 	return len;
@@ -143,6 +226,7 @@ static ssize_t tmx_store_ffb_intensity(struct device *dev, struct device_attribu
 {
 	uint8_t nforce;
 	struct tmx *tmx = dev_get_drvdata(dev);
+	int errno;
 
 	// If mallformed input leave...
 	if(kstrtou8(buf, 10, &nforce))
@@ -153,8 +237,8 @@ static ssize_t tmx_store_ffb_intensity(struct device *dev, struct device_attribu
 
 	nforce = DIV_ROUND_CLOSEST(nforce * 0x80, 100);
 
-	tmx_set_gain(tmx, nforce);
-	return count;
+	errno = tmx_set_gain(tmx, nforce, READ_ONCE(tmx->settings_wait) ? TMX_SETTINGS_WAIT : TMX_SETTINGS_ASYNC);
+	return errno ? errno : count;
 }
 
 static ssize_t tmx_show_ffb_intensity(struct device *dev, struct device_attribute *attr,char * buf )
@@ -164,7 +248,10 @@ static ssize_t tmx_show_ffb_intensity(struct device *dev, struct device_attribut
 	unsigned long flags;
 
 	spin_lock_irqsave(&tmx->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(tmx->settings.gain * 100, 0x80));
+	if(!tmx->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", DIV_ROUND_CLOSEST(tmx->settings.gain * 100, 0x80));
 	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
 
 	return len;
@@ -177,8 +264,216 @@ ssize_t tmx_show_fw_version(struct device *dev, struct device_attribute *attr,ch
 	unsigned long flags;
 
 	spin_lock_irqsave(&tmx->settings.access_lock, flags);
-	len = sprintf(buf, "%d\n", tmx->settings.firmware_version);
+	if(!tmx->settings.setup_done)
+		len = sprintf(buf, "pending\n");
+	else
+		len = sprintf(buf, "%d\n", tmx->settings.firmware_version);
 	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
 
 	return len;
 }
+
+static ssize_t tmx_store_settings_wait(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	bool wait;
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtobool(buf, &wait))
+		WRITE_ONCE(tmx->settings_wait, wait);
+
+	return count;
+}
+
+static ssize_t tmx_show_settings_wait(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%c\n", READ_ONCE(tmx->settings_wait) ? 'y' : 'n');
+}
+
+static ssize_t tmx_store_ff_coalesce(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	bool use;
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtobool(buf, &use))
+		WRITE_ONCE(tmx->ff_coalesce, use);
+
+	return count;
+}
+
+static ssize_t tmx_show_ff_coalesce(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%c\n", READ_ONCE(tmx->ff_coalesce) ? 'y' : 'n');
+}
+
+static ssize_t tmx_store_ff_reconstruct(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+	int mode = sysfs_match_string(tmx_recon_mode_names, buf);
+
+	if(mode < 0)
+		return mode;
+
+	WRITE_ONCE(tmx->recon->mode, mode);
+
+	return count;
+}
+
+static ssize_t tmx_show_ff_reconstruct(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", tmx_recon_mode_names[READ_ONCE(tmx->recon->mode)]);
+}
+
+static ssize_t tmx_store_ff_latency(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	uint32_t latency;
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtou32(buf, 10, &latency))
+		WRITE_ONCE(tmx->recon->latency_us, latency);
+
+	return count;
+}
+
+static ssize_t tmx_show_ff_latency(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(tmx->recon->latency_us));
+}
+
+static ssize_t tmx_store_ff_slew(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	uint16_t slew;
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtou16(buf, 10, &slew) && slew)
+		WRITE_ONCE(tmx->recon->slew, slew);
+
+	return count;
+}
+
+static ssize_t tmx_show_ff_slew(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(tmx->recon->slew));
+}
+
+static ssize_t tmx_store_ff_persist(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	bool use;
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	// If mallformed input leave...
+	if(!kstrtobool(buf, &use))
+		WRITE_ONCE(tmx->ff_persist, use);
+
+	return count;
+}
+
+static ssize_t tmx_show_ff_persist(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%c\n", READ_ONCE(tmx->ff_persist) ? 'y' : 'n');
+}
+
+static ssize_t tmx_store_poll_interval(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	uint8_t interval;
+	struct tmx *tmx = dev_get_drvdata(dev);
+	int errno;
+
+	// If mallformed input leave...
+	if(kstrtou8(buf, 10, &interval))
+		return count;
+
+	errno = tmx_input_set_poll(tmx, interval);
+
+	return errno ? errno : count;
+}
+
+static ssize_t tmx_show_poll_interval(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(tmx->poll_interval));
+}
+
+static ssize_t tmx_show_report_rate(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(tmx->input_stats->rate));
+}
+
+static ssize_t tmx_store_lut(struct file *file, struct kobject *kobj, tmx_bin_attribute *attr,
+	char *buf, loff_t off, size_t count)
+{
+	struct tmx *tmx = dev_get_drvdata(kobj_to_dev(kobj));
+	int errno;
+
+	// The table is taken in a single write
+	if(off)
+		return -EINVAL;
+
+	errno = tmx_axis_lut_store(tmx, attr - tmx_bin_attr_lut, buf, count);
+
+	return errno ? errno : count;
+}
+
+static ssize_t tmx_show_lut(struct file *file, struct kobject *kobj, tmx_bin_attribute *attr,
+	char *buf, loff_t off, size_t count)
+{
+	struct tmx *tmx = dev_get_drvdata(kobj_to_dev(kobj));
+
+	return tmx_axis_lut_show(tmx, attr - tmx_bin_attr_lut, buf, off, count);
+}
+
+static ssize_t tmx_store_filter(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+	char name[16];
+	u32 first = 0, second = 0;
+	int type, errno;
+
+	// If mallformed input leave...
+	if(sscanf(buf, "%15s %u %u", name, &first, &second) < 1)
+		return count;
+
+	for(type = 0; type < TMX_AXIS_FILTER_TYPES; type++)
+		if(sysfs_streq(name, tmx_axis_filter_names[type]))
+			break;
+
+	if(type == TMX_AXIS_FILTER_TYPES)
+		return count;
+
+	errno = tmx_axis_filter_store(tmx, attr - tmx_dev_attr_filter, type, first, second);
+
+	return errno ? errno : count;
+}
+
+static ssize_t tmx_show_filter(struct device *dev, struct device_attribute *attr,char * buf )
+{
+	struct tmx *tmx = dev_get_drvdata(dev);
+
+	return tmx_axis_filter_show(tmx, attr - tmx_dev_attr_filter, buf);
+}
@@ -23,6 +23,35 @@ static ssize_t tmx_store_ffb_intensity(struct device *dev, struct device_attribu
 	const char *buf, size_t count);
 static ssize_t tmx_show_ffb_intensity(struct device *dev, struct device_attribute *attr,char * buf );
 static ssize_t tmx_show_fw_version(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_settings_wait(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_settings_wait(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_ff_coalesce(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_ff_coalesce(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_ff_reconstruct(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_ff_reconstruct(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_ff_latency(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_ff_latency(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_ff_slew(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_ff_slew(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_ff_persist(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_ff_persist(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_poll_interval(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_poll_interval(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_show_report_rate(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_filter(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count);
+static ssize_t tmx_show_filter(struct device *dev, struct device_attribute *attr,char * buf );
+static ssize_t tmx_store_lut(struct file *file, struct kobject *kobj, tmx_bin_attribute *attr,
+	char *buf, loff_t off, size_t count);
+static ssize_t tmx_show_lut(struct file *file, struct kobject *kobj, tmx_bin_attribute *attr,
+	char *buf, loff_t off, size_t count);
 
 
 /** Attribute used to set how much strong is the simulated "spring" that makes
@@ -46,4 +75,102 @@ static DEVICE_ATTR(gain, 0664, tmx_show_ffb_intensity, tmx_store_ffb_intensity);
 
 /**
  * Read-only, returns the current firmware version of the Wheel*/
-static DEVICE_ATTR(firmware_version, 0444, tmx_show_fw_version, 0);
\ No newline at end of file
+static DEVICE_ATTR(firmware_version, 0444, tmx_show_fw_version, 0);
+
+/**
+ * Attribute used to make the writes of the other attributes wait for the wheel
+ * to ack the new setting, and fail if the wheel does not. By default the writes
+ * return immediately and the new value is shown once the wheel accepted it.
+ * Input is a boolean value*/
+static DEVICE_ATTR(settings_wait, 0664, tmx_show_settings_wait, tmx_store_settings_wait);
+
+/**
+ * Attribute used to send the three packets of a new effect as a single transfer.
+ * If the wheel refuses such a transfer the driver goes back to three transfers
+ * and the attribute reads n again.
+ * Input is a boolean value*/
+static DEVICE_ATTR(ff_coalesce, 0664, tmx_show_ff_coalesce, tmx_store_ff_coalesce);
+
+/**
+ * Attribute used to smooth the level changes of constant effects: off, linear,
+ * cubic or slew. The new level is reached over the next output intervals.
+ * Input is one of the names above*/
+static DEVICE_ATTR(ff_reconstruct, 0664, tmx_show_ff_reconstruct, tmx_store_ff_reconstruct);
+
+/**
+ * Attribute used to set the longest time, in microseconds, the reconstruction
+ * can take to reach a new level. One more output interval is always added.
+ * Input is a decimal value*/
+static DEVICE_ATTR(ff_latency_us, 0664, tmx_show_ff_latency, tmx_store_ff_latency);
+
+/**
+ * Attribute used to set how fast the slew reconstruction moves the level,
+ * in units of ff_constant_effect.level per millisecond.
+ * Input is a decimal value between 1 and 65535*/
+static DEVICE_ATTR(ff_slew, 0664, tmx_show_ff_slew, tmx_store_ff_slew);
+
+/**
+ * Attribute used to keep the effects on the wheel when the input is closed.
+ * The next open only restores what is playing, and an identical effect
+ * uploaded again lands on the slot that still holds it, without packets.
+ * Input is a boolean value*/
+static DEVICE_ATTR(ff_persist, 0664, tmx_show_ff_persist, tmx_store_ff_persist);
+
+/**
+ * Attribute used to set how often the wheel is polled, in milliseconds. An open
+ * input switches to the new interval right away. 0 leaves the polling to usbhid
+ * at the interval of the endpoint.
+ * The host controller has the last word: xHCI polls at the interval of the
+ * endpoint descriptor whatever is asked, so there this changes nothing. The
+ * interval granted is in the input_timing debugfs file and in the log.
+ * Opening hidraw makes usbhid poll too; once the driver sees that it leaves
+ * the polling to usbhid until the input is closed.
+ * Input is a decimal value between 0 and 255*/
+static DEVICE_ATTR(poll_interval, 0664, tmx_show_poll_interval, tmx_store_poll_interval);
+
+/**
+ * Read-only, returns how many input reports the wheel sent in the last second*/
+static DEVICE_ATTR(report_rate, 0444, tmx_show_report_rate, 0);
+
+/**
+ * Binary attributes with the table of each axis: 1025 little endian u16, the
+ * value reported for the minimum of the axis first and for the maximum last,
+ * the values in between are interpolated. They give the deadzone, the curve
+ * and the calibration. A write shorter than a table removes it, the axis
+ * reports what the wheel sends. Reading gives the table back, nothing if
+ * there is none*/
+#define TMX_LUT_ATTR(_axis, _name) \
+	[_axis] = { \
+		.attr = { .name = _name, .mode = 0664 }, \
+		.size = TMX_AXIS_LUT_SIZE, \
+		.read = tmx_show_lut, \
+		.write = tmx_store_lut, \
+	}
+
+static struct bin_attribute tmx_bin_attr_lut[TMX_AXES] = {
+	TMX_LUT_ATTR(TMX_AXIS_X, "lut_x"),
+	TMX_LUT_ATTR(TMX_AXIS_Y, "lut_y"),
+	TMX_LUT_ATTR(TMX_AXIS_RZ, "lut_rz"),
+	TMX_LUT_ATTR(TMX_AXIS_THROTTLE, "lut_throttle"),
+};
+
+/**
+ * Attributes with the filter of each axis, applied before the table:
+ *   none                    the axis is not filtered
+ *   iir <alpha>             one pole low pass, a new report weights alpha/256,
+ *                           1 to 256. The delay is about 256/alpha - 1 reports
+ *   median3                 median of the last three reports, removes spikes
+ *                           of one report at the cost of one report of delay
+ *   euro <cutoff> <beta>    1 euro filter: a low pass at cutoff mHz at rest
+ *                           that rises by beta mHz for each unit/s of speed,
+ *                           smooth at rest and with little lag when moving
+ * With no filter on any axis the reports do not pay for them*/
+#define TMX_FILTER_ATTR(_axis, _name) \
+	[_axis] = __ATTR(_name, 0664, tmx_show_filter, tmx_store_filter)
+
+static struct device_attribute tmx_dev_attr_filter[TMX_AXES] = {
+	TMX_FILTER_ATTR(TMX_AXIS_X, filter_x),
+	TMX_FILTER_ATTR(TMX_AXIS_Y, filter_y),
+	TMX_FILTER_ATTR(TMX_AXIS_RZ, filter_rz),
+	TMX_FILTER_ATTR(TMX_AXIS_THROTTLE, filter_throttle),
+};
@@ -0,0 +1,107 @@
+/** Prints the buckets of a histogram that are not empty */
+static void tmx_debugfs_hist(struct seq_file *file, const char *name, u32 *hist)
+{
+	int i;
+
+	for(i = 0; i < TMX_INPUT_HIST_BUCKETS; i++) {
+		if(!hist[i])
+			continue;
+
+		if(i < TMX_INPUT_HIST_BUCKETS - 1)
+			seq_printf(file, "%s < %lu us: %u\n", name, BIT(i), hist[i]);
+		else
+			seq_printf(file, "%s >= %lu us: %u\n", name, BIT(i - 1), hist[i]);
+	}
+}
+
+/** Timing of the input reports */
+static int tmx_debugfs_input_show(struct seq_file *file, void *data)
+{
+	struct tmx *tmx = file->private;
+	struct tmx_input_stats *stats = tmx->input_stats;
+
+	seq_printf(file, "interval asked %u ms, polled at %u ms by %s\n",
+		READ_ONCE(tmx->polling) ? tmx->poll_interval : tmx->bInterval_in,
+		tmx_input_period_ms(tmx), READ_ONCE(tmx->polling) ? "the driver" : "usbhid");
+	seq_printf(file, "reports %llu\n", stats->reports);
+	seq_printf(file, "rate %u Hz\n", READ_ONCE(stats->rate));
+	seq_printf(file, "slow seconds %u\n", stats->slow);
+	seq_printf(file, "interval max %llu us\n", stats->interval_max_us);
+	tmx_debugfs_hist(file, "interval", stats->interval);
+	seq_printf(file, "jitter max %llu us\n", stats->jitter_max_us);
+	tmx_debugfs_hist(file, "jitter", stats->jitter);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tmx_debugfs_input);
+
+/**
+ * Creates the debugfs directory of a wheel. Failures are not fatal,
+ * debugfs is just a debugging aid
+ * @param tmx the wheel
+ */
+static inline void tmx_init_debugfs(struct tmx *tmx)
+{
+	struct dentry *dir;
+	int i;
+
+	tmx->debugfs = debugfs_create_dir(dev_name(&tmx->hid_device->dev), tmx_debugfs_root);
+
+	debugfs_create_atomic_t("pool_exhausted", 0444, tmx->debugfs, &tmx->urb_pool->exhausted);
+	debugfs_create_atomic_t("input_vendor", 0444, tmx->debugfs, &tmx->input_vendor);
+	debugfs_create_atomic_t("input_unknown", 0444, tmx->debugfs, &tmx->input_unknown);
+	debugfs_create_file("input_timing", 0444, tmx->debugfs, tmx, &tmx_debugfs_input_fops);
+	debugfs_create_atomic_t("ff_coalesced", 0444, tmx->debugfs, &tmx->ff_coalesced);
+	debugfs_create_atomic_t("ff_uploads", 0444, tmx->debugfs, &tmx->ff_uploads);
+	debugfs_create_atomic_t("ff_upload_failures", 0444, tmx->debugfs, &tmx->ff_upload_failures);
+	debugfs_create_atomic_t("ff_upload_retries", 0444, tmx->debugfs, &tmx->ff_upload_retries);
+	debugfs_create_u32("tx_depth", 0444, tmx->debugfs, &tmx->tx->depth);
+	debugfs_create_u32("tx_depth_max", 0444, tmx->debugfs, &tmx->tx->depth_max);
+	debugfs_create_atomic_t("tx_dropped", 0444, tmx->debugfs, &tmx->tx->dropped);
+	debugfs_create_atomic_t("tx_merged", 0444, tmx->debugfs, &tmx->tx->merged);
+	debugfs_create_atomic_t("tx_refunded", 0444, tmx->debugfs, &tmx->tx->refunded);
+
+	for(i = 0; i < TMX_TX_CLASSES; i++) {
+		dir = debugfs_create_dir(tmx_tx_class_names[i], tmx->debugfs);
+		debugfs_create_u64("sent", 0444, dir, &tmx->tx->queues[i].sent);
+		debugfs_create_u64("latency_total_us", 0444, dir, &tmx->tx->queues[i].latency_total_us);
+		debugfs_create_u64("latency_max_us", 0444, dir, &tmx->tx->queues[i].latency_max_us);
+	}
+	debugfs_create_u64("setup_time_us", 0444, tmx->debugfs, &tmx->setup_time_us);
+
+	debugfs_create_atomic_t("recoveries", 0444, tmx->debugfs, &tmx->recovery->recoveries);
+	debugfs_create_atomic_t("recovery_failures", 0444, tmx->debugfs, &tmx->recovery->failures);
+	debugfs_create_atomic_t("recovery_errors", 0444, tmx->debugfs, &tmx->recovery->errors);
+	debugfs_create_u64("recovery_last_us", 0444, tmx->debugfs, &tmx->recovery->last_us);
+	debugfs_create_u64("recovery_max_us", 0444, tmx->debugfs, &tmx->recovery->max_us);
+	// Writing 32 makes the next successful transfer fail with -EPIPE
+	debugfs_create_atomic_t("recovery_inject", 0644, tmx->debugfs, &tmx->recovery->inject);
+
+	debugfs_create_atomic_t("vslot_hits", 0444, tmx->debugfs, &tmx->vslot->hits);
+	debugfs_create_atomic_t("vslot_misses", 0444, tmx->debugfs, &tmx->vslot->misses);
+	debugfs_create_atomic_t("vslot_evictions", 0444, tmx->debugfs, &tmx->vslot->evictions);
+	debugfs_create_atomic_t("vslot_merged", 0444, tmx->debugfs, &tmx->vslot->merged);
+	debugfs_create_atomic_t("vslot_merged_slots", 0444, tmx->debugfs, &tmx->vslot->merged_slots);
+	debugfs_create_atomic_t("vslot_reused", 0444, tmx->debugfs, &tmx->vslot->reused);
+	debugfs_create_atomic_t("vslot_timed", 0444, tmx->debugfs, &tmx->vslot->timed);
+	debugfs_create_u64("vslot_late_max_ns", 0444, tmx->debugfs, &tmx->vslot->late_max_ns);
+
+	debugfs_create_atomic_t("recon_emitted", 0444, tmx->debugfs, &tmx->recon->emitted);
+	debugfs_create_atomic_t("recon_skipped", 0444, tmx->debugfs, &tmx->recon->skipped);
+
+	debugfs_create_atomic_t("torque_underruns", 0444, tmx->debugfs, &tmx->torque->underruns);
+	debugfs_create_atomic_t("torque_overruns", 0444, tmx->debugfs, &tmx->torque->overruns);
+	debugfs_create_atomic_t("torque_stalls", 0444, tmx->debugfs, &tmx->torque->stalls);
+
+	if(tmx->mixer) {
+		debugfs_create_atomic_t("mixer_ticks", 0444, tmx->debugfs, &tmx->mixer->ticks);
+		debugfs_create_atomic_t("mixer_updates", 0444, tmx->debugfs, &tmx->mixer->updates);
+		debugfs_create_atomic_t("mixer_loops", 0444, tmx->debugfs, &tmx->mixer->loops);
+	}
+}
+
+static inline void tmx_free_debugfs(struct tmx *tmx)
+{
+	debugfs_remove_recursive(tmx->debugfs);
+	tmx->debugfs = 0;
+}
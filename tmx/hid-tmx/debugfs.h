@@ -0,0 +1,12 @@
+/********************************************************************
+ *			      DEBUGFS STUFF
+ *
+ *      Counters about the driver internals, they are placed
+ *         in /sys/kernel/debug/hid-tmx/<hid device name>/
+ *******************************************************************/
+
+/** Root directory shared by all the wheels, created when the module is loaded */
+static struct dentry *tmx_debugfs_root = 0;
+
+static inline void tmx_init_debugfs(struct tmx *tmx);
+static inline void tmx_free_debugfs(struct tmx *tmx);
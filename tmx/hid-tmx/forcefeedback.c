@@ -1,45 +1,354 @@
-/** Callback to free urb when a ffb request is completed */
-static void tmx_ff_free_urb(struct urb *urb) 
-{
-	//struct tmx *tmx = urb->context;
-	kfree(urb->transfer_buffer);
-	usb_free_urb(urb);
-}
-
 /**
- * Creates an usb URB to be sent to wheel for ffb operations
+ * Creates an usb URB to be sent to wheel for ffb operations, its
+ * buffer comes from the arena
  * @param tmx the wheel
  * @param buffer_size how large alloc the urb
+ * @param complete the completion handler
+ * @param context the context of the completion handler
  * @returns a ptr to URB if no error, 0 otherwise
  */
-static struct urb* tmx_ff_alloc_urb(struct tmx *tmx, const size_t buffer_size)
+static struct urb* tmx_ff_alloc_urb(struct tmx *tmx, const size_t buffer_size,
+	usb_complete_t complete, void *context)
 {
 	struct urb *urb;
 
-	void *buffer = kzalloc(buffer_size, GFP_KERNEL);
-	if(!buffer)
-		return 0;
-
 	urb = usb_alloc_urb(0, GFP_KERNEL);
-	if(!urb) {
-		kfree(buffer);
+	if(!urb)
 		return 0;
-	}
 
 	usb_fill_int_urb(
 		urb,
 		tmx->usb_device,
 		tmx->pipe_out,
-		buffer,
+		0,
 		buffer_size,
-		donothing_callback,
-		tmx,
+		complete,
+		context,
 		tmx->bInterval_out
 	); 
 
+	if(tmx_arena_bind(tmx, urb, buffer_size)) {
+		usb_free_urb(urb);
+		return 0;
+	}
+
 	return urb;
 }
 
+/**
+ * @param stage a stage of the mailbox
+ * @return the size of its packet
+ */
+static size_t tmx_ff_stage_size(unsigned long stage)
+{
+	switch (stage) {
+	case TMX_FF_STAGE_FIRST:
+		return sizeof(struct ff_first);
+	case TMX_FF_STAGE_UPDATE:
+		return sizeof(struct ff_update);
+	case TMX_FF_STAGE_COMMIT:
+		return sizeof(struct ff_commit);
+	case TMX_FF_STAGE_PLAY:
+	default:
+		return sizeof(struct ff_change_effect_status);
+	}
+}
+
+/**
+ * @param slot the effect slot
+ * @param stage a stage of the mailbox
+ * @return the newest version of its packet
+ */
+static void *tmx_ff_stage_packet(struct tmx_ff_slot *slot, unsigned long stage)
+{
+	switch (stage) {
+	case TMX_FF_STAGE_FIRST:
+		return &slot->first;
+	case TMX_FF_STAGE_UPDATE:
+		return &slot->update;
+	case TMX_FF_STAGE_COMMIT:
+		return &slot->commit;
+	case TMX_FF_STAGE_PLAY:
+	default:
+		return &slot->play;
+	}
+}
+
+/**
+ * @param slot the effect slot
+ * @param stage a stage of the mailbox
+ * @return the copy of its packet acknowledged by the wheel,
+ * 	0 for the play request that is a command and not a state
+ */
+static void *tmx_ff_stage_shadow(struct tmx_ff_slot *slot, unsigned long stage)
+{
+	switch (stage) {
+	case TMX_FF_STAGE_FIRST:
+		return &slot->shadow.first;
+	case TMX_FF_STAGE_UPDATE:
+		return &slot->shadow.update;
+	case TMX_FF_STAGE_COMMIT:
+		return &slot->shadow.commit;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * To be called with slot->lock held
+ * @param slot the effect slot
+ * @param stage a stage with a shadow
+ * @return true if the wheel does not have the newest version of the stage
+ */
+static bool tmx_ff_stage_stale(struct tmx_ff_slot *slot, unsigned long stage)
+{
+	return TMX_FF_BLIND_UPLOAD || !test_bit(stage, &slot->acked) ||
+		memcmp(tmx_ff_stage_packet(slot, stage), tmx_ff_stage_shadow(slot, stage),
+			tmx_ff_stage_size(stage));
+}
+
+/**
+ * Copies a stage of the mailbox at the end of the URB buffer
+ * @param slot the effect slot
+ * @param stage which packet to copy
+ */
+static void tmx_ff_slot_append(struct tmx_ff_slot *slot, unsigned long stage)
+{
+	uint8_t *buffer = (uint8_t *)slot->urb->transfer_buffer + slot->urb->transfer_buffer_length;
+
+	memcpy(buffer, tmx_ff_stage_packet(slot, stage), tmx_ff_stage_size(stage));
+	slot->urb->transfer_buffer_length += tmx_ff_stage_size(stage);
+
+	__set_bit(stage, &slot->inflight);
+}
+
+/**
+ * The wheel acknowledged the transfer in flight: its bytes become the
+ * shadow of their stages, and a stage changed in the meantime is sent
+ * again. The upload ends when no stage of it is left.
+ * To be called with slot->lock held
+ * @param slot the effect slot
+ */
+static void tmx_ff_slot_acked(struct tmx_ff_slot *slot)
+{
+	uint8_t *buffer = slot->urb->transfer_buffer;
+	unsigned long stage;
+	void *shadow;
+
+	// The stages are in the buffer in the order they were appended
+	for_each_set_bit(stage, &slot->inflight, TMX_FF_STAGES) {
+		shadow = tmx_ff_stage_shadow(slot, stage);
+		if(shadow) {
+			memcpy(shadow, buffer, tmx_ff_stage_size(stage));
+			__set_bit(stage, &slot->acked);
+			if(tmx_ff_stage_stale(slot, stage))
+				__set_bit(stage, &slot->pending);
+		}
+		buffer += tmx_ff_stage_size(stage);
+	}
+
+	if(slot->state == TMX_FF_SLOT_UPLOADING && !(slot->pending & TMX_FF_UPLOAD_STAGES)) {
+		slot->state = slot->playing ? TMX_FF_SLOT_PLAYING : TMX_FF_SLOT_READY;
+		atomic_inc(&slot->tmx->ff_uploads);
+	} else if(slot->state == TMX_FF_SLOT_READY && test_bit(TMX_FF_STAGE_PLAY, &slot->inflight)) {
+		slot->state = TMX_FF_SLOT_PLAYING;
+	}
+}
+
+/**
+ * Gives up on the transfer in flight, the effect on the wheel is
+ * incomplete and it's not played. To be called with slot->lock held
+ * @param slot the effect slot
+ */
+static void tmx_ff_slot_abort(struct tmx_ff_slot *slot)
+{
+	slot->retries = 0;
+	slot->state = TMX_FF_SLOT_EMPTY;
+	slot->playing = false;
+	__clear_bit(TMX_FF_STAGE_PLAY, &slot->pending);
+	atomic_inc(&slot->tmx->ff_upload_failures);
+}
+
+/**
+ * Sends the first pending stage of a slot, if its URB is not already
+ * in flight. When coalescing is enabled the pending stages are packed
+ * in the same transfer, in order, for as long as they fit in a single
+ * packet of the OUT endpoint. To be called with slot->lock held and a token
+ * of the transmit scheduler
+ * @param slot the effect slot
+ * @returns 0 if no error @see usb_submit_urb for the error codes
+ */
+static int tmx_ff_slot_submit(struct tmx_ff_slot *slot)
+{
+	struct tmx *tmx = slot->tmx;
+	unsigned long stage;
+	int errno;
+
+	if(slot->busy || !slot->pending || tmx_recovery_active(tmx))
+		return 0;
+
+	slot->inflight = 0;
+	slot->urb->transfer_buffer_length = 0;
+
+	tmx_ff_slot_append(slot, __ffs(slot->pending));
+
+	if(READ_ONCE(tmx->ff_coalesce)) {
+		for_each_set_bit(stage, &slot->pending, TMX_FF_STAGES) {
+			if(test_bit(stage, &slot->inflight))
+				continue;
+			if(slot->urb->transfer_buffer_length + tmx_ff_stage_size(stage) > tmx->max_packet_out)
+				break;
+			tmx_ff_slot_append(slot, stage);
+		}
+	}
+
+	slot->pending &= ~slot->inflight;
+
+	errno = usb_submit_urb(slot->urb, GFP_ATOMIC);
+	if(!errno)
+		slot->busy = true;
+	else
+		slot->pending |= slot->inflight;
+
+	return errno;
+}
+
+/**
+ * Asks the transmit scheduler to send the pending stages of a slot.
+ * While the slot waits for its turn new uploads only update the mailbox.
+ * To be called with slot->lock held
+ * @param slot the effect slot
+ * @returns 0 if no error @see usb_submit_urb for the error codes
+ */
+static int tmx_ff_slot_kick(struct tmx_ff_slot *slot)
+{
+	enum tmx_tx_class class;
+	int errno;
+
+	// The recovery kicks every slot when the endpoint is back
+	if(slot->busy || !slot->pending || tmx_recovery_active(slot->tmx))
+		return 0;
+
+	// Changing a single parameter or playing is live traffic, a whole effect is not
+	class = slot->pending & ~(BIT(TMX_FF_STAGE_UPDATE) | BIT(TMX_FF_STAGE_PLAY)) ?
+		TMX_TX_CLASS_UPLOAD : TMX_TX_CLASS_CONTROL;
+
+	if(!tmx_tx_acquire(slot->tmx, &slot->source, class))
+		return 0;
+
+	errno = tmx_ff_slot_submit(slot);
+
+	// Not submitted, the token is not used
+	if(!slot->busy)
+		tmx_tx_refund(slot->tmx, class);
+
+	return errno;
+}
+
+/** Called by the transmit scheduler when it's the turn of a queued slot */
+static bool tmx_ff_slot_send(struct tmx_tx_source *source)
+{
+	struct tmx_ff_slot *slot = container_of(source, struct tmx_ff_slot, source);
+	unsigned long flags;
+	bool sent;
+	int errno;
+
+	spin_lock_irqsave(&slot->lock, flags);
+	// Already in flight, nothing left or in recovery: nothing is submitted
+	sent = !slot->busy;
+	errno = tmx_ff_slot_submit(slot);
+	sent = sent && slot->busy;
+	spin_unlock_irqrestore(&slot->lock, flags);
+
+	if(errno)
+		hid_err(slot->tmx->hid_device, "submitting ffb urb of slot %d, error %d\n",
+			(int)(slot - slot->tmx->ff_slots), errno);
+
+	return sent;
+}
+
+/**
+ * Callback of the URB of a slot, sends the newest version of the next pending stage.
+ * A failed transfer is sent again, up to TMX_FF_RETRIES times in a row, but
+ * after a stall or a protocol error it waits for the recovery of the endpoint
+ */
+static void tmx_ff_slot_complete(struct urb *urb)
+{
+	struct tmx_ff_slot *slot = urb->context;
+	struct tmx *tmx = slot->tmx;
+	int status = tmx_recovery_status(tmx, urb->status);
+	unsigned long flags;
+	int errno = 0;
+	bool fallback = false, dropped = false, recover = false;
+
+	spin_lock_irqsave(&slot->lock, flags);
+	slot->busy = false;
+
+	switch (status) {
+	case 0:
+		if(hweight_long(slot->inflight) > 1)
+			atomic_inc(&tmx->ff_coalesced);
+		slot->retries = 0;
+		tmx_ff_slot_acked(slot);
+		errno = tmx_ff_slot_kick(slot);
+		break;
+	case -ENOENT:
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		// Killed by the recovery, the stages go out again after it
+		if(status != -ESHUTDOWN && tmx_recovery_active(tmx)) {
+			slot->acked &= ~slot->inflight;
+			slot->pending |= slot->inflight;
+			break;
+		}
+
+		// The URB was killed or the wheel was unplugged
+		slot->pending = 0;
+		break;
+	default:
+		if(tmx_recovery_fatal(status)) {
+			slot->acked &= ~slot->inflight;
+			slot->pending |= slot->inflight;
+			recover = true;
+			break;
+		}
+
+		// The wheel did not like the coalesced transfer, send the stages one by one
+		if(hweight_long(slot->inflight) > 1) {
+			fallback = READ_ONCE(tmx->ff_coalesce);
+			WRITE_ONCE(tmx->ff_coalesce, false);
+		}
+
+		// Nobody knows what the wheel has now, the stages are sent again
+		slot->acked &= ~slot->inflight;
+		if(fallback || ++slot->retries <= TMX_FF_RETRIES) {
+			slot->pending |= slot->inflight;
+			atomic_inc(&tmx->ff_upload_retries);
+		} else {
+			tmx_ff_slot_abort(slot);
+			dropped = true;
+		}
+		errno = tmx_ff_slot_kick(slot);
+	}
+
+	spin_unlock_irqrestore(&slot->lock, flags);
+
+	if(recover)
+		tmx_recovery_trigger(tmx, status);
+
+	if(fallback)
+		hid_warn(tmx->hid_device, "coalesced upload failed with status %d, falling back to three transfers\n",
+			status);
+
+	if(dropped)
+		hid_err(tmx->hid_device, "ffb urb of slot %d failed %d times with status %d, giving up\n",
+			(int)(slot - tmx->ff_slots), TMX_FF_RETRIES + 1, status);
+
+	if(errno)
+		hid_err(tmx->hid_device, "submitting ffb urb of slot %d, error %d\n",
+			(int)(slot - tmx->ff_slots), errno);
+}
+
 /** 
  * This macro is called in the probe function when the wheel input
  * is beign setted up
@@ -49,16 +358,53 @@ static struct urb* tmx_ff_alloc_urb(struct tmx *tmx, const size_t buffer_size)
 static inline int tmx_init_ffb(struct tmx *tmx)
 {
 	int errno, i;
+	struct tmx_ff_slot *slot;
 
 	for (i = 0; i < tmx_ffb_effects_length; i++)
 		set_bit(tmx_ffb_effects[i], tmx->joystick->ffbit);
 
+	errno = tmx_init_mixer(tmx);
+	if(errno)
+		return errno;
+
+	tmx->ff_slots = kcalloc(TMX_FF_DEVICE_SLOTS, sizeof(struct tmx_ff_slot), GFP_KERNEL);
+	if(!tmx->ff_slots) {
+		errno = -ENOMEM;
+		goto err;
+	}
+
+	for (i = 0; i < TMX_FF_DEVICE_SLOTS; i++) {
+		slot = &tmx->ff_slots[i];
+
+		spin_lock_init(&slot->lock);
+		slot->tmx = tmx;
+		slot->source.send = tmx_ff_slot_send;
+		slot->urb = tmx_ff_alloc_urb(tmx, TMX_FF_SLOT_BUFFER_SIZE, tmx_ff_slot_complete, slot);
+		if(!slot->urb) {
+			errno = -ENOMEM;
+			goto err;
+		}
+	}
+
+	errno = tmx_init_vslot(tmx);
+	if(errno)
+		goto err;
+
+	errno = tmx_init_recon(tmx);
+	if(errno)
+		goto err;
+
+	errno = tmx_init_torque(tmx);
+	if(errno)
+		goto err;
+
 	// input core will automatically free force feedback structures when device is destroyed.
+	// The effect ids are not device slots, all of them can be given to the games
 	errno = input_ff_create(tmx->joystick, FF_MAX_EFFECTS);
 	
 	if(errno) {
 		hid_err(tmx->hid_device, "error create ff :(. errno=%i\n", errno);
-		return errno;
+		goto err;
 	}
 
 	tmx->joystick->ff->upload = tmx_ff_upload;
@@ -67,6 +413,9 @@ static inline int tmx_init_ffb(struct tmx *tmx)
 	tmx->joystick->ff->set_gain = tmx_ff_set_gain;
 
 	return 0;
+
+err:	tmx_free_ffb(tmx);
+	return errno;
 }
 
 /**
@@ -76,23 +425,36 @@ static inline int tmx_init_ffb(struct tmx *tmx)
  */
 static inline void tmx_free_ffb(struct tmx *tmx)
 {
-	unsigned int i, j;
+	unsigned int i;
 
-	for(i = 0; i < FF_MAX_EFFECTS; i++)
-		for(j = 0; j < 3; j++) {
-			if(! tmx->update_ffb_urbs[i][j])
-				continue;
+	// The mixer, the reconstruction and the torque device post to the slots, stop them first
+	tmx_free_torque(tmx);
+	tmx_free_mixer(tmx);
+	tmx_free_recon(tmx);
+	tmx_free_vslot(tmx);
 
-			usb_kill_urb(tmx->update_ffb_urbs[i][j]);
-			kfree(tmx->update_ffb_urbs[i][j]->transfer_buffer);
-			usb_free_urb(tmx->update_ffb_urbs[i][j]);
-		}
+	if(!tmx->ff_slots)
+		return;
+
+	for(i = 0; i < TMX_FF_DEVICE_SLOTS; i++) {
+		if(! tmx->ff_slots[i].urb)
+			continue;
+
+		usb_kill_urb(tmx->ff_slots[i].urb);
+		usb_free_urb(tmx->ff_slots[i].urb);
+	}
+
+	kfree(tmx->ff_slots);
+	tmx->ff_slots = 0;
 }
 
 static void tmx_ff_preapre_first(struct ff_first *ff_first, struct ff_effect *effect)
 {
 	struct ff_envelope *ff_envelope;
 
+	// Every byte is compared with the shadow, the padding too
+	memset(ff_first, 0, sizeof(struct ff_first));
+
 	switch (effect->type) {
 	case FF_CONSTANT:
 		ff_envelope = &effect->u.constant.envelope;
@@ -121,12 +483,29 @@ static void tmx_ff_preapre_first(struct ff_first *ff_first, struct ff_effect *ef
 	if(ff_envelope) {
 		ff_first->attack_length = cpu_to_le16(ff_envelope->attack_length);
 		// @FIXME the attack and fade levels are wrong !
-		ff_first->attack_level  = ff_envelope->attack_level / 0x1fff;
+		ff_first->attack_level  = tmx_conv_udiv(ff_envelope->attack_level,
+			TMX_CONV_RECIPROCAL(TMX_CONV_ENVELOPE_LEVEL));
 		ff_first->fade_length = cpu_to_le16(ff_envelope->attack_length);
-		ff_first->fade_level  = ff_envelope->fade_level / 0x1fff;
+		ff_first->fade_level  = tmx_conv_udiv(ff_envelope->fade_level,
+			TMX_CONV_RECIPROCAL(TMX_CONV_ENVELOPE_LEVEL));
 	}
 }
 
+/**
+ * @param effect a constant effect
+ * @return the level sent to the wheel in the update packet
+ */
+static int8_t tmx_ff_constant_level(struct ff_effect *effect)
+{
+	int32_t level;
+
+	/* Not sure if really necessary. Done only for the ffmvforce utility :P */
+	level = effect->u.constant.level * tmx_conv_direction(effect->direction);
+	level >>= 15; // int only
+
+	return tmx_conv_sdiv(level, TMX_CONV_RECIPROCAL(TMX_CONV_CONSTANT_LEVEL));
+}
+
 /**
  * This function prepares an update packet to update an already uploaded effected
  * or when we're uploading a new effect
@@ -135,8 +514,7 @@ static void tmx_ff_preapre_first(struct ff_first *ff_first, struct ff_effect *ef
  */
 static void tmx_ff_prepare_update(struct ff_update *ff_update, struct ff_effect *effect)
 {
-	int32_t level = 0;
-
+	memset(ff_update, 0, sizeof(struct ff_update));
 	ff_update->pk_id1 = effect->id * 0x1c + 0x0e;
 	ff_update->f1 = 0x00;
 
@@ -147,49 +525,54 @@ static void tmx_ff_prepare_update(struct ff_update *ff_update, struct ff_effect
 
 		ff_update->effect.periodic.magnitude = word_high(effect->u.periodic.magnitude);
 		ff_update->effect.periodic.offset = word_high(effect->u.periodic.offset);
-		ff_update->effect.periodic.phase = effect->u.periodic.phase / ( (360*100) / 0xff) ; // Check if correct
+		ff_update->effect.periodic.phase = tmx_conv_udiv(effect->u.periodic.phase,
+			TMX_CONV_RECIPROCAL(TMX_CONV_PHASE)); // Check if correct
 		ff_update->effect.periodic.period = cpu_to_le16(effect->u.periodic.period);
 		break;
 	case FF_CONSTANT:
 		ff_update->effect_class = TMX_FF_UPDATE_CODE_CONSTANT;
 
-		/* Not sure if really necessary. Done only for the ffmvforce utility :P */
-		level = effect->u.constant.level * fixp_sin16(effect->direction / ( 0xFFFF / 360 )) * +1;
-		level >>= 15; // int only
-
-		ff_update->effect.constant.level = (level / 0x01ff);
+		ff_update->effect.constant.level = tmx_ff_constant_level(effect);
 		break;
 	case FF_SPRING:
 		ff_update->effect_class = TMX_FF_UPDATE_CODE_CONDITION;
 
-		ff_update->effect.condition.right_coeff = effect->u.condition[0].right_coeff / 0x147;
-		ff_update->effect.condition.left_coeff = effect->u.condition[0].left_coeff / 0x147;
+		ff_update->effect.condition.right_coeff = tmx_conv_sdiv(effect->u.condition[0].right_coeff,
+			TMX_CONV_RECIPROCAL(TMX_CONV_COEFF));
+		ff_update->effect.condition.left_coeff = tmx_conv_sdiv(effect->u.condition[0].left_coeff,
+			TMX_CONV_RECIPROCAL(TMX_CONV_COEFF));
 
 		ff_update->effect.condition.center = cpu_to_le16(
-			effect->u.condition[0].center / (0x7fff / 0x01f4) 
+			tmx_conv_sdiv(effect->u.condition[0].center, TMX_CONV_RECIPROCAL(TMX_CONV_CENTER))
 		);
 		ff_update->effect.condition.deadband = cpu_to_le16(
-			effect->u.condition[0].deadband / (0xffff /0x03e8)
+			tmx_conv_udiv(effect->u.condition[0].deadband, TMX_CONV_RECIPROCAL(TMX_CONV_DEADBAND))
 		);
 
-		ff_update->effect.condition.right_sat = effect->u.condition[0].right_saturation / 0x030c;
-		ff_update->effect.condition.left_sat = effect->u.condition[0].left_saturation / 0x030c;
+		ff_update->effect.condition.right_sat = tmx_conv_udiv(effect->u.condition[0].right_saturation,
+			TMX_CONV_RECIPROCAL(TMX_CONV_SPRING_SAT));
+		ff_update->effect.condition.left_sat = tmx_conv_udiv(effect->u.condition[0].left_saturation,
+			TMX_CONV_RECIPROCAL(TMX_CONV_SPRING_SAT));
 		break;
 	case FF_DAMPER:
 		ff_update->effect_class = TMX_FF_UPDATE_CODE_CONDITION;
 
-		ff_update->effect.condition.right_coeff = effect->u.condition[0].right_coeff / 0x147;
-		ff_update->effect.condition.left_coeff = effect->u.condition[0].left_coeff / 0x147;
+		ff_update->effect.condition.right_coeff = tmx_conv_sdiv(effect->u.condition[0].right_coeff,
+			TMX_CONV_RECIPROCAL(TMX_CONV_COEFF));
+		ff_update->effect.condition.left_coeff = tmx_conv_sdiv(effect->u.condition[0].left_coeff,
+			TMX_CONV_RECIPROCAL(TMX_CONV_COEFF));
 
 		ff_update->effect.condition.center = cpu_to_le16(
-			effect->u.condition[0].center / (0x7fff / 0x01f4) 
+			tmx_conv_sdiv(effect->u.condition[0].center, TMX_CONV_RECIPROCAL(TMX_CONV_CENTER))
 		);
 		ff_update->effect.condition.deadband = cpu_to_le16(
-			effect->u.condition[0].deadband / (0xffff /0x03e8)
+			tmx_conv_udiv(effect->u.condition[0].deadband, TMX_CONV_RECIPROCAL(TMX_CONV_DEADBAND))
 		);
 
-		ff_update->effect.condition.right_sat = effect->u.condition[0].right_saturation / 0x028f;
-		ff_update->effect.condition.left_sat = effect->u.condition[0].left_saturation / 0x028f;
+		ff_update->effect.condition.right_sat = tmx_conv_udiv(effect->u.condition[0].right_saturation,
+			TMX_CONV_RECIPROCAL(TMX_CONV_DAMPER_SAT));
+		ff_update->effect.condition.left_sat = tmx_conv_udiv(effect->u.condition[0].left_saturation,
+			TMX_CONV_RECIPROCAL(TMX_CONV_DAMPER_SAT));
 
 		break;
 	}
@@ -197,6 +580,7 @@ static void tmx_ff_prepare_update(struct ff_update *ff_update, struct ff_effect
 
 static void tmx_ff_prepare_commit(struct ff_commit *ff_commit, struct ff_effect *effect)
 {
+	memset(ff_commit, 0, sizeof(struct ff_commit));
 	ff_commit->f0 = 0x01;
 	ff_commit->id = effect->id;
 	if(effect->replay.length) // Ugly hack(?) per Assetto Corsa :P
@@ -241,9 +625,68 @@ static void tmx_ff_prepare_commit(struct ff_commit *ff_commit, struct ff_effect
 	}
 }
 
+/**
+ * Posts the packets of an effect in the mailbox of a device slot.
+ * Each packet is compared with the last version the wheel acknowledged
+ * on that slot and, if they are the same, the stage is not sent, unless
+ * you define TMX_FF_BLIND_UPLOAD as true.
+ * A stage still pending is overwritten, only its newest version is sent
+ * @param tmx the wheel
+ * @param slot_id the device slot, the id of the effect is not used
+ * @param effect the effect to upload
+ * 
+ * @return 0 if no errors occured
+ */
+static int tmx_ff_post(struct tmx *tmx, int slot_id, struct ff_effect *effect)
+{
+	struct tmx_ff_slot *slot = &tmx->ff_slots[slot_id];
+	struct ff_effect device;
+	unsigned long flags, stage;
+	int errno = 0;
+
+	struct ff_first ff_first;
+	struct ff_update ff_update;
+	struct ff_commit ff_commit;
+
+	/** Preparing effect, the packets carry the id of the slot */
+	device = *effect;
+	device.id = slot_id;
+	tmx_ff_preapre_first(&ff_first, &device);
+	tmx_ff_prepare_update(&ff_update, &device);
+	tmx_ff_prepare_commit(&ff_commit, &device);
+
+	spin_lock_irqsave(&slot->lock, flags);
+
+	slot->first = ff_first;
+	slot->update = ff_update;
+	slot->commit = ff_commit;
+
+	// A stage in flight is checked again when the wheel acknowledges it
+	for(stage = TMX_FF_STAGE_FIRST; stage <= TMX_FF_STAGE_COMMIT; stage++) {
+		if(tmx_ff_stage_stale(slot, stage))
+			__set_bit(stage, &slot->pending);
+		else
+			__clear_bit(stage, &slot->pending);
+	}
+
+	if(slot->pending & TMX_FF_UPLOAD_STAGES)
+		slot->state = TMX_FF_SLOT_UPLOADING;
+
+	errno = tmx_ff_slot_kick(slot);
+
+	spin_unlock_irqrestore(&slot->lock, flags);
+
+	if(errno)
+		hid_err(tmx->hid_device, "submitting ffb urb of slot %d, error %d\n", slot_id ,errno);
+
+	return errno;
+}
+
 /**
  * Function called to upload an effect to the wheel.
  * An effect has to be sent to the wheel fragmented in 3 usb request.
+ * Effects played by the mixer never reach the wheel, the others go
+ * through the effect table, @see tmx_vslot_post
  * @param dev the input_dev
  * @param effect the effect to upload
  * @param old If I have to update an already uploaded effect this is not 0
@@ -253,93 +696,27 @@ static void tmx_ff_prepare_commit(struct ff_commit *ff_commit, struct ff_effect
 static int tmx_ff_upload(struct input_dev *dev, struct ff_effect *effect, struct ff_effect *old)
 {
 	struct tmx *tmx = input_get_drvdata(dev);
-	int errno = 0;
-
-	struct ff_first ff_first_old, ff_first_new;
-	struct ff_update ff_update_old, ff_update_new;
-	struct ff_commit ff_commit_old, ff_commit_new;
 
 	// No need to re-upload the same effect....
 	if(!TMX_FF_BLIND_COMPUTE_EFFECT && old && memcmp(effect, old, sizeof(struct ff_effect)) == 0)
 		return 0;
 
-	// If URBs were already allocated we can re-use them....
-	// Alloc first urb
-	if(! tmx->update_ffb_urbs[effect->id][0])
-		tmx->update_ffb_urbs[effect->id][0] = tmx_ff_alloc_urb(tmx, sizeof(struct ff_first));
-
-	if(! tmx->update_ffb_urbs[effect->id][0])
-		return -ENOMEM;
-
-	// Alloc second urb
-	if(! tmx->update_ffb_urbs[effect->id][1])
-		tmx->update_ffb_urbs[effect->id][1] = tmx_ff_alloc_urb(tmx, sizeof(struct ff_update));
-
-	if(! tmx->update_ffb_urbs[effect->id][1])
-		goto free0;
-
-	// Alloc third urb
-	if(! tmx->update_ffb_urbs[effect->id][2])
-		tmx->update_ffb_urbs[effect->id][2] = tmx_ff_alloc_urb(tmx, sizeof(struct ff_commit));
-
-	if(! tmx->update_ffb_urbs[effect->id][2])
-		goto free1;	
-
-	/** Preparing effect */
-	tmx_ff_preapre_first(&ff_first_new, effect);
-	tmx_ff_prepare_update(&ff_update_new, effect);
-	tmx_ff_prepare_commit(&ff_commit_new, effect);
-
-	if(old) {
-		tmx_ff_preapre_first(&ff_first_old, old);
-		tmx_ff_prepare_update(&ff_update_old, old);
-		tmx_ff_prepare_commit(&ff_commit_old, old);
-	}
-	
-	/** Submiting the effect to the wheel 
-	 * If an old is present and the result packet are the same we skip an URB
-	 * unless you define TMX_FF_BLIND_UPLOAD as true
-	 */
-	if(TMX_FF_BLIND_UPLOAD || !old || memcmp(&ff_first_old, &ff_first_new, sizeof(struct ff_first))){
-		usb_kill_urb(tmx->update_ffb_urbs[effect->id][0]);
-
-		memcpy(tmx->update_ffb_urbs[effect->id][0]->transfer_buffer, &ff_first_new, sizeof(struct ff_first));
-		errno = usb_submit_urb(tmx->update_ffb_urbs[effect->id][0], GFP_ATOMIC);
-		if(errno) {
-			hid_err(tmx->hid_device, "submitting ffb 0 urb of effect %d, error %d\n", effect->id ,errno);
-			return errno;
-		}
-	}
-
-	if(TMX_FF_BLIND_UPLOAD || !old || memcmp(&ff_update_old, &ff_update_new, sizeof(struct ff_update))){
-		usb_kill_urb(tmx->update_ffb_urbs[effect->id][1]);
-
-		memcpy(tmx->update_ffb_urbs[effect->id][1]->transfer_buffer, &ff_update_new, sizeof(struct ff_update));
-		errno = usb_submit_urb(tmx->update_ffb_urbs[effect->id][1], GFP_ATOMIC);
-		if(errno) {
-			hid_err(tmx->hid_device, "submitting ffb 1 urb of effect %d, error %d\n", effect->id ,errno);
-			return errno;
-		}
+	if(tmx_mixer_wants(tmx, effect)) {
+		tmx_recon_release(tmx, effect->id);
+		tmx_vslot_release(tmx, effect->id);
+		tmx_mixer_upload(tmx, effect);
+		return 0;
 	}
 
-	if(TMX_FF_BLIND_UPLOAD || !old || memcmp(&ff_commit_old, &ff_commit_new, sizeof(struct ff_commit))){
-		usb_kill_urb(tmx->update_ffb_urbs[effect->id][2]);
+	if(tmx_mixer_owns(tmx, effect->id))
+		tmx_mixer_release(tmx, effect->id);
 
-		memcpy(tmx->update_ffb_urbs[effect->id][2]->transfer_buffer, &ff_commit_new, sizeof(struct ff_commit));
-		errno = usb_submit_urb(tmx->update_ffb_urbs[effect->id][2], GFP_ATOMIC);
-		if(errno) {
-			hid_err(tmx->hid_device, "submitting ffb 2 urb of effect %d, error %d\n", effect->id ,errno);
-			return errno;
-		}
-	}
+	if(effect->type == FF_CONSTANT)
+		return tmx_recon_upload(tmx, effect);
 
-	return 0;
+	tmx_recon_release(tmx, effect->id);
 
-free1:	tmx_ff_free_urb(tmx->update_ffb_urbs[effect->id][1]);
-	tmx->update_ffb_urbs[effect->id][1] = 0;
-free0:	tmx_ff_free_urb(tmx->update_ffb_urbs[effect->id][0]);
-	tmx->update_ffb_urbs[effect->id][0] = 0;
-	return -ENOMEM;
+	return tmx_vslot_post(tmx, effect);
 }
 
 /**
@@ -355,11 +732,161 @@ static int tmx_ff_erase(struct input_dev *dev, int effect_id)
 	 * tmx_ff_play. Observing the Windows's driver seems there isn't any
 	 * specific packet to explicity destory the effect, so we return success (0)
 	 * to notify the Kernel that the id can be freed and re-used for another
-	 * effect. 
+	 * effect. Its device slot is given back to the table.
 	 */
+	tmx_mixer_release(input_get_drvdata(dev), effect_id);
+	tmx_recon_release(input_get_drvdata(dev), effect_id);
+	tmx_vslot_release(input_get_drvdata(dev), effect_id);
+
 	return 0;
 }
 
+static void tmx_ff_prepare_play(struct ff_change_effect_status *ff_change, int slot, int times)
+{
+	ff_change->f0 = 0x41;
+	ff_change->id = slot;
+	ff_change->mode = times ? 0x41 : 0x00; // Play or stop ?
+	ff_change->times = times ? times : 0x01;
+}
+
+/**
+ * Sends a request to play or stop the effect of a device slot.
+ * A play request still waiting in the mailbox of the slot is cancelled.
+ * While the effect is being uploaded the play request waits in the
+ * mailbox, so it's never sent before the end of the upload
+ * @param tmx the wheel
+ * @param slot the device slot
+ * @param times how many times the effect should be played, 0 to stop it
+ * 
+ * @return 0 if no errors occured, -EBUSY if the pool is exhausted
+ */
+static int tmx_ff_send_play(struct tmx *tmx, int slot, int times)
+{
+	struct tmx_ff_slot *ff_slot = &tmx->ff_slots[slot];
+	struct urb *urb;
+	unsigned long flags;
+	bool uploading;
+	int errno;
+
+	spin_lock_irqsave(&ff_slot->lock, flags);
+
+	__clear_bit(TMX_FF_STAGE_PLAY, &ff_slot->pending);
+	uploading = ff_slot->state == TMX_FF_SLOT_UPLOADING;
+	if(!uploading || !times) {
+		ff_slot->playing = times;
+		if(ff_slot->state != TMX_FF_SLOT_EMPTY && !uploading)
+			ff_slot->state = times ? TMX_FF_SLOT_PLAYING : TMX_FF_SLOT_READY;
+	}
+
+	spin_unlock_irqrestore(&ff_slot->lock, flags);
+
+	if(uploading && times)
+		return tmx_ff_post_play(tmx, slot, times);
+
+	// Called with the event lock held, the URB comes from the pool
+	urb = tmx_pool_get(tmx);
+	if(!urb)
+		return -EBUSY;
+
+	tmx_ff_prepare_play(urb->transfer_buffer, slot, times);
+
+	errno = tmx_pool_submit(tmx, urb, sizeof(struct ff_change_effect_status),
+		TMX_TX_KEY_PLAY(slot));
+	if(errno)
+		hid_err(tmx->hid_device, "unable to send URB to play slot n %d, errno %d\n", slot ,errno);
+
+	return errno;
+}
+
+/**
+ * Posts a play request in the mailbox of a device slot, so that it's
+ * sent after the upload still pending there
+ * @param tmx the wheel
+ * @param slot_id the device slot
+ * @param times how many times the effect should be played
+ * 
+ * @return 0 if no errors occured
+ */
+static int tmx_ff_post_play(struct tmx *tmx, int slot_id, int times)
+{
+	struct tmx_ff_slot *slot = &tmx->ff_slots[slot_id];
+	unsigned long flags;
+	int errno;
+
+	spin_lock_irqsave(&slot->lock, flags);
+	tmx_ff_prepare_play(&slot->play, slot_id, times);
+	__set_bit(TMX_FF_STAGE_PLAY, &slot->pending);
+	slot->playing = true;
+	errno = tmx_ff_slot_kick(slot);
+	spin_unlock_irqrestore(&slot->lock, flags);
+
+	if(errno)
+		hid_err(tmx->hid_device, "submitting ffb urb of slot %d, error %d\n", slot_id ,errno);
+
+	return errno;
+}
+
+/**
+ * The wheel lost its effects: the shadows are dropped, so that the next
+ * upload of each slot sends all of its packets
+ * @param tmx the wheel
+ */
+static void tmx_ff_forget(struct tmx *tmx)
+{
+	struct tmx_ff_slot *slot;
+	unsigned long flags;
+	int i;
+
+	for(i = 0; i < TMX_FF_DEVICE_SLOTS; i++) {
+		slot = &tmx->ff_slots[i];
+
+		spin_lock_irqsave(&slot->lock, flags);
+		slot->acked = 0;
+		slot->playing = false;
+		__clear_bit(TMX_FF_STAGE_PLAY, &slot->pending);
+		if(slot->state != TMX_FF_SLOT_UPLOADING)
+			slot->state = TMX_FF_SLOT_EMPTY;
+		spin_unlock_irqrestore(&slot->lock, flags);
+	}
+}
+
+/**
+ * Sends again all the effects of the slots after the recovery of the
+ * endpoint, nobody knows what the wheel kept. The effects are uploaded
+ * in full, and the ones that were playing are started again after it
+ * @param tmx the wheel
+ */
+static void tmx_ff_resend(struct tmx *tmx)
+{
+	struct tmx_ff_slot *slot;
+	unsigned long flags;
+	int errno, i;
+
+	for(i = 0; i < TMX_FF_DEVICE_SLOTS; i++) {
+		slot = &tmx->ff_slots[i];
+
+		spin_lock_irqsave(&slot->lock, flags);
+
+		if(slot->state != TMX_FF_SLOT_EMPTY) {
+			slot->acked = 0;
+			slot->pending |= TMX_FF_UPLOAD_STAGES;
+			slot->state = TMX_FF_SLOT_UPLOADING;
+
+			if(slot->playing && !test_bit(TMX_FF_STAGE_PLAY, &slot->pending)) {
+				tmx_ff_prepare_play(&slot->play, i, 1);
+				__set_bit(TMX_FF_STAGE_PLAY, &slot->pending);
+			}
+		}
+
+		errno = tmx_ff_slot_kick(slot);
+
+		spin_unlock_irqrestore(&slot->lock, flags);
+
+		if(errno)
+			hid_err(tmx->hid_device, "submitting ffb urb of slot %d, error %d\n", i, errno);
+	}
+}
+
 /**
  * Function used to play an effect already uploaded to the Wheel
  * If times==0 then the function will send to the wheel a request
@@ -374,27 +901,11 @@ static int tmx_ff_erase(struct input_dev *dev, int effect_id)
 static int tmx_ff_play(struct input_dev *dev, int effect_id, int times)
 {
 	struct tmx *tmx = input_get_drvdata(dev);
-	struct urb *urb;
-	struct ff_change_effect_status *ff_change;
-	int errno;
 
-	// Alloc urb
-	urb = tmx_ff_alloc_urb(tmx, sizeof(struct ff_change_effect_status));
-	if(!urb)
-		return -ENOMEM;
-	ff_change = urb->transfer_buffer;
+	if(tmx_mixer_owns(tmx, effect_id))
+		return tmx_mixer_play(tmx, effect_id, times);
 
-	ff_change->f0 = 0x41;
-	ff_change->id = effect_id;
-	ff_change->mode = times ? 0x41 : 0x00; // Play or stop ?
-	ff_change->times = times ? times : 0x01;
-
-	urb->complete = tmx_ff_free_urb;
-	errno = usb_submit_urb(urb, GFP_KERNEL);
-	if(errno)
-		hid_err(tmx->hid_device, "unable to send URB to play effect n %d, errno %d\n", effect_id ,errno);
-
-	return errno;
+	return tmx_vslot_play(tmx, effect_id, times);
 }
 
 /**
@@ -407,23 +918,18 @@ static void tmx_ff_set_gain(struct input_dev *dev, uint16_t gain)
 	int errno;
 	struct urb *urb;
 	struct ff_change_gain *ff_change;
-	unsigned long flags;
 
-	urb = tmx_ff_alloc_urb(tmx, sizeof(struct ff_change_gain));
+	urb = tmx_pool_get(tmx);
 	if(!urb)
-		return; // -NOMEM
+		return; // Counted in the pool
 
 	ff_change = urb->transfer_buffer;
 	
 	ff_change->f0 = 0x43;
 	ff_change->gain = DIV_ROUND_CLOSEST(gain, 0x1ff);
 
-	spin_lock_irqsave(&tmx->settings.access_lock, flags);
-	tmx->settings.gain = ff_change->gain;
-	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
-
-	urb->complete = tmx_ff_free_urb;
-	errno = usb_submit_urb(urb, GFP_KERNEL);
+	// The cached value is updated by the pool once the wheel took it
+	errno = tmx_pool_submit(tmx, urb, sizeof(struct ff_change_gain), TMX_TX_KEY_GAIN);
 	if(errno)
 		hid_err(tmx->hid_device, "unable to send URB to set gain, errno %i\n", errno);
 }
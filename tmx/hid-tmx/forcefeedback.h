@@ -149,6 +149,88 @@ union __packed ff_change
 	struct ff_change_gain gain;
 };
 
+/** A failed transfer of a slot is sent again this many times before giving up */
+#define TMX_FF_RETRIES				3
+
+/** Effect slots of the wheel, the effect ids of the games are mapped on them */
+#define TMX_FF_DEVICE_SLOTS			16
+
+/** Room for all the packets of a slot sent as a single transfer */
+#define TMX_FF_SLOT_BUFFER_SIZE \
+	(sizeof(struct ff_first) + sizeof(struct ff_update) + sizeof(struct ff_commit) + \
+	sizeof(struct ff_change_effect_status))
+
+/** The packets of an effect, in the order they are sent to the wheel */
+enum tmx_ff_stage
+{
+	TMX_FF_STAGE_FIRST,
+	TMX_FF_STAGE_UPDATE,
+	TMX_FF_STAGE_COMMIT,
+	/** Play request of an effect uploaded on demand, it must follow the upload */
+	TMX_FF_STAGE_PLAY,
+	TMX_FF_STAGES
+};
+
+/** Packets that make up the upload of an effect */
+#define TMX_FF_UPLOAD_STAGES \
+	(BIT(TMX_FF_STAGE_FIRST) | BIT(TMX_FF_STAGE_UPDATE) | BIT(TMX_FF_STAGE_COMMIT))
+
+/** What the wheel has on a device slot */
+enum tmx_ff_slot_state
+{
+	/** Nothing, or an effect whose upload failed */
+	TMX_FF_SLOT_EMPTY,
+	/** Some packets of the upload are not acknowledged yet */
+	TMX_FF_SLOT_UPLOADING,
+	/** The whole effect, stopped */
+	TMX_FF_SLOT_READY,
+	/** The whole effect, playing */
+	TMX_FF_SLOT_PLAYING
+};
+
+/** Mailbox of a device slot.
+ * The upload writes the new packets here, overwriting the ones still
+ * pending, and the completion handler of the slot URB sends the newest
+ * version of each pending packet. Only the recovery of the endpoint
+ * kills the URB, and the upload never waits for it. The shadow holds the packets as the wheel
+ * acknowledged them, a packet equal to its shadow is not sent again.
+ */
+struct tmx_ff_slot
+{
+	spinlock_t	lock;
+	struct tmx	*tmx;
+	struct urb	*urb;
+	/** true while the URB is in flight */
+	bool		busy;
+	/** Bit n set if stage n is waiting to be sent */
+	unsigned long	pending;
+	/** Stages carried by the transfer in flight */
+	unsigned long	inflight;
+	/** Waits here for the transmit scheduler */
+	struct tmx_tx_source	source;
+
+	struct ff_first		first;
+	struct ff_update	update;
+	struct ff_commit	commit;
+	struct ff_change_effect_status play;
+
+	/** Bit n set if the shadow of stage n is what the wheel has */
+	unsigned long		acked;
+	struct {
+		struct ff_first		first;
+		struct ff_update	update;
+		struct ff_commit	commit;
+	} shadow;
+	/** Failed transfers in a row */
+	unsigned		retries;
+
+	/** An upload is a transaction, it ends when all of its packets are
+	 * acknowledged or when one of them fails for good */
+	enum tmx_ff_slot_state	state;
+	/** Last play request, the state after the upload */
+	bool			playing;
+};
+
 static int tmx_init_ffb(struct tmx *tmx);
 static void tmx_free_ffb(struct tmx *tmx);
 
@@ -157,6 +239,13 @@ static int tmx_ff_erase(struct input_dev *dev, int effect_id);
 static int tmx_ff_play(struct input_dev *dev, int effect_id, int value);
 static void tmx_ff_set_gain(struct input_dev *dev, uint16_t gain);
 
+static int tmx_ff_post(struct tmx *tmx, int slot, struct ff_effect *effect);
+static int tmx_ff_post_play(struct tmx *tmx, int slot, int times);
+static int tmx_ff_send_play(struct tmx *tmx, int slot, int times);
+static void tmx_ff_forget(struct tmx *tmx);
+static void tmx_ff_resend(struct tmx *tmx);
+static int8_t tmx_ff_constant_level(struct ff_effect *effect);
+
 static uint8_t tmx_ffb_effects_length = 8;
 static const int16_t tmx_ffb_effects[] = {
 	FF_GAIN,
@@ -11,15 +11,35 @@
 #include <linux/fixp-arith.h>
 #include <linux/spinlock.h>
 #include <linux/hid.h>
+#include <linux/debugfs.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/miscdevice.h>
+#include <linux/kref.h>
+#include <linux/idr.h>
+#include <linux/mm.h>
+#include <linux/jhash.h>
+#include <linux/hidraw.h>
+#include <linux/rcupdate.h>
+#include <linux/jump_label.h>
 
 #include "hid-tmx.h"
+#include "convert.h"
+#include "axis.h"
 #include "input.h"
 #include "attributes.h"
 #include "settings.h"
+#include "tx.h"
+#include "recovery.h"
 #include "forcefeedback.h"
+#include "vslot.h"
 #include "packet.h"
-
-static void donothing_callback(struct urb *urb) {}
+#include "pool.h"
+#include "arena.h"
+#include "mixer.h"
+#include "reconstruct.h"
+#include "torque.h"
+#include "debugfs.h"
 
 /** Init for a tmx data struct
  * @param tmx pointer to the tmx structor to init
@@ -77,26 +97,71 @@ static inline int tmx_constructor(struct tmx *tmx,struct hid_device *hid_device)
 	tmx->pipe_out= usb_sndintpipe(tmx->usb_device, ep_irq_out->bEndpointAddress);
 
 	tmx->bInterval_in = ep_irq_in->bInterval;
+	tmx->max_packet_in = usb_endpoint_maxp(ep_irq_in);
 	tmx->bInterval_out = ep_irq_out->bInterval;
+	tmx->max_packet_out = usb_endpoint_maxp(ep_irq_out);
 
-	error_code = tmx_init_input(tmx);
+	// Freed after hid_hw_stop, when no report can use the tables anymore
+	error_code = tmx_init_axis(tmx);
+	if(error_code)
+		goto error3;
+
+	error_code = tmx_init_tx(tmx);
+	if(error_code)
+		goto error3;
+
+	error_code = tmx_init_recovery(tmx);
 	if(error_code)
 		goto error4;
 
-	error_code = tmx_init_ffb(tmx);
+	error_code = tmx_init_arena(tmx);
 	if(error_code)
 		goto error5;
+
+	error_code = tmx_init_pool(tmx);
+	if(error_code)
+		goto error6;
+
+	error_code = tmx_init_input(tmx);
+	if(error_code)
+		goto error7;
+
+	error_code = tmx_init_ffb(tmx);
+	if(error_code)
+		goto error8;
 	
+	error_code = tmx_init_settings(tmx);
+	if(error_code)
+		goto error9;
+
 	error_code = tmx_init_attributes(tmx);
 	if(error_code)
-		goto error6;
+		goto error10;
+
+	tmx_init_debugfs(tmx);
+
+	// hid_hw_start made hidraw and the input device visible, the reports
+	// they open go to hid-core alone until everything above is in place
+	smp_store_release(&tmx->ready, true);
+
+	// The wheel is configured in background, probe does not wait for it
+	queue_work(tmx->settings_wq, &tmx->setup_work);
 
 	return 0;
 
-error6: tmx_free_ffb(tmx);
-error5: tmx_free_input(tmx);
-error4:	;
+error10: tmx_free_settings(tmx);
+	// Nothing is sent before the ffb is set up, it's the last to need the stop
+error9: tmx_stop_tx(tmx);
+	tmx_stop_recovery(tmx);
+	tmx_free_ffb(tmx);
+error8: tmx_stop_input(tmx);
+error7:	tmx_free_pool(tmx);
+error6: tmx_free_arena(tmx);
+error5: tmx_free_recovery(tmx);
+error4: tmx_free_tx(tmx);
 error3: hid_hw_stop(hid_device);
+	tmx_free_input(tmx);
+	tmx_free_axis(tmx);
 	return error_code;
 }
 
@@ -110,6 +175,8 @@ static int tmx_probe(struct hid_device *hid_device, const struct hid_device_id *
 	if(!tmx)
 		return -ENOMEM;
 
+	tmx->probe_time = ktime_get();
+
 	error_code = tmx_constructor(tmx, hid_device);
 	if(error_code)
 		goto error0;
@@ -126,27 +193,59 @@ static void tmx_remove(struct hid_device *hid_device)
 
 	hid_info(tmx->hid_device, "TMX Wheel removed. Bye\n");
 
-	// Force feedback 
+	// sysfs first, its handlers use everything freed below
+	tmx_free_attributes(tmx);
+
+	tmx_free_debugfs(tmx);
+
+	// usbhid polls until hid_hw_stop, the reports from now on go to hid-core
+	// and the ones still in raw_event are waited for
+	smp_store_release(&tmx->ready, false);
+	synchronize_rcu();
+
+	// Force feedback, nothing is sent anymore
+	tmx_stop_tx(tmx);
+	tmx_stop_recovery(tmx);
 	tmx_free_ffb(tmx);
 
-	// input deregister
-	tmx_free_input(tmx);
+	// The URB of the driver has a buffer in the arena
+	tmx_stop_input(tmx);
 
-	// sysf free
-	tmx_free_attributes(tmx);
+	tmx_free_pool(tmx);
+	tmx_free_arena(tmx);
+
+	// Settings still queued are flushed, the scheduler is stopped and they fail
+	tmx_free_settings(tmx);
+	tmx_free_recovery(tmx);
+	tmx_free_tx(tmx);
 
 	// Stop hid
 	hid_hw_close(hid_device);
 	hid_hw_stop(hid_device);
 
+	// No report arrives anymore
+	tmx_free_input(tmx);
+	tmx_free_axis(tmx);
+
 	// tmx free
 	kfree(tmx);
 }
 
+#include "convert.c"
+#include "axis.c"
 #include "attributes.c"
 #include "input.c"
 #include "settings.c"
 #include "forcefeedback.c"
+#include "vslot.c"
+#include "tx.c"
+#include "recovery.c"
+#include "pool.c"
+#include "arena.c"
+#include "mixer.c"
+#include "reconstruct.c"
+#include "torque.c"
+#include "debugfs.c"
 
 
 /********************************************************************
@@ -167,7 +266,12 @@ static struct hid_driver tmx_driver =
 	.id_table = tmx_table,
 	.probe = tmx_probe,
 	.remove = tmx_remove,
-	.raw_event = tmx_update_input
+	.raw_event = tmx_update_input,
+	.input_configured = tmx_input_configured,
+	.driver = {
+		// The setup is deferred anyway, do not hold up the other devices
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS
+	}
 };
 
 static int __init tmx_init(void)
@@ -189,13 +293,18 @@ static int __init tmx_init(void)
 	*packet_input_what = cpu_to_le16(0x0542);
 	*packet_input_close = cpu_to_le16(0x0042);
 
+	tmx_init_conv();
+
+	tmx_debugfs_root = debugfs_create_dir("hid-tmx", 0);
+
 	errno = hid_register_driver(&tmx_driver);
 	if(errno)
 		goto err3;
 	else
 		return 0;
 
-err3:	kfree(packet_input_close);
+err3:	debugfs_remove_recursive(tmx_debugfs_root);
+	kfree(packet_input_close);
 err2:	kfree(packet_input_what);
 err1:	kfree(packet_input_open);
 err0:	return errno;
@@ -208,6 +317,8 @@ static void __exit tmx_exit(void)
 	kfree(packet_input_close);
 
 	hid_unregister_driver(&tmx_driver);
+
+	debugfs_remove_recursive(tmx_debugfs_root);
 }
 
 module_init(tmx_init);
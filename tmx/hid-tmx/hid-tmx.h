@@ -1,4 +1,6 @@
 #include <linux/mutex.h>
+#include <linux/hrtimer.h>
+#include <linux/version.h>
 
 #define USB_THRUSTMASTER_VENDOR_ID	0x044f
 #define USB_TMX_PRODUCT_ID		0xb67f
@@ -8,6 +10,14 @@ struct ff_first;
 struct ff_second;
 struct ff_third;
 union ff_change;
+struct tmx_urb_pool;
+struct tmx_ff_slot;
+struct tmx_mixer;
+struct tmx_recon;
+struct tmx_vslot;
+struct tmx_tx;
+struct tmx_arena;
+struct tmx_torque;
 
 struct tmx
 {
@@ -17,20 +27,83 @@ struct tmx
 	// Stuff to read from the wheel
 	int pipe_in;
 	uint8_t bInterval_in;
+	uint16_t max_packet_in;
+	// Polling interval in ms asked for the IN endpoint, 0 for the one of usbhid
+	uint8_t poll_interval;
+	// Polls the IN endpoint in place of usbhid when poll_interval is set
+	struct urb *urb_in;
+	// true while urb_in is the one polling
+	bool polling;
+	// true while the completion of urb_in hands its report to hid-core
+	bool polled_report;
+	// Interval the host controller gave to urb_in, xHCI keeps the one of the endpoint
+	uint16_t poll_effective;
+	// Hands the polling back to usbhid when hidraw makes it poll too
+	struct work_struct poll_fallback;
 
 	// Stuff to write to the wheel
 	int pipe_out;
 	uint8_t bInterval_out;
+	uint16_t max_packet_out;
+
+	// Set at the end of probe, the reports are handled by the driver only then
+	bool ready;
 
 	// Input api stuff
 	char dev_path[128];
 	struct input_dev *joystick;
-
-	struct urb *update_ffb_urbs[FF_MAX_EFFECTS][3];
-	unsigned update_ffb_free_slot;
+	// When the input reports arrive
+	struct tmx_input_stats *input_stats;
+	// Tables of the axes
+	struct tmx_axis *axis;
+	// Vendor reports and reports of an unknown type received
+	atomic_t input_vendor;
+	atomic_t input_unknown;
+
+	// One mailbox for each device slot
+	struct tmx_ff_slot *ff_slots;
+	// Maps the effect ids of the games on the device slots
+	struct tmx_vslot *vslot;
+	// Send the three packets of an upload as a single transfer
+	bool ff_coalesce;
+	atomic_t ff_coalesced;
+	// Leave the effects on the wheel when the input is closed
+	bool ff_persist;
+	// Uploads completed and failed for good, and packets sent again
+	atomic_t ff_uploads;
+	atomic_t ff_upload_failures;
+	atomic_t ff_upload_retries;
+	// Effects played by the host, 0 if all of them are native
+	struct tmx_mixer *mixer;
+	// Smooths the level changes of constant effects
+	struct tmx_recon *recon;
+	// Torque streamed by userspace through /dev/tmx-torqueN
+	struct tmx_torque *torque;
+
+	// Buffers of the URBs of the pool and of the effect slots
+	struct tmx_arena *arena;
+	// URBs for play, stop and gain requests
+	struct tmx_urb_pool *urb_pool;
+	// Paces the ffb traffic to the OUT endpoint
+	struct tmx_tx *tx;
+	// Brings the OUT endpoint back after a stall
+	struct tmx_recovery *recovery;
+
+	struct dentry *debugfs;
 
 	struct mutex lock;
 
+	// Ordered queue of the settings commands
+	struct workqueue_struct *settings_wq;
+	// sysfs writes wait for the wheel to ack the new setting
+	bool settings_wait;
+
+	// Firmware version and default settings, sent after probe
+	struct work_struct setup_work;
+	ktime_t probe_time;
+	// How long it took from probe to a configured wheel
+	u64 setup_time_us;
+
 	struct {
 		spinlock_t access_lock;
 
@@ -40,6 +113,9 @@ struct tmx
 		uint8_t gain;
 
 		uint8_t firmware_version;
+
+		// false until the setup task has run
+		bool setup_done;
 	} settings;
 };
 
@@ -63,6 +139,29 @@ static inline uint8_t word_low(const uint16_t word)
 	return word;
 }
 
+/**
+ * hrtimer_setup() replaced hrtimer_init() in 6.13
+ */
+static inline void tmx_hrtimer_setup(struct hrtimer *timer,
+	enum hrtimer_restart (*function)(struct hrtimer *), clockid_t clock, enum hrtimer_mode mode)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(timer, function, clock, mode);
+#else
+	hrtimer_init(timer, clock, mode);
+	timer->function = function;
+#endif
+}
+
+/**
+ * The callbacks of the binary attributes get a const attribute since 6.17
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0)
+#define tmx_bin_attribute const struct bin_attribute
+#else
+#define tmx_bin_attribute struct bin_attribute
+#endif
+
 static inline void printP(uint8_t const *const bytes, const size_t length)
 {
 	int i;
@@ -1,3 +1,16 @@
+/** Axes of the hat for each of its positions, as hid-input maps them */
+static const struct {
+	int8_t x, y;
+} tmx_input_hat[STATE_PACKET_HAT_MAX + 1] = {
+	{ 0, -1 }, { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }
+};
+
+module_param_named(poll_interval, tmx_input_poll_interval, uint, 0644);
+MODULE_PARM_DESC(poll_interval, "Polling interval of the wheel in ms, 1 to 255, "
+	"0 for the one of the endpoint (default: 0)");
+
+static void tmx_input_irq(struct urb *urb);
+
 /**
  * This function initializes the input system for
  * @tmx pointer to our device
@@ -6,6 +19,32 @@ static inline int tmx_init_input(struct tmx *tmx)
 {
 	struct hid_input *hidinput = list_entry(tmx->hid_device->inputs.next, struct hid_input, list);
 	tmx->joystick = hidinput->input;
+
+	tmx->input_stats = kzalloc(sizeof(struct tmx_input_stats), GFP_KERNEL);
+	if(!tmx->input_stats)
+		return -ENOMEM;
+
+	tmx->urb_in = usb_alloc_urb(0, GFP_KERNEL);
+	if(!tmx->urb_in)
+		goto err;
+
+	// The interval is set when the polling starts
+	usb_fill_int_urb(
+		tmx->urb_in,
+		tmx->usb_device,
+		tmx->pipe_in,
+		0,
+		min_t(uint16_t, tmx->max_packet_in, TMX_INPUT_BUFFER_SIZE),
+		tmx_input_irq,
+		tmx,
+		tmx->bInterval_in
+	);
+
+	if(tmx_arena_bind(tmx, tmx->urb_in, TMX_INPUT_BUFFER_SIZE))
+		goto err;
+
+	tmx->poll_interval = min_t(unsigned int, tmx_input_poll_interval, U8_MAX);
+	INIT_WORK(&tmx->poll_fallback, tmx_input_fallback);
 	
 	input_set_drvdata(tmx->joystick, tmx);
 
@@ -13,10 +52,268 @@ static inline int tmx_init_input(struct tmx *tmx)
 	tmx->joystick->close = tmx_input_close;
 
 	return 0;
+
+err:	usb_free_urb(tmx->urb_in);
+	tmx->urb_in = 0;
+	kfree(tmx->input_stats);
+	tmx->input_stats = 0;
+	return -ENOMEM;
+}
+
+/**
+ * Stops the IN URB of the driver and drops the PM reference it held. To
+ * be called with the mutex of the input device held, while polling
+ * @param tmx target wheel
+ */
+static void tmx_input_unpoll(struct tmx *tmx)
+{
+	usb_kill_urb(tmx->urb_in);
+	tmx->polling = false;
+	hid_hw_power(tmx->hid_device, PM_HINT_NORMAL);
+}
+
+/**
+ * Stops and frees the IN URB of the driver, its buffer is in the arena.
+ * The opens that come later fall back to usbhid
+ */
+static inline void tmx_stop_input(struct tmx *tmx)
+{
+	// No report schedules it anymore, raw_event is off
+	cancel_work_sync(&tmx->poll_fallback);
+
+	// Opens and closes hold the mutex, none of them sees the URB go away
+	mutex_lock(&tmx->joystick->mutex);
+	if(tmx->polling)
+		tmx_input_unpoll(tmx);
+	usb_free_urb(tmx->urb_in);
+	tmx->urb_in = 0;
+	mutex_unlock(&tmx->joystick->mutex);
 }
 
+/**
+ * To be called once no report can arrive anymore, after hid_hw_stop
+ */
 static inline void tmx_free_input(struct tmx *tmx)
 {
+	kfree(tmx->input_stats);
+	tmx->input_stats = 0;
+}
+
+/** Callback of the IN URB, feeds the reports to hid-core and polls again */
+static void tmx_input_irq(struct urb *urb)
+{
+	struct tmx *tmx = urb->context;
+	int errno;
+
+	switch (urb->status) {
+	case 0:
+		// Any other report in raw_event comes from the URB of usbhid
+		WRITE_ONCE(tmx->polled_report, true);
+		hid_input_report(tmx->hid_device, HID_INPUT_REPORT,
+			urb->transfer_buffer, urb->actual_length, 1);
+		WRITE_ONCE(tmx->polled_report, false);
+		break;
+	case -ENOENT:
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		// Killed or unplugged
+		return;
+	default:
+		hid_warn_ratelimited(tmx->hid_device, "input report failed with status %d\n", urb->status);
+		break;
+	}
+
+	errno = usb_submit_urb(urb, GFP_ATOMIC);
+	if(errno && errno != -EPERM)
+		hid_err_ratelimited(tmx->hid_device, "resubmitting the input URB, error %d\n", errno);
+}
+
+/**
+ * Starts the reports: the IN URB of the driver polls at poll_interval,
+ * otherwise usbhid polls at its own interval. To be called with the
+ * mutex of the input device held
+ * @param tmx target wheel
+ * @return 0 on success @see usb_submit_urb and hid_hw_open for the errors
+ */
+static int tmx_input_start(struct tmx *tmx)
+{
+	int errno;
+
+	// The reports stopped while closed, that gap is not an interval
+	tmx->input_stats->last = 0;
+	tmx->input_stats->window = 0;
+
+	if(!tmx->poll_interval)
+		return hid_hw_open(tmx->hid_device);
+
+	if(!tmx->urb_in)
+		return -ENODEV;
+
+	// hid_hw_open keeps the interface awake for usbhid, the URB needs the same
+	errno = hid_hw_power(tmx->hid_device, PM_HINT_FULLON);
+	if(errno < 0)
+		return errno;
+
+	// At full speed the interval is in frames, milliseconds
+	tmx->urb_in->interval = tmx->poll_interval;
+
+	errno = usb_submit_urb(tmx->urb_in, GFP_KERNEL);
+	if(errno) {
+		hid_hw_power(tmx->hid_device, PM_HINT_NORMAL);
+		return errno;
+	}
+
+	// The host controller may have changed it: xHCI polls at the interval of
+	// the endpoint whatever the URB asks, the others round it to a power of 2
+	tmx->poll_effective = tmx->urb_in->interval;
+	tmx->polling = true;
+
+	if(tmx->poll_effective != tmx->poll_interval)
+		hid_info(tmx->hid_device, "the host controller polls every %u ms, not every %u ms\n",
+			tmx->poll_effective, tmx->poll_interval);
+
+	return 0;
+}
+
+/**
+ * Scheduled when a report comes from usbhid while the driver polls: hidraw
+ * was opened and usbhid polls the same endpoint, the two URBs would share
+ * the reports. The driver stops its URB and keeps usbhid open in its place
+ * until the input is closed, the next open tries again
+ */
+static void tmx_input_fallback(struct work_struct *work)
+{
+	struct tmx *tmx = container_of(work, struct tmx, poll_fallback);
+	int errno;
+
+	mutex_lock(&tmx->joystick->mutex);
+
+	if(!tmx->polling)
+		goto out;
+
+	errno = hid_hw_open(tmx->hid_device);
+	if(errno) {
+		hid_err(tmx->hid_device, "handing the polling to usbhid, error %d\n", errno);
+		goto out;
+	}
+
+	tmx_input_unpoll(tmx);
+	hid_info(tmx->hid_device, "hidraw is open, usbhid polls every %u ms until the input is closed\n",
+		tmx->bInterval_in);
+
+out:	mutex_unlock(&tmx->joystick->mutex);
+}
+
+/**
+ * @param tmx target wheel
+ * @return the interval the IN endpoint is polled at, as far as the
+ *         driver can tell, at least 1 ms
+ */
+static unsigned int tmx_input_period_ms(struct tmx *tmx)
+{
+	return max_t(unsigned int, tmx->polling ? tmx->poll_effective : tmx->bInterval_in, 1);
+}
+
+/**
+ * Stops the reports, whoever is polling. To be called with the mutex
+ * of the input device held
+ * @param tmx target wheel
+ */
+static void tmx_input_stop(struct tmx *tmx)
+{
+	if(!tmx->polling) {
+		hid_hw_close(tmx->hid_device);
+		return;
+	}
+
+	tmx_input_unpoll(tmx);
+}
+
+/**
+ * Changes the polling interval. If the input is open the reports are
+ * stopped and started again with the new interval
+ * @param tmx target wheel
+ * @param interval the interval in ms, 0 for the one of usbhid
+ * @return 0 on success @see tmx_input_start for the errors
+ */
+static int tmx_input_set_poll(struct tmx *tmx, uint8_t interval)
+{
+	int errno = 0;
+
+	mutex_lock(&tmx->joystick->mutex);
+
+	tmx->poll_interval = interval;
+	if(tmx->joystick->users) {
+		tmx_input_stop(tmx);
+		errno = tmx_input_start(tmx);
+	}
+
+	mutex_unlock(&tmx->joystick->mutex);
+
+	return errno;
+}
+
+/**
+ * Called by hid-input before the input device is registered, the
+ * reports carry the time they arrived in MSC_TIMESTAMP
+ */
+static int tmx_input_configured(struct hid_device *hdev, struct hid_input *hidinput)
+{
+	input_set_capability(hidinput->input, EV_MSC, MSC_TIMESTAMP);
+
+	return 0;
+}
+
+/**
+ * @param us a time in microseconds
+ * @return its bucket in the histograms
+ */
+static inline unsigned tmx_input_bucket(u64 us)
+{
+	return min_t(unsigned, fls64(us), TMX_INPUT_HIST_BUCKETS - 1);
+}
+
+/**
+ * Accounts the arrival of a report in the histograms
+ * @param tmx target wheel
+ * @param now when the URB of the report completed
+ */
+static void tmx_input_account(struct tmx *tmx, ktime_t now)
+{
+	struct tmx_input_stats *stats = tmx->input_stats;
+	u64 interval, jitter, period = tmx_input_period_ms(tmx) * USEC_PER_MSEC;
+	s64 elapsed;
+
+	stats->reports++;
+
+	// Checks once per second that the wheel keeps up with the interval
+	if(!stats->window) {
+		stats->window = now;
+		stats->window_reports = 0;
+	}
+
+	stats->window_reports++;
+	elapsed = ktime_us_delta(now, stats->window);
+	if(elapsed >= USEC_PER_SEC) {
+		WRITE_ONCE(stats->rate, div64_u64((u64)stats->window_reports * USEC_PER_SEC, elapsed));
+		if((u64)stats->window_reports * period * 10 < (u64)elapsed * 9)
+			stats->slow++;
+
+		stats->window = now;
+		stats->window_reports = 0;
+	}
+
+	if(stats->last) {
+		interval = ktime_us_delta(now, stats->last);
+		jitter = interval > period ? interval - period : period - interval;
+
+		stats->interval[tmx_input_bucket(interval)]++;
+		stats->interval_max_us = max(stats->interval_max_us, interval);
+		stats->jitter[tmx_input_bucket(jitter)]++;
+		stats->jitter_max_us = max(stats->jitter_max_us, jitter);
+	}
+
+	stats->last = now;
 }
 
 static int tmx_input_open(struct input_dev *dev)
@@ -34,7 +331,11 @@ static int tmx_input_open(struct input_dev *dev)
 	if(ret)
 		return ret;
 
-	ret = hid_hw_open(tmx->hid_device);
+	ret = tmx_input_start(tmx);
+
+	// The effects stayed on the wheel, only what plays has to be restored
+	if(!ret && READ_ONCE(tmx->ff_persist))
+		tmx_vslot_replay(tmx, false);
 
 	return ret;
 }
@@ -44,16 +345,20 @@ static void tmx_input_close(struct input_dev *dev)
 	struct tmx *tmx = input_get_drvdata(dev);
 	int boh, i;
 
-	hid_hw_close(tmx->hid_device);
+	tmx_input_stop(tmx);
 
-	// Send magic codes
-	for(i = 0; i < 2; i++)
-		usb_interrupt_msg(
-			tmx->usb_device,
-			tmx->pipe_out,
-			packet_input_what, 2, &boh,
-			8
-		);
+	// Send magic codes, they wipe the effects of the wheel
+	if(!READ_ONCE(tmx->ff_persist)) {
+		for(i = 0; i < 2; i++)
+			usb_interrupt_msg(
+				tmx->usb_device,
+				tmx->pipe_out,
+				packet_input_what, 2, &boh,
+				8
+			);
+
+		tmx_ff_forget(tmx);
+	}
 
 	usb_interrupt_msg(
 		tmx->usb_device,
@@ -64,20 +369,124 @@ static void tmx_input_close(struct input_dev *dev)
 }
 
 /**
- * This function updates the current input status of the joystick
+ * Reports the state of the wheel straight from the raw bytes, with the
+ * codes hid-input gave to the usages of the report, and a single SYN
+ * @param tmx target wheel
+ * @param packet an input report
+ * @param now when the URB of the report completed
+ */
+static void tmx_input_report(struct tmx *tmx, struct tmx_state_packet *packet, ktime_t now)
+{
+	struct input_dev *input = tmx->joystick;
+	uint16_t buttons = le16_to_cpu(packet->buttons);
+	uint8_t hat = packet->hat & 0x0f;
+	int i;
+
+	// evdev stamps the events with the arrival too, not with the wakeup of the reader
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+	input_set_timestamp(input, now);
+#endif
+	input_event(input, EV_MSC, MSC_TIMESTAMP, (u32)ktime_to_us(now));
+
+	input_report_abs(input, ABS_X, tmx_axis_shape(tmx, TMX_AXIS_X, le16_to_cpu(packet->wheel)));
+	input_report_abs(input, ABS_Y, tmx_axis_shape(tmx, TMX_AXIS_Y, le16_to_cpu(packet->y)));
+	input_report_abs(input, ABS_RZ, tmx_axis_shape(tmx, TMX_AXIS_RZ, le16_to_cpu(packet->rz)));
+	input_report_abs(input, ABS_THROTTLE, tmx_axis_shape(tmx, TMX_AXIS_THROTTLE, le16_to_cpu(packet->slider)));
+
+	for(i = 0; i < STATE_PACKET_BUTTONS; i++)
+		input_report_key(input, BTN_JOYSTICK + i, buttons & BIT(i));
+
+	input_report_abs(input, ABS_HAT0X, hat <= STATE_PACKET_HAT_MAX ? tmx_input_hat[hat].x : 0);
+	input_report_abs(input, ABS_HAT0Y, hat <= STATE_PACKET_HAT_MAX ? tmx_input_hat[hat].y : 0);
+
+	input_sync(input);
+}
+
+/**
+ * Handles a vendor report. What they carry is not known, they are
+ * only counted
+ * @param tmx target wheel
+ * @param packet_raw the report
+ * @param size its size
+ */
+static void tmx_input_vendor(struct tmx *tmx, uint8_t *packet_raw, int size)
+{
+	atomic_inc(&tmx->input_vendor);
+	hid_dbg(tmx->hid_device, "vendor report 0x%02hhx of %d bytes\n", packet_raw[0], size);
+}
+
+/**
+ * Handles a report. To be called in an RCU read section, tmx_remove waits
+ * for it to end before freeing what the report uses
+ * @param tmx target wheel
+ * @param packet_raw the report
+ * @param size its size
+ * @param now when the report arrived
+ * @return true if the report was handled, false to let hid-core parse it
+ */
+static bool tmx_input_handle(struct tmx *tmx, uint8_t *packet_raw, int size, ktime_t now)
+{
+	struct tmx_state_packet *packet = (struct tmx_state_packet*)packet_raw;
+
+	// Not from urb_in, usbhid polls as well
+	if(READ_ONCE(tmx->polling) && !READ_ONCE(tmx->polled_report))
+		schedule_work(&tmx->poll_fallback);
+
+	switch (packet->type) {
+	case STATE_PACKET_INPUT:
+		// Shorter than expected, hid-core knows better
+		if(size < sizeof(struct tmx_state_packet))
+			return false;
+
+		// The mixer follows the wheel for the condition effects
+		if(tmx->mixer)
+			tmx_mixer_input(tmx, (int32_t)le16_to_cpu(packet->wheel) - 0x8000);
+
+		tmx_input_account(tmx, now);
+		tmx_input_report(tmx, packet, now);
+		return true;
+	case STATE_PACKET_VENDOR_02:
+	case STATE_PACKET_VENDOR_14:
+		tmx_input_vendor(tmx, packet_raw, size);
+		return true;
+	default:
+		atomic_inc(&tmx->input_unknown);
+		return false;
+	}
+}
+
+/**
+ * This function updates the current input status of the joystick.
+ * The reports handled here skip the generic parsing of hid-core,
+ * hidraw still gets them
  * @tmx target wheel
  * @ss   new status to register
+ * @return -1 if the report was handled, 0 to let hid-core parse it
  */
 static int tmx_update_input(struct hid_device *hdev, struct hid_report *report, uint8_t *packet_raw, int size)
 {	
-	struct tmx_state_packet *packet = (struct tmx_state_packet*)packet_raw;
+	struct tmx *tmx = hid_get_drvdata(hdev);
+	// Called by the completion handler of the IN URB, this is when the report arrived
+	ktime_t now = ktime_get();
+	bool handled = false;
 
-	if(packet->type != STATE_PACKET_INPUT)
-	{
-		hid_warn(hdev, "recived a packet that is not an input state :/\n");
-		printP(packet_raw, size);
-		return -1; // @TODO 
-	}
+	if(size < 1)
+		return 0;
 
-	return 0;
+	rcu_read_lock();
+
+	// Still in probe, or in remove, the joystick, the stats, the tables
+	// and the mixer may not exist
+	if(smp_load_acquire(&tmx->ready))
+		handled = tmx_input_handle(tmx, packet_raw, size, now);
+
+	rcu_read_unlock();
+
+	if(!handled)
+		return 0;
+
+	if(hdev->claimed & HID_CLAIMED_HIDRAW)
+		hidraw_report_event(hdev, packet_raw, size);
+
+	return -1;
 }
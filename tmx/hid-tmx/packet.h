@@ -1,10 +1,33 @@
 #define STATE_PACKET_INPUT 0x07
+/** Vendor defined input reports, 14 bytes of data each. Their meaning is unknown */
+#define STATE_PACKET_VENDOR_02 0x02
+#define STATE_PACKET_VENDOR_14 0x14
+
+/** Buttons in the input report, they follow each other from bit 0 */
+#define STATE_PACKET_BUTTONS 13
+/** Values of the hat above this one mean it's centered */
+#define STATE_PACKET_HAT_MAX 7
 
 /**
+ * The input report, the same for firmware 21 and 35 (see the hid_report_fw21
+ * and hid_report_fw35 dumps in traffic/old_caps).
  * All data is stored in little endian
  */
 struct __packed tmx_state_packet
 {
 	/** 0x07 if this packet contains the wheel current input status */
 	uint8_t		type;
-};
\ No newline at end of file
+	/** Steering axis, 0x0000 full left, 0xffff full right */
+	uint16_t	wheel;
+	/** Y, Rz and slider axes, the pedals, 0x000 to 0x3ff */
+	uint16_t	y;
+	uint16_t	rz;
+	uint16_t	slider;
+	uint16_t	pad0;
+	/** Bit n is button n + 1, the 3 bits above the buttons are padding */
+	uint16_t	buttons;
+	uint8_t		pad1;
+	/** Low nibble, 0 up and clockwise to 7 up-left, STATE_PACKET_HAT_MAX + 1
+	 * and above when centered. The high nibble is padding */
+	uint8_t		hat;
+};
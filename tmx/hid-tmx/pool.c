@@ -0,0 +1,220 @@
+/** Gives an URB back to the pool */
+static void tmx_pool_put(struct urb *urb)
+{
+	struct tmx_pool_entry *entry = urb->context;
+	struct tmx_urb_pool *pool = entry->tmx->urb_pool;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	__set_bit(entry->index, pool->free);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/** Callback of the URBs of the pool, a halted endpoint is recovered */
+static void tmx_pool_complete(struct urb *urb)
+{
+	struct tmx_pool_entry *entry = urb->context;
+	struct tmx *tmx = entry->tmx;
+	struct ff_change_gain *ff_change = urb->transfer_buffer;
+	int status = tmx_recovery_status(tmx, urb->status);
+	unsigned long flags;
+
+	// The wheel accepted the gain, now we can update the cached value
+	if(!status && entry->source.key == TMX_TX_KEY_GAIN) {
+		spin_lock_irqsave(&tmx->settings.access_lock, flags);
+		tmx->settings.gain = ff_change->gain;
+		spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
+	}
+
+	tmx_pool_put(urb);
+
+	if(tmx_recovery_fatal(status))
+		tmx_recovery_trigger(tmx, status);
+}
+
+/** Called by the transmit scheduler when it's the turn of a queued URB */
+static bool tmx_pool_send(struct tmx_tx_source *source)
+{
+	struct tmx_pool_entry *entry = container_of(source, struct tmx_pool_entry, source);
+	int errno;
+
+	// The recovery replays the play state once the endpoint is back
+	if(tmx_recovery_active(entry->tmx)) {
+		tmx_pool_put(entry->urb);
+		return false;
+	}
+
+	errno = usb_submit_urb(entry->urb, GFP_ATOMIC);
+	if(errno) {
+		tmx_pool_put(entry->urb);
+		hid_err(entry->tmx->hid_device, "unable to send queued URB, errno %d\n", errno);
+		return false;
+	}
+
+	return true;
+}
+
+/** Called by the transmit scheduler when a newer command replaced a queued URB */
+static void tmx_pool_drop(struct tmx_tx_source *source)
+{
+	struct tmx_pool_entry *entry = container_of(source, struct tmx_pool_entry, source);
+
+	tmx_pool_put(entry->urb);
+}
+
+/**
+ * Allocates all the URBs of the pool, their buffers come from the arena.
+ * Called from probe, it's the only place where the pool allocates memory
+ * @param tmx the wheel
+ * @returns 0 if no error, -ENOMEM otherwise
+ */
+static int tmx_init_pool(struct tmx *tmx)
+{
+	struct tmx_urb_pool *pool;
+	struct tmx_pool_entry *entry;
+	unsigned i;
+
+	pool = kzalloc(sizeof(struct tmx_urb_pool), GFP_KERNEL);
+	if(!pool)
+		return -ENOMEM;
+
+	spin_lock_init(&pool->lock);
+	atomic_set(&pool->exhausted, 0);
+	tmx->urb_pool = pool;
+
+	for(i = 0; i < TMX_POOL_SIZE; i++) {
+		entry = &pool->entries[i];
+		entry->tmx = tmx;
+		entry->index = i;
+		entry->source.send = tmx_pool_send;
+		entry->source.drop = tmx_pool_drop;
+
+		entry->urb = usb_alloc_urb(0, GFP_KERNEL);
+		if(!entry->urb)
+			goto err;
+
+		usb_fill_int_urb(
+			entry->urb,
+			tmx->usb_device,
+			tmx->pipe_out,
+			0,
+			TMX_POOL_BUFFER_SIZE,
+			tmx_pool_complete,
+			entry,
+			tmx->bInterval_out
+		);
+
+		if(tmx_arena_bind(tmx, entry->urb, TMX_POOL_BUFFER_SIZE))
+			goto err;
+
+		__set_bit(i, pool->free);
+	}
+
+	return 0;
+
+err:	tmx_free_pool(tmx);
+	return -ENOMEM;
+}
+
+/**
+ * Waits for the URBs in flight and frees the whole pool
+ * @param tmx the wheel
+ */
+static void tmx_free_pool(struct tmx *tmx)
+{
+	struct tmx_urb_pool *pool = tmx->urb_pool;
+	unsigned i;
+
+	if(!pool)
+		return;
+
+	for(i = 0; i < TMX_POOL_SIZE; i++) {
+		if(!pool->entries[i].urb)
+			continue;
+
+		usb_kill_urb(pool->entries[i].urb);
+		usb_free_urb(pool->entries[i].urb);
+	}
+
+	kfree(pool);
+	tmx->urb_pool = 0;
+}
+
+/**
+ * Takes a free URB from the pool. Safe to call in atomic context.
+ * @param tmx the wheel
+ * @returns an URB with a zeroed buffer of TMX_POOL_BUFFER_SIZE bytes,
+ * 	0 if every URB of the pool is in flight
+ */
+static struct urb *tmx_pool_get(struct tmx *tmx)
+{
+	struct tmx_urb_pool *pool = tmx->urb_pool;
+	struct urb *urb;
+	unsigned long flags, i;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	i = find_first_bit(pool->free, TMX_POOL_SIZE);
+	if(i >= TMX_POOL_SIZE) {
+		spin_unlock_irqrestore(&pool->lock, flags);
+		atomic_inc(&pool->exhausted);
+		return 0;
+	}
+
+	__clear_bit(i, pool->free);
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	urb = pool->entries[i].urb;
+	memset(urb->transfer_buffer, 0, TMX_POOL_BUFFER_SIZE);
+
+	return urb;
+}
+
+/**
+ * Sends an URB taken with tmx_pool_get, through the transmit scheduler.
+ * If the submission fails the URB is given back to the pool. Safe to call
+ * in atomic context.
+ * @param tmx the wheel
+ * @param urb the URB to send
+ * @param length how many bytes of the buffer are to be sent
+ * @param key an older queued command with the same key is dropped, 0 never
+ * @returns 0 if no error or if the URB is queued
+ * 	@see usb_submit_urb for the error codes
+ */
+static int tmx_pool_submit(struct tmx *tmx, struct urb *urb, size_t length, u32 key)
+{
+	struct tmx_pool_entry *entry = urb->context;
+	int errno;
+
+	urb->transfer_buffer_length = length;
+	entry->source.key = key;
+
+	// The recovery replays the play state once the endpoint is back
+	if(tmx_recovery_active(tmx)) {
+		tmx_pool_put(urb);
+		return 0;
+	}
+
+	if(!tmx_tx_acquire(tmx, &entry->source, TMX_TX_CLASS_CONTROL))
+		return 0;
+
+	errno = usb_submit_urb(urb, GFP_ATOMIC);
+	if(errno) {
+		tmx_pool_put(urb);
+		tmx_tx_refund(tmx, TMX_TX_CLASS_CONTROL);
+	}
+
+	return errno;
+}
+
+/**
+ * Kills the URBs of the pool in flight, they go back to the pool
+ * @param tmx the wheel
+ */
+static void tmx_pool_kill(struct tmx *tmx)
+{
+	unsigned i;
+
+	for(i = 0; i < TMX_POOL_SIZE; i++)
+		usb_kill_urb(tmx->urb_pool->entries[i].urb);
+}
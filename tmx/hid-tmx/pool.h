@@ -0,0 +1,40 @@
+/********************************************************************
+ *			      URB POOL
+ *
+ *      URBs used for the short ffb commands (play, stop, gain)
+ *      are allocated once when the wheel is probed and then
+ *         recycled by their completion handler, so the
+ *          callers never allocate and never sleep
+ *******************************************************************/
+
+/** How many URBs are preallocated for each wheel */
+#define TMX_POOL_SIZE		32
+/** Size of the buffer of each URB, an interrupt packet of the OUT endpoint */
+#define TMX_POOL_BUFFER_SIZE	32
+
+struct tmx_pool_entry
+{
+	struct tmx	*tmx;
+	struct urb	*urb;
+	unsigned	index;
+	/** Waits here for the transmit scheduler */
+	struct tmx_tx_source	source;
+};
+
+struct tmx_urb_pool
+{
+	spinlock_t lock;
+	/** A set bit means the URB is not in flight and can be used */
+	unsigned long free[BITS_TO_LONGS(TMX_POOL_SIZE)];
+	struct tmx_pool_entry entries[TMX_POOL_SIZE];
+
+	/** How many times a caller found no free URB */
+	atomic_t exhausted;
+};
+
+static int tmx_init_pool(struct tmx *tmx);
+static void tmx_free_pool(struct tmx *tmx);
+
+static struct urb *tmx_pool_get(struct tmx *tmx);
+static int tmx_pool_submit(struct tmx *tmx, struct urb *urb, size_t length, u32 key);
+static void tmx_pool_kill(struct tmx *tmx);
@@ -0,0 +1,81 @@
+/********************************************************************
+ *		     CONSTANT FORCE RECONSTRUCTION
+ *
+ *    Games update constant forces 60-100 times per second and
+ *   the wheel renders every change as a step. This stage sits
+ *   between tmx_ff_upload and the OUT endpoint and moves the
+ *   level towards each new value over several output intervals
+ *******************************************************************/
+
+/** Default latency budget, about one frame of a 60 Hz game */
+#define TMX_RECON_DEFAULT_LATENCY_US	16000
+/** Default slew rate, in level units per millisecond */
+#define TMX_RECON_DEFAULT_SLEW		0x0800
+
+/** How a new level is reached */
+enum tmx_recon_mode
+{
+	/** Levels are sent as they come */
+	TMX_RECON_OFF,
+	/** Straight line from the current level to the new one */
+	TMX_RECON_LINEAR,
+	/** Cubic Hermite curve through the last levels of the game */
+	TMX_RECON_CUBIC,
+	/** The level moves by at most slew units per millisecond */
+	TMX_RECON_SLEW,
+	TMX_RECON_MODES
+};
+
+static const char * const tmx_recon_mode_names[TMX_RECON_MODES] = {
+	"off", "linear", "cubic", "slew"
+};
+
+/** State of the reconstruction of a constant effect */
+struct tmx_recon_channel
+{
+	/** The effect as it is on the wheel */
+	struct ff_effect	sent;
+	/** Level of the game before the current target, for the cubic tangent */
+	int32_t			previous;
+	/** Level where the current segment starts */
+	int32_t			from;
+	/** Level requested by the game */
+	int32_t			to;
+	/** Start and length of the current segment */
+	ktime_t			start;
+	uint32_t		span_us;
+	/** When the game changed the level the last time */
+	ktime_t			last_update;
+};
+
+struct tmx_recon
+{
+	struct tmx		*tmx;
+	spinlock_t		lock;
+	struct hrtimer		timer;
+	/** One tick per interval of the OUT endpoint */
+	ktime_t			period;
+	bool			running;
+
+	/** Settings, changed through sysfs */
+	enum tmx_recon_mode	mode;
+	uint32_t		latency_us;
+	uint32_t		slew;
+
+	/** Bit n set if channel n has a valid sent effect */
+	unsigned long		valid[BITS_TO_LONGS(FF_MAX_EFFECTS)];
+	/** Bit n set if channel n is moving towards its target */
+	unsigned long		moving[BITS_TO_LONGS(FF_MAX_EFFECTS)];
+	struct tmx_recon_channel channels[FF_MAX_EFFECTS];
+
+	/** Samples sent to the wheel and samples that did not change the level on the wire */
+	atomic_t		emitted;
+	atomic_t		skipped;
+};
+
+static int tmx_init_recon(struct tmx *tmx);
+static void tmx_free_recon(struct tmx *tmx);
+
+static int tmx_recon_upload(struct tmx *tmx, struct ff_effect *effect);
+static void tmx_recon_release(struct tmx *tmx, int effect_id);
+static enum hrtimer_restart tmx_recon_tick(struct hrtimer *timer);
@@ -0,0 +1,197 @@
+static void tmx_recovery_work(struct work_struct *work);
+
+/**
+ * Allocates the recovery of a wheel
+ * @param tmx ptr to tmx
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int tmx_init_recovery(struct tmx *tmx)
+{
+	struct tmx_recovery *recovery = kzalloc(sizeof(struct tmx_recovery), GFP_KERNEL);
+
+	if(!recovery)
+		return -ENOMEM;
+
+	spin_lock_init(&recovery->lock);
+	mutex_init(&recovery->sync_lock);
+	INIT_DELAYED_WORK(&recovery->work, tmx_recovery_work);
+	recovery->tmx = tmx;
+
+	tmx->recovery = recovery;
+
+	return 0;
+}
+
+/**
+ * No recovery is started anymore, and the one running is waited for.
+ * To be called before the URBs of the slots and of the pool are freed
+ * @param tmx ptr to tmx
+ */
+static void tmx_stop_recovery(struct tmx *tmx)
+{
+	struct tmx_recovery *recovery = tmx->recovery;
+	unsigned long flags;
+
+	if(!recovery)
+		return;
+
+	spin_lock_irqsave(&recovery->lock, flags);
+	recovery->dead = true;
+	spin_unlock_irqrestore(&recovery->lock, flags);
+
+	cancel_delayed_work_sync(&recovery->work);
+}
+
+/**
+ * Frees the recovery, after all the URBs were killed
+ * @param tmx ptr to tmx
+ */
+static void tmx_free_recovery(struct tmx *tmx)
+{
+	tmx_stop_recovery(tmx);
+
+	kfree(tmx->recovery);
+	tmx->recovery = 0;
+}
+
+/**
+ * @param status status of a transfer on the OUT endpoint
+ * @return true if the endpoint is halted or out of sync with the wheel,
+ * 	and sending again is pointless until it's recovered
+ */
+static bool tmx_recovery_fatal(int status)
+{
+	switch (status) {
+	case -EPIPE:
+	case -EPROTO:
+	case -EILSEQ:
+	case -ETIME:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * The status a completion handler has to act on: the one of the URB,
+ * unless an error was injected through debugfs and the transfer succeeded
+ * @param tmx ptr to tmx
+ * @param status status of the URB
+ * @return the status to handle
+ */
+static int tmx_recovery_status(struct tmx *tmx, int status)
+{
+	int injected;
+
+	if(status || !atomic_read(&tmx->recovery->inject))
+		return status;
+
+	injected = atomic_xchg(&tmx->recovery->inject, 0);
+
+	return injected ? -abs(injected) : status;
+}
+
+/**
+ * Starts the recovery of the OUT endpoint, if it's not already running.
+ * Safe to call in atomic context
+ * @param tmx ptr to tmx
+ * @param status the error that was seen
+ */
+static void tmx_recovery_trigger(struct tmx *tmx, int status)
+{
+	struct tmx_recovery *recovery = tmx->recovery;
+	unsigned long flags;
+	bool start = false;
+
+	spin_lock_irqsave(&recovery->lock, flags);
+
+	if(recovery->dead)
+		goto out;
+
+	if(recovery->active) {
+		atomic_inc(&recovery->errors);
+		goto out;
+	}
+
+	WRITE_ONCE(recovery->active, true);
+	// The settings wait in their queue until the endpoint is back
+	tmx_tx_hold(tmx, TMX_TX_CLASS_SETTINGS, true);
+	recovery->since = ktime_get();
+	recovery->attempts = 0;
+	queue_delayed_work(system_highpri_wq, &recovery->work, 0);
+	start = true;
+
+out:	spin_unlock_irqrestore(&recovery->lock, flags);
+
+	if(start)
+		hid_warn(tmx->hid_device, "OUT endpoint failed with status %d, recovering\n", status);
+}
+
+/**
+ * @param tmx ptr to tmx
+ * @return true while the OUT endpoint is being recovered, the ffb
+ * 	traffic waits for the end of it
+ */
+static bool tmx_recovery_active(struct tmx *tmx)
+{
+	return READ_ONCE(tmx->recovery->active);
+}
+
+/**
+ * Worker of the recovery. The URBs queued on the endpoint are killed,
+ * the slots keep their packets, then the halt is cleared, which also
+ * resets the data toggle of the endpoint. Once the endpoint works the
+ * cached settings are applied again, the effects of the slots are
+ * uploaded in full and the play state of the table is replayed
+ */
+static void tmx_recovery_work(struct work_struct *work)
+{
+	struct tmx_recovery *recovery = container_of(to_delayed_work(work), struct tmx_recovery, work);
+	struct tmx *tmx = recovery->tmx;
+	unsigned long flags;
+	u64 elapsed;
+	int errno, i;
+
+	// Nothing may be queued on an endpoint while its halt is cleared
+	for(i = 0; i < TMX_FF_DEVICE_SLOTS; i++)
+		usb_kill_urb(tmx->ff_slots[i].urb);
+	tmx_pool_kill(tmx);
+
+	// A setting that had its turn before the error is waited for
+	mutex_lock(&recovery->sync_lock);
+	errno = usb_clear_halt(tmx->usb_device, tmx->pipe_out);
+	mutex_unlock(&recovery->sync_lock);
+
+	if(errno && ++recovery->attempts < TMX_RECOVERY_ATTEMPTS && !READ_ONCE(recovery->dead)) {
+		queue_delayed_work(system_highpri_wq, &recovery->work,
+			msecs_to_jiffies(TMX_RECOVERY_BACKOFF_MS));
+		return;
+	}
+
+	spin_lock_irqsave(&recovery->lock, flags);
+	WRITE_ONCE(recovery->active, false);
+	spin_unlock_irqrestore(&recovery->lock, flags);
+
+	tmx_tx_hold(tmx, TMX_TX_CLASS_SETTINGS, false);
+
+	// The next error starts over
+	if(errno) {
+		atomic_inc(&recovery->failures);
+		hid_err(tmx->hid_device, "unable to clear the halt of the OUT endpoint, error %d\n", errno);
+		return;
+	}
+
+	if(READ_ONCE(recovery->dead))
+		return;
+
+	tmx_settings_reapply(tmx);
+	tmx_ff_resend(tmx);
+	tmx_vslot_replay(tmx, true);
+
+	elapsed = ktime_us_delta(ktime_get(), recovery->since);
+	recovery->last_us = elapsed;
+	recovery->max_us = max(recovery->max_us, elapsed);
+	atomic_inc(&recovery->recoveries);
+
+	hid_info(tmx->hid_device, "OUT endpoint recovered in %llu us\n", elapsed);
+}
@@ -0,0 +1,53 @@
+/********************************************************************
+ *			   ENDPOINT RECOVERY
+ *
+ *     A stall or a protocol error leaves the OUT endpoint dead
+ *   until its halt is cleared. The recovery worker stops the ffb
+ *   traffic, clears the halt and sends again what the wheel had:
+ *     the settings, the effects and which of them were playing
+ *******************************************************************/
+
+/** Attempts to clear the halt before giving up */
+#define TMX_RECOVERY_ATTEMPTS		3
+/** Wait between two attempts, in milliseconds */
+#define TMX_RECOVERY_BACKOFF_MS		5
+
+struct tmx_recovery
+{
+	struct delayed_work	work;
+	struct tmx		*tmx;
+
+	spinlock_t		lock;
+	/** true from the error to the end of the recovery, nothing is sent */
+	bool			active;
+	/** true once the wheel is being removed */
+	bool			dead;
+	/** Held by the settings around their synchronous transfer, which can't
+	 * be killed, and by the worker while it clears the halt */
+	struct mutex		sync_lock;
+	/** Failed attempts to clear the halt of the current recovery */
+	unsigned		attempts;
+	/** When the error that started the recovery arrived */
+	ktime_t			since;
+
+	/** errno, as a positive number, that the next successful transfer
+	 * reports instead of its status; 0 if none. Written from debugfs */
+	atomic_t		inject;
+
+	/** Recoveries completed, given up, and errors seen while one was running */
+	atomic_t		recoveries;
+	atomic_t		failures;
+	atomic_t		errors;
+	/** Time from the error to the traffic sent again, in microseconds */
+	u64			last_us;
+	u64			max_us;
+};
+
+static int tmx_init_recovery(struct tmx *tmx);
+static void tmx_stop_recovery(struct tmx *tmx);
+static void tmx_free_recovery(struct tmx *tmx);
+
+static bool tmx_recovery_fatal(int status);
+static int tmx_recovery_status(struct tmx *tmx, int status);
+static void tmx_recovery_trigger(struct tmx *tmx, int status);
+static bool tmx_recovery_active(struct tmx *tmx);
@@ -1,118 +1,224 @@
 /**
- * @param tmx ptr to tmx
- * @param gain a value between 0x00 and 0x80 where 0x80 is 100% gain
- * @return 0 on success @see usb_interrupt_msg for return codes
+ * Sends a command to the wheel and, if the wheel accepts it, updates the
+ * cached value of the setting
+ * @param setting the command
  */
-static int tmx_set_gain(struct tmx *tmx, uint8_t gain)
+static void tmx_settings_run(struct tmx_setting *setting)
 {
-	int boh, errno;
-	uint8_t *buffer = kzalloc(2, GFP_KERNEL);
+	struct tmx *tmx = setting->tmx;
+	struct operation40 *op40 = (struct operation40 *)setting->buffer;
+	struct tmx_tx_waiter waiter;
 	unsigned long flags;
+	int boh;
 
-	buffer[0] = 0x43;
-	buffer[1] = gain;
+	for(;;) {
+		// Settings go after the ffb traffic, and wait for the end of a recovery
+		setting->errno = tmx_tx_wait(tmx, &waiter, TMX_TX_CLASS_SETTINGS);
+		if(setting->errno)
+			return;
 
-	mutex_lock(&tmx->lock);
+		mutex_lock(&tmx->recovery->sync_lock);
+		if(!tmx_recovery_active(tmx))
+			break;
 
-	// Send to the wheel desidered return force
-	errno = usb_interrupt_msg(
+		// The recovery started after our turn came, back in the queue
+		mutex_unlock(&tmx->recovery->sync_lock);
+		tmx_tx_refund(tmx, TMX_TX_CLASS_SETTINGS);
+	}
+
+	setting->errno = usb_interrupt_msg(
 		tmx->usb_device,
 		tmx->pipe_out,
-		buffer,
-		2, &boh,
+		setting->buffer,
+		setting->length, &boh,
 		SETTINGS_TIMEOUT
 	);
 
-	if(!errno) {
-		spin_lock_irqsave(&tmx->settings.access_lock, flags);
-		tmx->settings.gain = gain;
-		spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
-	} else {
-		hid_err(tmx->hid_device, "Operation set gain failed with code %d", errno);
+	mutex_unlock(&tmx->recovery->sync_lock);
+
+	if(setting->errno) {
+		hid_err(tmx->hid_device, "errno %d during operation 0x%02hhX 0x%02hhX",
+			setting->errno, setting->buffer[0], setting->buffer[1]);
+		if(tmx_recovery_fatal(setting->errno))
+			tmx_recovery_trigger(tmx, setting->errno);
+		return;
 	}
 
-	mutex_unlock(&tmx->lock);
+	// The wheel accepted the command, now we can update the cached value
+	spin_lock_irqsave(&tmx->settings.access_lock, flags);
+
+	if(setting->buffer[0] == 0x43)
+		tmx->settings.gain = setting->buffer[1];
+	else switch (op40->operation) {
+	case SET40_RETURN_FORCE:
+		tmx->settings.autocenter_force = le16_to_cpu(op40->argument);
+		break;
+	case SET40_USE_RETURN_FORCE:
+		tmx->settings.autocenter_enabled = le16_to_cpu(op40->argument);
+		break;
+	case SET40_RANGE:
+		tmx->settings.range = le16_to_cpu(op40->argument);
+		break;
+	}
 
-	kfree(buffer);
+	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
+}
 
-	return errno;
+/**
+ * Worker of the settings queue. The queue is ordered, so the commands reach the
+ * wheel one at the time and in the same order they were queued.
+ */
+static void tmx_settings_work(struct work_struct *work)
+{
+	struct tmx_setting *setting = container_of(work, struct tmx_setting, work);
+
+	tmx_settings_run(setting);
+
+	if(setting->mode == TMX_SETTINGS_WAIT) {
+		complete(&setting->done);
+	} else {
+		kfree(setting->buffer);
+		kfree(setting);
+	}
 }
 
 /**
- * @param autocenter_force a value between 0 and 100, is the strength of the autocenter effect
+ * Allocates a new settings command
+ * @param tmx ptr to tmx
+ * @param length size of the packet
+ * @param mode how the command is going to be delivered
+ * @return the command with a zeroed buffer, 0 if no memory
  */
-static __always_inline int tmx_set_autocenter(struct tmx *tmx, uint8_t autocenter_force)
+static struct tmx_setting *tmx_settings_alloc(struct tmx *tmx, size_t length,
+	enum tmx_settings_mode mode)
 {
-	uint8_t *buffer = kzalloc(4, GFP_KERNEL);
-	int errno;
-	unsigned long flags;
+	struct tmx_setting *setting = kzalloc(sizeof(struct tmx_setting), GFP_KERNEL);
 
-	mutex_lock(&tmx->lock);
+	if(!setting)
+		return 0;
+
+	setting->buffer = kzalloc(length, GFP_KERNEL);
+	if(!setting->buffer) {
+		kfree(setting);
+		return 0;
+	}
 
-	errno = tmx_settings_set40(tmx, SET40_RETURN_FORCE, autocenter_force, buffer);
+	INIT_WORK(&setting->work, tmx_settings_work);
+	init_completion(&setting->done);
+	setting->tmx = tmx;
+	setting->length = length;
+	setting->mode = mode;
 
-	if(!errno) {
-		spin_lock_irqsave(&tmx->settings.access_lock, flags);
-		tmx->settings.autocenter_force = autocenter_force;
-		spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
+	return setting;
+}
+
+/**
+ * Delivers a command allocated with tmx_settings_alloc
+ * @return 0 if async, otherwise the result of the command
+ * 	@see usb_interrupt_msg for return codes
+ */
+static int tmx_settings_queue(struct tmx *tmx, struct tmx_setting *setting)
+{
+	int errno;
+
+	switch (setting->mode) {
+	case TMX_SETTINGS_ASYNC:
+		queue_work(tmx->settings_wq, &setting->work);
+		return 0;
+	case TMX_SETTINGS_WAIT:
+		queue_work(tmx->settings_wq, &setting->work);
+		wait_for_completion(&setting->done);
+		break;
+	case TMX_SETTINGS_NOW:
+		tmx_settings_run(setting);
+		break;
 	}
 
-	mutex_unlock(&tmx->lock);
+	errno = setting->errno;
+	kfree(setting->buffer);
+	kfree(setting);
 
-	kfree(buffer);
 	return errno;
 }
 
 /**
- * @param enable true if the autocenter effect is to be kept enabled when the input
- * 	is opened. The autocentering effect is always active while no input are open
+ * Creates the ordered work queue used to send the settings to the wheel
+ * @param tmx ptr to tmx
+ * @return 0 on success, -ENOMEM otherwise
  */
-static __always_inline int tmx_set_enable_autocenter(struct tmx *tmx, bool enable)
+static int tmx_init_settings(struct tmx *tmx)
 {
-	uint8_t *buffer = kzalloc(4, GFP_KERNEL);
-	int errno;
-	unsigned long flags;
+	tmx->settings_wq = alloc_ordered_workqueue("tmx-settings-%s", 0,
+		dev_name(&tmx->hid_device->dev));
 
-	mutex_lock(&tmx->lock);
+	if(!tmx->settings_wq)
+		return -ENOMEM;
 
-	errno = tmx_settings_set40(tmx, SET40_USE_RETURN_FORCE, enable, buffer);
+	INIT_WORK(&tmx->setup_work, tmx_setup_task);
 
-	if(!errno) {
-		spin_lock_irqsave(&tmx->settings.access_lock, flags);
-		tmx->settings.autocenter_enabled = enable;
-		spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
-	}
+	return 0;
+}
 
-	mutex_unlock(&tmx->lock);
+/**
+ * Sends the commands still in the queue and destroys it.
+ * If the setup did not start yet it's skipped
+ * @param tmx ptr to tmx
+ */
+static void tmx_free_settings(struct tmx *tmx)
+{
+	if(!tmx->settings_wq)
+		return;
 
-	kfree(buffer);
-	return errno;
+	cancel_work_sync(&tmx->setup_work);
+	destroy_workqueue(tmx->settings_wq);
+	tmx->settings_wq = 0;
 }
 
 /**
- * @param range a value between 0x0000 and 0xffff where 0xffff is 900°
- * 	wheel range
+ * @param tmx ptr to tmx
+ * @param gain a value between 0x00 and 0x80 where 0x80 is 100% gain
+ * @param mode how the command is delivered
+ * @return 0 on success @see usb_interrupt_msg for return codes
  */
-static __always_inline int tmx_set_range(struct tmx *tmx, uint16_t range)
+static int tmx_set_gain(struct tmx *tmx, uint8_t gain, enum tmx_settings_mode mode)
 {
-	uint8_t *buffer = kzalloc(4, GFP_KERNEL);
-	int errno;
-	unsigned long flags;
+	struct tmx_setting *setting = tmx_settings_alloc(tmx, 2, mode);
 
-	mutex_lock(&tmx->lock);
+	if(!setting)
+		return -ENOMEM;
 
-	errno = tmx_settings_set40(tmx, SET40_RANGE, range, buffer);
+	setting->buffer[0] = 0x43;
+	setting->buffer[1] = gain;
 
-	if(!errno) {
-		spin_lock_irqsave(&tmx->settings.access_lock, flags);
-		tmx->settings.range = range;
-		spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
-	}
+	return tmx_settings_queue(tmx, setting);
+}
 
-	mutex_unlock(&tmx->lock);
+/**
+ * @param autocenter_force a value between 0 and 100, is the strength of the autocenter effect
+ */
+static __always_inline int tmx_set_autocenter(struct tmx *tmx, uint8_t autocenter_force,
+	enum tmx_settings_mode mode)
+{
+	return tmx_settings_set40(tmx, SET40_RETURN_FORCE, autocenter_force, mode);
+}
 
-	kfree(buffer);
-	return errno;
+/**
+ * @param enable true if the autocenter effect is to be kept enabled when the input
+ * 	is opened. The autocentering effect is always active while no input are open
+ */
+static __always_inline int tmx_set_enable_autocenter(struct tmx *tmx, bool enable,
+	enum tmx_settings_mode mode)
+{
+	return tmx_settings_set40(tmx, SET40_USE_RETURN_FORCE, enable, mode);
+}
+
+/**
+ * @param range a value between 0x0000 and 0xffff where 0xffff is 900°
+ * 	wheel range
+ */
+static __always_inline int tmx_set_range(struct tmx *tmx, uint16_t range, enum tmx_settings_mode mode)
+{
+	return tmx_settings_set40(tmx, SET40_RANGE, range, mode);
 }
 
 
@@ -120,45 +226,46 @@ static __always_inline int tmx_set_range(struct tmx *tmx, uint16_t range)
  * @tmx pointer to tmx
  * @operation number of operation
  * @argument the argument to pass with the request
- * @buffer a buffer of at least 4 BYTES!
+ * @mode how the command is delivered
  * @return 0 on success @see usb_interrupt_msg for return codes
  */
 static int tmx_settings_set40(
-	struct tmx *tmx, operation_t operation, uint16_t argument, void *buffer_
+	struct tmx *tmx, operation_t operation, uint16_t argument, enum tmx_settings_mode mode
 )
 {
-	int boh, errno;
-	struct operation40 *buffer = buffer_;
+	struct operation40 *buffer;
+	struct tmx_setting *setting = tmx_settings_alloc(tmx, sizeof(struct operation40), mode);
+
+	if(!setting)
+		return -ENOMEM;
+
+	buffer = (struct operation40 *)setting->buffer;
 	buffer->code = 0x40;
 	buffer->operation = operation;
 	buffer->argument = cpu_to_le16(argument);
 
-	// Send to the wheel desidered return force
-	errno = usb_interrupt_msg(
-		tmx->usb_device,
-		tmx->pipe_out,
-		buffer,
-		sizeof(struct operation40), &boh,
-		SETTINGS_TIMEOUT
-	);
-
-	if(errno)
-		hid_err(tmx->hid_device, "errno %d during operation 0x40 0x%02hhX with argument (big endian) %04hhX",
-			errno, operation, argument);
-
-	return errno;
+	return tmx_settings_queue(tmx, setting);
 }
 
-static int tmx_setup_task(struct tmx *tmx)
+/**
+ * Retrives the firmware version and writes the default settings.
+ * Runs in the settings queue after probe, so the writes done to the sysfs
+ * attributes in the meantime are applied after the defaults
+ */
+static void tmx_setup_task(struct work_struct *work)
 {
+	struct tmx *tmx = container_of(work, struct tmx, setup_work);
 	int errno = 0;
 	uint8_t *fw_version;
+	unsigned long flags;
 
 	fw_version = kzalloc(8, GFP_KERNEL);
+	if(!fw_version)
+		return;
 
 	// Retrive current version
 	mutex_lock(&tmx->lock);
-	
+
 	errno = usb_control_msg(
 		tmx->usb_device,
 		usb_rcvctrlpipe(tmx->usb_device, 0),
@@ -172,24 +279,59 @@ static int tmx_setup_task(struct tmx *tmx)
 	else
 		tmx->settings.firmware_version = fw_version[1];
 
-	errno = tmx_set_gain(tmx, 0x66); // ~80%
+	errno = tmx_set_gain(tmx, 0x66, TMX_SETTINGS_NOW); // ~80%
 	if(errno)
 		hid_err(tmx->hid_device, "Error %d while setting the tmx default gain\n", errno);
 
-	errno = tmx_set_enable_autocenter(tmx, false);
+	errno = tmx_set_enable_autocenter(tmx, false, TMX_SETTINGS_NOW);
 	if(errno)
 		hid_err(tmx->hid_device, "Error %d while setting the tmx default enable_autocenter\n", errno);
 
-	errno = tmx_set_autocenter(tmx, 50);
+	errno = tmx_set_autocenter(tmx, 50, TMX_SETTINGS_NOW);
 	if(errno)
 		hid_err(tmx->hid_device, "Error %d while setting the tmx default autocenter\n", errno);
 
-	errno = tmx_set_range(tmx, 0xffff);
+	errno = tmx_set_range(tmx, 0xffff, TMX_SETTINGS_NOW);
 	if(errno)
 		hid_err(tmx->hid_device, "Error %d while setting the tmx default range\n", errno);
 
-	hid_info(tmx->hid_device,  "Setup completed! Firmware version is %d\n", tmx->settings.firmware_version);
+	spin_lock_irqsave(&tmx->settings.access_lock, flags);
+	tmx->settings.setup_done = true;
+	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
+
+	tmx->setup_time_us = ktime_us_delta(ktime_get(), tmx->probe_time);
+
+	hid_info(tmx->hid_device,  "Setup completed in %llu ms! Firmware version is %d\n",
+		tmx->setup_time_us / USEC_PER_MSEC, tmx->settings.firmware_version);
 
 	kfree(fw_version);
-	return errno;
+}
+
+/**
+ * Queues again the settings the wheel accepted, after the recovery of
+ * the OUT endpoint. Before the setup there is nothing to apply again
+ * @param tmx ptr to tmx
+ */
+static void tmx_settings_reapply(struct tmx *tmx)
+{
+	uint8_t gain, autocenter_force;
+	bool autocenter_enabled, setup_done;
+	uint16_t range;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tmx->settings.access_lock, flags);
+	gain = tmx->settings.gain;
+	autocenter_force = tmx->settings.autocenter_force;
+	autocenter_enabled = tmx->settings.autocenter_enabled;
+	range = tmx->settings.range;
+	setup_done = tmx->settings.setup_done;
+	spin_unlock_irqrestore(&tmx->settings.access_lock, flags);
+
+	if(!setup_done)
+		return;
+
+	tmx_set_gain(tmx, gain, TMX_SETTINGS_ASYNC);
+	tmx_set_enable_autocenter(tmx, autocenter_enabled, TMX_SETTINGS_ASYNC);
+	tmx_set_autocenter(tmx, autocenter_force, TMX_SETTINGS_ASYNC);
+	tmx_set_range(tmx, range, TMX_SETTINGS_ASYNC);
 }
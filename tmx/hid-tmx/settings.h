@@ -25,12 +25,48 @@ struct opertation42
 	operation_t	operation;
 };
 
-static int tmx_settings_set40(struct tmx *tmx, operation_t operation, 
-	uint16_t argument, void *buffer);
+/** How a settings command is delivered */
+enum tmx_settings_mode
+{
+	/** Queued, the caller does not wait for the ack */
+	TMX_SETTINGS_ASYNC,
+	/** Queued, the caller waits for the ack */
+	TMX_SETTINGS_WAIT,
+	/** Sent right away, only for code already running in the settings queue */
+	TMX_SETTINGS_NOW
+};
+
+/** A settings command waiting in the work queue of the wheel.
+ * The cached value in tmx->settings is updated by the worker only
+ * after the wheel has accepted the command.
+ */
+struct tmx_setting
+{
+	struct work_struct	work;
+	struct tmx		*tmx;
+
+	/** DMA-safe packet, 0x40 operation or 0x43 gain */
+	uint8_t			*buffer;
+	size_t			length;
+
+	/** If not async the caller frees the command */
+	enum tmx_settings_mode	mode;
+	struct completion	done;
+	int			errno;
+};
+
+static int tmx_init_settings(struct tmx *tmx);
+static void tmx_free_settings(struct tmx *tmx);
+
+static int tmx_settings_set40(struct tmx *tmx, operation_t operation,
+	uint16_t argument, enum tmx_settings_mode mode);
 
-static int tmx_set_gain(struct tmx *tmx, uint8_t gain);
-static __always_inline int tmx_set_autocenter(struct tmx *tmx, uint8_t autocenter_force);
-static __always_inline int tmx_set_enable_autocenter(struct tmx *tmx, bool enable);
-static __always_inline int tmx_set_range(struct tmx *tmx, uint16_t range);
+static int tmx_set_gain(struct tmx *tmx, uint8_t gain, enum tmx_settings_mode mode);
+static __always_inline int tmx_set_autocenter(struct tmx *tmx, uint8_t autocenter_force,
+	enum tmx_settings_mode mode);
+static __always_inline int tmx_set_enable_autocenter(struct tmx *tmx, bool enable,
+	enum tmx_settings_mode mode);
+static __always_inline int tmx_set_range(struct tmx *tmx, uint16_t range, enum tmx_settings_mode mode);
 
-static int tmx_setup_task(struct tmx *tmx);
\ No newline at end of file
+static void tmx_setup_task(struct work_struct *work);
+static void tmx_settings_reapply(struct tmx *tmx);
@@ -0,0 +1,267 @@
+static DEFINE_IDA(tmx_torque_ida);
+
+/** Frees the device when the wheel and the file are both gone */
+static void tmx_torque_destroy(struct kref *kref)
+{
+	struct tmx_torque *torque = container_of(kref, struct tmx_torque, kref);
+
+	__free_page(torque->page);
+	kfree(torque);
+}
+
+/**
+ * Sends a new level on the reserved slot, starting the effect the
+ * first time. To be called with torque->lock held
+ * @param torque the device
+ * @param level the new level
+ */
+static void tmx_torque_output(struct tmx_torque *torque, int32_t level)
+{
+	struct tmx *tmx = torque->tmx;
+	struct ff_effect stream = torque->stream;
+	int errno = 0;
+
+	stream.u.constant.level = level;
+
+	if(!torque->active) {
+		errno = tmx_ff_post(tmx, torque->slot, &stream);
+		if(!errno)
+			errno = tmx_ff_post_play(tmx, torque->slot, 1);
+		torque->active = !errno;
+	} else if(level != torque->stream.u.constant.level) {
+		errno = tmx_ff_post(tmx, torque->slot, &stream);
+	}
+
+	if(!errno)
+		torque->stream = stream;
+}
+
+/**
+ * Timer of the device, drains the ring once per output interval.
+ * The samples that arrived since the last tick are averaged into
+ * a single level; without new samples the last level is held, and
+ * after TMX_TORQUE_STALL_US it drops to zero
+ */
+static enum hrtimer_restart tmx_torque_tick(struct hrtimer *timer)
+{
+	struct tmx_torque *torque = container_of(timer, struct tmx_torque, timer);
+	struct tmx_torque_ring *ring = torque->ring;
+	ktime_t now = ktime_get();
+	int32_t level, sum = 0;
+	unsigned long flags;
+	u32 head, count;
+	bool running;
+
+	spin_lock_irqsave(&torque->lock, flags);
+
+	running = torque->open && torque->tmx;
+	if(!running)
+		goto out;
+
+	// Pairs with the release of the producer, the samples are there
+	head = smp_load_acquire(&ring->head);
+	count = head - torque->tail;
+
+	if(count > TMX_TORQUE_RING_SAMPLES) {
+		atomic_add(count - TMX_TORQUE_RING_SAMPLES, &torque->overruns);
+		torque->tail = head - TMX_TORQUE_RING_SAMPLES;
+		count = TMX_TORQUE_RING_SAMPLES;
+	}
+
+	if(count) {
+		for(; torque->tail != head; torque->tail++)
+			sum += READ_ONCE(ring->samples[torque->tail % TMX_TORQUE_RING_SAMPLES]);
+
+		level = clamp_t(int32_t, sum / (int32_t)count, -0x7fff, 0x7fff);
+		torque->last_sample = now;
+		smp_store_release(&ring->tail, torque->tail);
+	} else {
+		atomic_inc(&torque->underruns);
+		level = torque->stream.u.constant.level;
+
+		if(level && ktime_us_delta(now, torque->last_sample) > TMX_TORQUE_STALL_US) {
+			atomic_inc(&torque->stalls);
+			level = 0;
+		}
+	}
+
+	tmx_torque_output(torque, level);
+
+out:	torque->running = running;
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	if(!running)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, torque->period);
+	return HRTIMER_RESTART;
+}
+
+/** Only one producer at a time, it gets the reserved slot */
+static int tmx_torque_open(struct inode *inode, struct file *file)
+{
+	struct tmx_torque *torque = container_of(file->private_data, struct tmx_torque, misc);
+	unsigned long flags;
+	int errno = 0;
+
+	spin_lock_irqsave(&torque->lock, flags);
+
+	if(!torque->tmx) {
+		errno = -ENODEV;
+	} else if(torque->open) {
+		errno = -EBUSY;
+	} else {
+		torque->slot = tmx_vslot_reserve(torque->tmx);
+		if(torque->slot < 0) {
+			errno = torque->slot;
+		} else {
+			memset(torque->ring, 0, sizeof(struct tmx_torque_ring));
+			torque->ring->size = TMX_TORQUE_RING_SAMPLES;
+			torque->tail = 0;
+			torque->last_sample = ktime_get();
+			torque->active = false;
+			torque->stream.u.constant.level = 0;
+			torque->open = true;
+
+			if(!torque->running) {
+				torque->running = true;
+				hrtimer_start(&torque->timer, torque->period, HRTIMER_MODE_REL);
+			}
+		}
+	}
+
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	if(errno)
+		return errno;
+
+	kref_get(&torque->kref);
+	file->private_data = torque;
+
+	return 0;
+}
+
+/** The torque is stopped and the slot given back */
+static int tmx_torque_release(struct inode *inode, struct file *file)
+{
+	struct tmx_torque *torque = file->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&torque->lock, flags);
+
+	torque->open = false;
+	if(torque->tmx) {
+		if(torque->active)
+			tmx_ff_send_play(torque->tmx, torque->slot, 0);
+		tmx_vslot_unreserve(torque->tmx, torque->slot);
+	}
+	torque->active = false;
+
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	kref_put(&torque->kref, tmx_torque_destroy);
+
+	return 0;
+}
+
+/** Maps the ring, a single page */
+static int tmx_torque_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct tmx_torque *torque = file->private_data;
+
+	if(vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	// The mapping holds a reference to the page, it outlives the device
+	return vm_insert_page(vma, vma->vm_start, torque->page);
+}
+
+static const struct file_operations tmx_torque_fops = {
+	.owner = THIS_MODULE,
+	.open = tmx_torque_open,
+	.release = tmx_torque_release,
+	.mmap = tmx_torque_mmap,
+	.llseek = noop_llseek,
+};
+
+/**
+ * Creates /dev/tmx-torqueN for a wheel
+ * @param tmx ptr to tmx
+ * @return 0 on success, -ENOMEM or an error of misc_register
+ */
+static int tmx_init_torque(struct tmx *tmx)
+{
+	struct tmx_torque *torque = kzalloc(sizeof(struct tmx_torque), GFP_KERNEL);
+	int errno = -ENOMEM;
+
+	if(!torque)
+		return -ENOMEM;
+
+	torque->page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if(!torque->page)
+		goto err0;
+	torque->ring = page_address(torque->page);
+
+	kref_init(&torque->kref);
+	spin_lock_init(&torque->lock);
+	tmx_hrtimer_setup(&torque->timer, tmx_torque_tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+
+	// At full speed bInterval is in milliseconds
+	torque->period = ms_to_ktime(max_t(uint8_t, tmx->bInterval_out, 1));
+	torque->tmx = tmx;
+
+	// The stream is a constant force pointing along the wheel axis
+	torque->stream.type = FF_CONSTANT;
+	torque->stream.direction = 0x4000;
+
+	torque->minor_id = ida_alloc(&tmx_torque_ida, GFP_KERNEL);
+	if(torque->minor_id < 0) {
+		errno = torque->minor_id;
+		goto err1;
+	}
+
+	snprintf(torque->name, sizeof(torque->name), "tmx-torque%d", torque->minor_id);
+	torque->misc.minor = MISC_DYNAMIC_MINOR;
+	torque->misc.name = torque->name;
+	torque->misc.fops = &tmx_torque_fops;
+	torque->misc.parent = &tmx->hid_device->dev;
+
+	errno = misc_register(&torque->misc);
+	if(errno)
+		goto err2;
+
+	tmx->torque = torque;
+
+	return 0;
+
+err2:	ida_free(&tmx_torque_ida, torque->minor_id);
+err1:	__free_page(torque->page);
+err0:	kfree(torque);
+	return errno;
+}
+
+/**
+ * Removes the device. An open file keeps it alive, but it's cut
+ * off from the wheel. To be called before the slots are freed
+ * @param tmx ptr to tmx
+ */
+static void tmx_free_torque(struct tmx *tmx)
+{
+	struct tmx_torque *torque = tmx->torque;
+	unsigned long flags;
+
+	if(!torque)
+		return;
+
+	misc_deregister(&torque->misc);
+	ida_free(&tmx_torque_ida, torque->minor_id);
+
+	spin_lock_irqsave(&torque->lock, flags);
+	torque->tmx = 0;
+	spin_unlock_irqrestore(&torque->lock, flags);
+
+	hrtimer_cancel(&torque->timer);
+
+	tmx->torque = 0;
+	kref_put(&torque->kref, tmx_torque_destroy);
+}
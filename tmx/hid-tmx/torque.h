@@ -0,0 +1,73 @@
+/********************************************************************
+ *			  RAW TORQUE DEVICE
+ *
+ *     /dev/tmx-torqueN lets a simulator that computes its own
+ *   torque skip the ff_effect uploads. It maps a ring of samples
+ *    that the driver drains once per output interval into the
+ *      level of a constant force on a reserved device slot
+ *******************************************************************/
+
+/** Samples in the ring, a power of two; one second at 1 kHz */
+#define TMX_TORQUE_RING_SAMPLES		1024
+/** Without new samples for this long the torque goes to zero */
+#define TMX_TORQUE_STALL_US		20000
+
+/** The page mapped by the producer. head and tail run freely, the
+ * sample n is at samples[n % size]. The producer writes the samples
+ * and then head, the driver reads everything up to head and stores
+ * how far it got in tail. A sample is a level of a constant force:
+ * -0x7fff to 0x7fff, positive pushes the same way as a constant effect
+ * with direction 0x4000 */
+struct tmx_torque_ring
+{
+	/** Written by the producer, one past the newest sample */
+	u32			head;
+	/** Written by the driver, one past the last sample it read */
+	u32			tail;
+	/** Number of samples, TMX_TORQUE_RING_SAMPLES */
+	u32			size;
+	u32			reserved;
+	s16			samples[TMX_TORQUE_RING_SAMPLES];
+};
+
+struct tmx_torque
+{
+	/** The file keeps the device alive after the wheel is gone */
+	struct kref		kref;
+	struct miscdevice	misc;
+	char			name[24];
+	int			minor_id;
+
+	spinlock_t		lock;
+	/** 0 once the wheel is removed */
+	struct tmx		*tmx;
+	/** true while the producer has the device open */
+	bool			open;
+	struct hrtimer		timer;
+	/** One tick per interval of the OUT endpoint */
+	ktime_t			period;
+	bool			running;
+
+	struct page		*page;
+	struct tmx_torque_ring	*ring;
+	/** Private copy of ring->tail, the producer can not change it */
+	u32			tail;
+	/** When the last sample arrived */
+	ktime_t			last_sample;
+
+	/** Reserved device slot and the effect on it */
+	int			slot;
+	bool			active;
+	struct ff_effect	stream;
+
+	/** Ticks without new samples, samples overwritten before being
+	 * read and times the torque fell back to zero */
+	atomic_t		underruns;
+	atomic_t		overruns;
+	atomic_t		stalls;
+};
+
+static int tmx_init_torque(struct tmx *tmx);
+static void tmx_free_torque(struct tmx *tmx);
+
+static enum hrtimer_restart tmx_torque_tick(struct hrtimer *timer);
@@ -0,0 +1,386 @@
+/**
+ * Allocates the transmit scheduler of a wheel, with a full bucket
+ * @param tmx ptr to tmx
+ * @return 0 on success, -ENOMEM otherwise
+ */
+static int tmx_init_tx(struct tmx *tmx)
+{
+	struct tmx_tx *tx = kzalloc(sizeof(struct tmx_tx), GFP_KERNEL);
+	int i;
+
+	if(!tx)
+		return -ENOMEM;
+
+	spin_lock_init(&tx->lock);
+	for(i = 0; i < TMX_TX_CLASSES; i++)
+		INIT_LIST_HEAD(&tx->queues[i].sources);
+	tmx_hrtimer_setup(&tx->timer, tmx_tx_tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+
+	// At full speed bInterval is in milliseconds
+	tx->period = ms_to_ktime(max_t(uint8_t, tmx->bInterval_out, 1));
+	tx->tokens = TMX_TX_BURST;
+
+	tmx->tx = tx;
+
+	return 0;
+}
+
+/**
+ * Stops the scheduler. The sources still queued are dropped, so that
+ * whoever waits for its turn is woken up. To be called before the URBs
+ * of the sources are killed
+ * @param tmx ptr to tmx
+ */
+static void tmx_stop_tx(struct tmx *tmx)
+{
+	struct tmx_tx *tx = tmx->tx;
+	struct tmx_tx_source *source, *next;
+	LIST_HEAD(dropped);
+	unsigned long flags;
+	int i;
+
+	if(!tx)
+		return;
+
+	spin_lock_irqsave(&tx->lock, flags);
+
+	tx->dead = true;
+	for(i = 0; i < TMX_TX_CLASSES; i++)
+		list_splice_tail_init(&tx->queues[i].sources, &dropped);
+	list_for_each_entry(source, &dropped, node)
+		source->queued = false;
+	tx->depth = 0;
+
+	spin_unlock_irqrestore(&tx->lock, flags);
+
+	list_for_each_entry_safe(source, next, &dropped, node)
+		if(source->drop)
+			source->drop(source);
+
+	hrtimer_cancel(&tx->timer);
+}
+
+/**
+ * Frees the scheduler, after all the URBs were killed
+ * @param tmx ptr to tmx
+ */
+static void tmx_free_tx(struct tmx *tmx)
+{
+	tmx_stop_tx(tmx);
+
+	kfree(tmx->tx);
+	tmx->tx = 0;
+}
+
+/**
+ * Accounts a send of a class. To be called with tx->lock held
+ * @param tx the scheduler
+ * @param class the class
+ * @param latency how long the source waited, in microseconds
+ */
+static void tmx_tx_account(struct tmx_tx *tx, enum tmx_tx_class class, u64 latency)
+{
+	struct tmx_tx_queue *queue = &tx->queues[class];
+
+	queue->sent++;
+	queue->latency_total_us += latency;
+	queue->latency_max_us = max(queue->latency_max_us, latency);
+}
+
+/**
+ * @param tx the scheduler
+ * @param class a class
+ * @return true if a source of the same or of a higher class is waiting
+ */
+static bool tmx_tx_busy(struct tmx_tx *tx, enum tmx_tx_class class)
+{
+	int i;
+
+	for(i = 0; i <= class; i++)
+		if(!list_empty(&tx->queues[i].sources))
+			return true;
+
+	return false;
+}
+
+/**
+ * Asks to send a packet. If a token is free, the class is not held back
+ * and nobody of the same or of a higher class is waiting the caller sends
+ * it right away, otherwise
+ * the source is queued and its send callback is called when its turn
+ * comes. A queued source with the same key is replaced, keeping its place
+ * in the queue. Once the scheduler is stopped the source is dropped.
+ * Safe to call in atomic context.
+ * @param tmx ptr to tmx
+ * @param source who wants to send
+ * @param class the traffic class of the packet
+ * @return true if the caller has to send now
+ */
+static bool tmx_tx_acquire(struct tmx *tmx, struct tmx_tx_source *source,
+	enum tmx_tx_class class)
+{
+	struct tmx_tx *tx = tmx->tx;
+	struct tmx_tx_source *queued, *stale = 0;
+	unsigned long flags;
+	bool now = false;
+
+	spin_lock_irqsave(&tx->lock, flags);
+
+	// Nothing is sent anymore, the source is dropped right away
+	if(tx->dead) {
+		stale = source;
+		goto out;
+	}
+
+	if(source->queued) {
+		atomic_inc(&tx->merged);
+		goto out;
+	}
+
+	source->class = class;
+
+	if(source->key) {
+		list_for_each_entry(queued, &tx->queues[class].sources, node) {
+			if(queued->key == source->key) {
+				stale = queued;
+				break;
+			}
+		}
+	}
+
+	if(stale) {
+		list_replace(&stale->node, &source->node);
+		stale->queued = false;
+		source->queued = true;
+		source->since = ktime_get();
+		atomic_inc(&tx->dropped);
+	} else if(tx->tokens && !(tx->held & BIT(class)) && !tmx_tx_busy(tx, class)) {
+		tx->tokens--;
+		tmx_tx_account(tx, class, 0);
+		now = true;
+	} else {
+		list_add_tail(&source->node, &tx->queues[class].sources);
+		source->queued = true;
+		source->since = ktime_get();
+		tx->depth++;
+		tx->depth_max = max(tx->depth, tx->depth_max);
+	}
+
+	// The timer refills the bucket and drains the queues
+	if(!tx->running) {
+		tx->running = true;
+		hrtimer_start(&tx->timer, tx->period, HRTIMER_MODE_REL);
+	}
+
+out:	spin_unlock_irqrestore(&tx->lock, flags);
+
+	if(stale && stale->drop)
+		stale->drop(stale);
+
+	return now;
+}
+
+/**
+ * Puts back in the bucket the token of a send that did not queue a
+ * transfer. To be called with tx->lock held
+ * @param tx the scheduler
+ */
+static void tmx_tx_give_back(struct tmx_tx *tx)
+{
+	if(tx->tokens < TMX_TX_BURST)
+		tx->tokens++;
+
+	atomic_inc(&tx->refunded);
+}
+
+/**
+ * Gives back the token that tmx_tx_acquire handed to a caller that in
+ * the end queued no transfer, and takes the send out of the statistics
+ * @param tmx ptr to tmx
+ * @param class the class the token was taken for
+ */
+static void tmx_tx_refund(struct tmx *tmx, enum tmx_tx_class class)
+{
+	struct tmx_tx *tx = tmx->tx;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tx->lock, flags);
+	tmx_tx_give_back(tx);
+	tx->queues[class].sent--;
+	spin_unlock_irqrestore(&tx->lock, flags);
+}
+
+/**
+ * Holds back a traffic class, or serves it again. While held its sources
+ * wait in the queue, the other classes go on. The timer runs for as long
+ * as something is queued, the next tick after the release sends them.
+ * Safe to call in atomic context
+ * @param tmx ptr to tmx
+ * @param class the class
+ * @param hold true to hold it back, false to serve it again
+ */
+static void tmx_tx_hold(struct tmx *tmx, enum tmx_tx_class class, bool hold)
+{
+	struct tmx_tx *tx = tmx->tx;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tx->lock, flags);
+	if(hold)
+		tx->held |= BIT(class);
+	else
+		tx->held &= ~BIT(class);
+	spin_unlock_irqrestore(&tx->lock, flags);
+}
+
+/** Send callback of the sources waited by tmx_tx_wait */
+static bool tmx_tx_wake(struct tmx_tx_source *source)
+{
+	complete(&container_of(source, struct tmx_tx_waiter, source)->turn);
+
+	// The waiter sends by itself
+	return true;
+}
+
+/** Drop callback of the sources waited by tmx_tx_wait */
+static void tmx_tx_wake_dead(struct tmx_tx_source *source)
+{
+	struct tmx_tx_waiter *waiter = container_of(source, struct tmx_tx_waiter, source);
+
+	waiter->errno = -ENODEV;
+	complete(&waiter->turn);
+}
+
+/**
+ * Sleeps until the scheduler gives a token to the caller, who then
+ * sends its packet synchronously
+ * @param tmx ptr to tmx
+ * @param waiter the waiter, initialized here
+ * @param class the traffic class of the packet
+ * @return 0 when it's the turn of the caller, -ENODEV if the wheel is gone
+ */
+static int tmx_tx_wait(struct tmx *tmx, struct tmx_tx_waiter *waiter, enum tmx_tx_class class)
+{
+	memset(waiter, 0, sizeof(struct tmx_tx_waiter));
+	init_completion(&waiter->turn);
+	waiter->source.send = tmx_tx_wake;
+	waiter->source.drop = tmx_tx_wake_dead;
+
+	if(tmx_tx_acquire(tmx, &waiter->source, class))
+		return 0;
+
+	wait_for_completion(&waiter->turn);
+
+	return waiter->errno;
+}
+
+/**
+ * Picks the next source to send. Classes are served in strict order of
+ * priority, except that after TMX_TX_STARVATION_LIMIT tokens in a row
+ * went to a higher class the lowest waiting class gets one, unless the
+ * higher class has a play or a stop first in line. The classes held back
+ * are skipped.
+ * To be called with tx->lock held
+ * @param tx the scheduler
+ * @return the source, 0 if nothing can be sent
+ */
+static struct tmx_tx_source *tmx_tx_next(struct tmx_tx *tx)
+{
+	struct tmx_tx_source *source;
+	int first = -1, last = -1, i;
+
+	for(i = 0; i < TMX_TX_CLASSES; i++) {
+		if(tx->held & BIT(i) || list_empty(&tx->queues[i].sources))
+			continue;
+		if(first < 0)
+			first = i;
+		last = i;
+	}
+
+	if(first < 0)
+		return 0;
+
+	source = list_first_entry(&tx->queues[first].sources, struct tmx_tx_source, node);
+
+	// A play or a stop goes first whatever waits behind it
+	if(first == last) {
+		tx->bypassed = 0;
+	} else if(!TMX_TX_KEY_IS_PLAY(source->key) && ++tx->bypassed > TMX_TX_STARVATION_LIMIT) {
+		tx->bypassed = 0;
+		source = list_first_entry(&tx->queues[last].sources, struct tmx_tx_source, node);
+	}
+
+	return source;
+}
+
+/**
+ * Sends the queued sources for as long as there are tokens. The sources
+ * are called without the lock held, they may queue themselves again
+ * @param tx the scheduler
+ */
+static void tmx_tx_dispatch(struct tmx_tx *tx)
+{
+	struct tmx_tx_source *source;
+	enum tmx_tx_class class;
+	unsigned long flags;
+	u64 latency;
+	bool sent;
+
+	for(;;) {
+		spin_lock_irqsave(&tx->lock, flags);
+
+		source = tx->dead || !tx->tokens ? 0 : tmx_tx_next(tx);
+		if(!source) {
+			spin_unlock_irqrestore(&tx->lock, flags);
+			return;
+		}
+
+		list_del(&source->node);
+		source->queued = false;
+		tx->depth--;
+		tx->tokens--;
+		// The source may queue itself again while sending
+		class = source->class;
+		latency = ktime_us_delta(ktime_get(), source->since);
+
+		spin_unlock_irqrestore(&tx->lock, flags);
+
+		sent = source->send(source);
+
+		// Only what reached the endpoint uses the bandwidth
+		spin_lock_irqsave(&tx->lock, flags);
+		if(sent)
+			tmx_tx_account(tx, class, latency);
+		else
+			tmx_tx_give_back(tx);
+		spin_unlock_irqrestore(&tx->lock, flags);
+	}
+}
+
+/**
+ * Timer of the scheduler, adds a token every interval of the endpoint.
+ * It stops once the bucket is full and nobody is waiting
+ */
+static enum hrtimer_restart tmx_tx_tick(struct hrtimer *timer)
+{
+	struct tmx_tx *tx = container_of(timer, struct tmx_tx, timer);
+	unsigned long flags;
+	bool running;
+
+	spin_lock_irqsave(&tx->lock, flags);
+	if(tx->tokens < TMX_TX_BURST)
+		tx->tokens++;
+	spin_unlock_irqrestore(&tx->lock, flags);
+
+	tmx_tx_dispatch(tx);
+
+	spin_lock_irqsave(&tx->lock, flags);
+	running = tx->running = !tx->dead &&
+		(tx->tokens < TMX_TX_BURST || tx->depth);
+	spin_unlock_irqrestore(&tx->lock, flags);
+
+	if(!running)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, tx->period);
+	return HRTIMER_RESTART;
+}